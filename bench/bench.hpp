@@ -0,0 +1,72 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+// A tiny benchmarking harness used by the path tracer microbenchmarks.
+
+// The result of a benchmark.
+struct BenchmarkResult {
+    std::string name;
+    uint64_t operations; // The total number of operations that were run.
+    double seconds; // The total time spent running them.
+    const char* unit = "ops"; // What an operation is (e.g. "rays" or "prims"), used to print the throughput.
+
+    inline double get_ns_per_op() const { return seconds * 1e9 / operations; }
+    inline double get_mops_per_second() const { return operations / seconds * 1e-6; }
+};
+
+// A sink that prevents the compiler from optimizing away the benchmarked work.
+// Each benchmark should add a value depending on its results to it.
+inline volatile float benchmark_sink = 0.0f;
+
+// A measurement which is not a timing (such as a memory size or a build time), reported next to the benchmark results.
+struct BenchmarkValue {
+    std::string name;
+    double value;
+    std::string unit;
+};
+
+// All the results and values printed so far, so that they can be written to a JSON file at the end of the run.
+inline std::vector<BenchmarkResult> benchmark_results;
+inline std::vector<BenchmarkValue> benchmark_values;
+
+// Runs `fn` repeatedly for at least `min_seconds` and returns the timing. 
+// Every call to `fn` must run `operations_per_call` operations of the given unit.
+template<typename F>
+BenchmarkResult run_benchmark(const std::string& name, uint64_t operations_per_call, F&& fn, const char* unit = "ops", double min_seconds = 0.5) {
+    using clock = std::chrono::high_resolution_clock;
+    // Warm up the caches and the branch predictors first.
+    fn();
+    BenchmarkResult result = { name, 0, 0.0, unit };
+    auto start = clock::now();
+    do {
+        fn();
+        result.operations += operations_per_call;
+        result.seconds = std::chrono::duration<double>(clock::now() - start).count();
+    } while(result.seconds < min_seconds);
+    return result;
+}
+
+// Prints the result of a benchmark as a row of the result table, and records it.
+inline void print_benchmark_result(const BenchmarkResult& result) {
+    printf("%-40s %12.2f ns/op %12.2f M%s/s\n", result.name.c_str(), result.get_ns_per_op(), result.get_mops_per_second(), result.unit);
+    benchmark_results.push_back(result);
+}
+
+// Prints a value as a row of the result table, and records it.
+inline void print_benchmark_value(const std::string& name, double value, const std::string& unit) {
+    printf("%-40s %12.2f %s\n", name.c_str(), value, unit.c_str());
+    benchmark_values.push_back({ name, value, unit });
+}
+
+// The benchmark suites (each one prints its own results).
+void bench_materials();
+void bench_camera();
+void bench_geometry();
+void bench_accelerators();
+void bench_kernels();
+void bench_scaling();
@@ -0,0 +1,100 @@
+#include "bench.hpp"
+
+#include <scene.hpp>
+#include <scene_setup.hpp>
+
+#include <vector>
+#include <random>
+#include <functional>
+
+// A scene to compare the acceleration structures on, and the region its rays are shot from and aimed at.
+struct AcceleratorBenchmarkCase {
+    const char* name;
+    std::function<void(Scene&)> setup;
+    glm::vec3 eye;
+    AABB targets;
+};
+
+// Compares the build time and the cost of intersecting rays of each acceleration structure on scenes with different distributions of shapes:
+// - city: a few hundred triangles on a huge ground plane (the grids waste most of their cells on the empty ground).
+// - sphere-field: 32K spheres spread evenly in a cube (where the uniform grid shines).
+// - stadium: 32K tiny spheres in the middle of a large sparse scene (which only the two-level grid and the BVH resolve).
+void bench_accelerators() {
+    printf("== Accelerators ==\n");
+
+    std::shared_ptr<Material> white = std::make_shared<LambertMaterial>(Color(0.8f, 0.8f, 0.8f));
+    // The scenes are generated with a fixed seed so that the runs are reproducible.
+    std::vector<AcceleratorBenchmarkCase> cases = {
+        { "city", [](Scene& scene) { setup_city_scene(scene, 3); }, glm::vec3(-6.0f, 6.0f, 10.0f), { glm::vec3(-4.0f, 0.0f, -4.0f), glm::vec3(4.0f, 5.0f, 4.0f) } },
+        { "sphere-field", [&](Scene& scene) {
+            std::mt19937 rng(42);
+            std::uniform_real_distribution<float> jitter(-0.5f, 0.5f);
+            scene.start_construction();
+            for(int z = 0; z < 32; ++z)
+                for(int y = 0; y < 32; ++y)
+                    for(int x = 0; x < 32; ++x)
+                        scene.add_sphere(white, glm::vec3(x + jitter(rng), y + jitter(rng), z + jitter(rng)) * 3.0f, 0.5f);
+            scene.finish_construction();
+        }, glm::vec3(48.0f, 48.0f, -40.0f), { glm::vec3(0.0f), glm::vec3(96.0f) } },
+        { "stadium", [&](Scene& scene) {
+            std::mt19937 rng(42);
+            std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+            scene.start_construction();
+            scene.add_rectangle(white, glm::vec3(0.0f), glm::vec2(1000.0f, 1000.0f));
+            for(int i = 0; i < 256; ++i) scene.add_sphere(white, glm::vec3(unit(rng) * 1000.0f - 500.0f, unit(rng) * 20.0f, unit(rng) * 1000.0f - 500.0f), 2.0f);
+            for(int i = 0; i < 32768; ++i) scene.add_sphere(white, glm::vec3(unit(rng) * 2.0f - 1.0f, unit(rng) * 2.0f, unit(rng) * 2.0f - 1.0f), 0.02f);
+            scene.finish_construction();
+        }, glm::vec3(0.0f, 10.0f, -60.0f), { glm::vec3(-2.0f, 0.0f, -2.0f), glm::vec3(2.0f, 2.0f, 2.0f) } },
+    };
+
+    // Testing every shape is only measured on the small scenes, since it takes seconds on the large ones.
+    const size_t MAX_SHAPES_WITHOUT_ACCELERATOR = 4096;
+    const int RAY_COUNT = 1 << 14;
+    for(const AcceleratorBenchmarkCase& benchmark_case: cases) {
+        Scene scene;
+        benchmark_case.setup(scene);
+
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::vector<Ray> rays(RAY_COUNT);
+        for(Ray& ray: rays) {
+            glm::vec3 target = glm::mix(benchmark_case.targets.vmin, benchmark_case.targets.vmax, glm::vec3(unit(rng), unit(rng), unit(rng)));
+            ray.origin = benchmark_case.eye;
+            ray.direction = glm::normalize(target - ray.origin);
+        }
+
+        // The BVH is also measured with smaller leaves than its default (a full packet of shapes).
+        struct Configuration { AcceleratorType type; uint32_t bvh_leaf_size; };
+        std::vector<Configuration> configurations = {
+            { AcceleratorType::NONE, DEFAULT_BVH_LEAF_SIZE },
+            { AcceleratorType::BVH, DEFAULT_BVH_LEAF_SIZE },
+            { AcceleratorType::BVH, 1 },
+            { AcceleratorType::BVH, 4 },
+            { AcceleratorType::GRID, DEFAULT_BVH_LEAF_SIZE },
+            { AcceleratorType::TWO_LEVEL_GRID, DEFAULT_BVH_LEAF_SIZE },
+        };
+        for(const Configuration& configuration: configurations) {
+            AcceleratorType type = configuration.type;
+            std::string name = std::string(benchmark_case.name) + "-" + get_accelerator_name(type);
+            if(type == AcceleratorType::BVH && configuration.bvh_leaf_size != DEFAULT_BVH_LEAF_SIZE) name += "-leaf" + std::to_string(configuration.bvh_leaf_size);
+            if(type == AcceleratorType::NONE && scene.get_shapes().size() > MAX_SHAPES_WITHOUT_ACCELERATOR) continue;
+
+            // The scene was constructed without an accelerator, so each one is built over a copy of its shapes.
+            std::vector<Shape*> shapes = scene.get_shapes();
+            Arena arena(MemoryCategory::ACCELERATORS);
+            auto start = std::chrono::high_resolution_clock::now();
+            const Accelerator* accelerator = create_accelerator(type, shapes, arena, configuration.bvh_leaf_size);
+            std::chrono::duration<double, std::milli> build_duration = std::chrono::high_resolution_clock::now() - start;
+            print_benchmark_value("accel/build-" + name, build_duration.count(), "ms");
+
+            print_benchmark_result(run_benchmark("accel/intersect-" + name, RAY_COUNT, [&]() {
+                float sum = 0.0f;
+                for(const Ray& ray: rays) {
+                    RayHit hit;
+                    if(accelerator ? accelerator->intersect(ray, hit) : scene.intersect(ray, hit)) sum += hit.distance;
+                }
+                benchmark_sink = benchmark_sink + sum;
+            }, "rays"));
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#include "bench.hpp"
+
+#include <camera.hpp>
+
+#include <vector>
+#include <random>
+
+// Compares generating the primary rays of a tile one by one with Camera::get_ray
+// against generating them all at once with the TileRayGenerator.
+void bench_camera() {
+    printf("== Camera ==\n");
+
+    const glm::ivec2 TILE_SIZE(64, 64);
+    const int RAY_COUNT = TILE_SIZE.x * TILE_SIZE.y;
+    Camera camera(glm::vec3(0.0f, 1.0f, 3.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::radians(60.0f), glm::ivec2(1920, 1080));
+    const glm::ivec2 tile_origin(640, 512);
+
+    // Generate the jitters with a fixed seed so that the runs are reproducible.
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> jitter_distribution(0.0f, 1.0f);
+    std::vector<float> jitter_x(RAY_COUNT), jitter_y(RAY_COUNT);
+    for(int i = 0; i < RAY_COUNT; ++i) {
+        jitter_x[i] = jitter_distribution(rng);
+        jitter_y[i] = jitter_distribution(rng);
+    }
+
+    std::vector<Ray> rays(RAY_COUNT);
+    print_benchmark_result(run_benchmark("camera/get_ray", RAY_COUNT, [&]() {
+        for(int y = 0; y < TILE_SIZE.y; ++y) {
+            for(int x = 0; x < TILE_SIZE.x; ++x) {
+                int index = y * TILE_SIZE.x + x;
+                rays[index] = camera.get_ray(glm::vec2(tile_origin.x + x + jitter_x[index], tile_origin.y + y + jitter_y[index]));
+            }
+        }
+        float sum = 0.0f;
+        for(const Ray& ray: rays) sum += ray.direction.x;
+        benchmark_sink = benchmark_sink + sum;
+    }));
+
+    TileRayGenerator generator(camera);
+    RayBatch batch;
+    auto checksum = [&]() {
+        float sum = 0.0f;
+        for(float value: batch.direction_x) sum += value;
+        benchmark_sink = benchmark_sink + sum;
+    };
+    print_benchmark_result(run_benchmark("camera/tile-batch-jittered", RAY_COUNT, [&]() {
+        generator.generate(tile_origin, TILE_SIZE, jitter_x.data(), jitter_y.data(), batch);
+        checksum();
+    }));
+    print_benchmark_result(run_benchmark("camera/tile-batch-centered", RAY_COUNT, [&]() {
+        generator.generate(tile_origin, TILE_SIZE, nullptr, nullptr, batch);
+        checksum();
+    }));
+}
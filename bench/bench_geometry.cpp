@@ -0,0 +1,55 @@
+#include "bench.hpp"
+
+#include <mesh.hpp>
+
+#include <vector>
+#include <cmath>
+#include <random>
+
+// Compares the memory used by a large mesh in each storage mode against the cost of intersecting rays with it.
+void bench_geometry() {
+    printf("== Geometry ==\n");
+
+    // A rolling terrain of 2M triangles, so the mesh is much larger than the caches.
+    const int GRID_SIZE = 1024;
+    std::vector<glm::vec3> vertices;
+    std::vector<uint32_t> indices;
+    vertices.reserve((GRID_SIZE + 1) * (GRID_SIZE + 1));
+    for(int z = 0; z <= GRID_SIZE; ++z) {
+        for(int x = 0; x <= GRID_SIZE; ++x) {
+            float u = float(x) / GRID_SIZE, v = float(z) / GRID_SIZE;
+            vertices.emplace_back(u * 100.0f, 4.0f * std::sin(u * 17.0f) * std::cos(v * 13.0f), v * 100.0f);
+        }
+    }
+    for(int z = 0; z < GRID_SIZE; ++z) {
+        for(int x = 0; x < GRID_SIZE; ++x) {
+            uint32_t corner = z * (GRID_SIZE + 1) + x;
+            indices.insert(indices.end(), { corner, corner + 1, corner + GRID_SIZE + 2, corner, corner + GRID_SIZE + 2, corner + GRID_SIZE + 1 });
+        }
+    }
+
+    // Random rays from above the terrain towards random points on it, generated with a fixed seed so that the runs are reproducible.
+    const int RAY_COUNT = 1 << 16;
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> position_distribution(0.0f, 100.0f);
+    std::vector<Ray> rays(RAY_COUNT);
+    for(Ray& ray: rays) {
+        ray.origin = glm::vec3(position_distribution(rng), 30.0f, position_distribution(rng));
+        glm::vec3 target = glm::vec3(position_distribution(rng), 0.0f, position_distribution(rng));
+        ray.direction = glm::normalize(target - ray.origin);
+    }
+
+    struct Mode { const char* name; MeshStorage storage; };
+    for(Mode mode: { Mode{ "full", MeshStorage::FULL }, Mode{ "compact16", MeshStorage::COMPACT16 }, Mode{ "compact8", MeshStorage::COMPACT8 } }) {
+        TriangleMesh mesh(vertices, indices, mode.storage, nullptr);
+        print_benchmark_value(std::string("geometry/memory-") + mode.name, double(mesh.get_memory_size()) / mesh.get_triangle_count(), "bytes per triangle");
+        print_benchmark_result(run_benchmark(std::string("geometry/intersect-") + mode.name, RAY_COUNT, [&]() {
+            float sum = 0.0f;
+            for(const Ray& ray: rays) {
+                RayHit hit;
+                if(mesh.intersect(ray, hit)) sum += hit.distance;
+            }
+            benchmark_sink = benchmark_sink + sum;
+        }, "rays"));
+    }
+}
@@ -0,0 +1,170 @@
+#include "bench.hpp"
+
+#include <scene.hpp>
+#include <scene_setup.hpp>
+
+#include <gtc/constants.hpp>
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <functional>
+
+// The rays of a built-in scene on which the kernels are measured.
+struct KernelRaySet {
+    const char* name;
+    std::vector<Ray> rays;
+};
+
+// Captures two ray sets from the camera of a scene, generated with a fixed seed so that the runs are reproducible:
+// - coherent: the primary rays through the pixel centers in tile order, which traverse the same nodes one after the other.
+// - incoherent: diffuse bounces from the first hits of the primary rays in a random order (the rays which miss are
+//   replaced by random rays inside the scene), which jump all over the acceleration structure.
+static std::vector<KernelRaySet> capture_ray_sets(const Scene& scene, glm::ivec2 resolution, glm::ivec2 tile_size) {
+    Camera camera = scene.get_camera();
+    camera.set_viewport_size(resolution);
+    TileRayGenerator generator(camera);
+    RayBatch batch;
+    KernelRaySet coherent = { "coherent", {} };
+    for(int tile_y = 0; tile_y < resolution.y; tile_y += tile_size.y) {
+        for(int tile_x = 0; tile_x < resolution.x; tile_x += tile_size.x) {
+            glm::ivec2 size = glm::min(tile_size, resolution - glm::ivec2(tile_x, tile_y));
+            generator.generate(glm::ivec2(tile_x, tile_y), size, nullptr, nullptr, batch);
+            for(int index = 0; index < batch.size(); ++index) coherent.rays.push_back(batch.get_ray(index));
+        }
+    }
+
+    // The random values come from get_random_unit, one statement at a time, so that the rays are the same with every compiler and standard library.
+    std::mt19937 rng(42);
+    auto random_direction = [&]() {
+        float z = 1.0f - 2.0f * get_random_unit(rng);
+        float phi = glm::two_pi<float>() * get_random_unit(rng);
+        float r = glm::sqrt(glm::max(0.0f, 1.0f - z * z));
+        return glm::vec3(r * glm::cos(phi), r * glm::sin(phi), z);
+    };
+    auto random_point = [&]() {
+        float x = get_random_unit(rng);
+        float y = get_random_unit(rng);
+        float z = get_random_unit(rng);
+        return glm::vec3(x, y, z);
+    };
+    AABB bounds = scene.get_bounds();
+    KernelRaySet incoherent = { "incoherent", {} };
+    for(const Ray& ray: coherent.rays) {
+        RayHit hit;
+        Ray bounce;
+        if(scene.intersect(ray, hit)) {
+            bounce.direction = random_direction();
+            if(glm::dot(bounce.direction, hit.normal) < 0.0f) bounce.direction = -bounce.direction;
+            bounce.origin = ray.origin + ray.direction * hit.distance + hit.normal * 1e-3f;
+        } else {
+            bounce.direction = random_direction();
+            bounce.origin = glm::mix(bounds.vmin, bounds.vmax, random_point());
+        }
+        incoherent.rays.push_back(bounce);
+    }
+    // A Fisher-Yates shuffle, since std::shuffle is not the same with every standard library either.
+    for(size_t index = incoherent.rays.size(); index > 1; --index) std::swap(incoherent.rays[index - 1], incoherent.rays[rng() % index]);
+    return { std::move(coherent), std::move(incoherent) };
+}
+
+// Measures the kernels that dominate the render time on ray sets captured from the built-in scenes:
+// the ray-box, ray-triangle & ray-sphere tests (against the first shapes of the scene), the BVH traversal,
+// the material sampling at the hits, and the build of each acceleration structure (in primitives per second).
+void bench_kernels() {
+    printf("== Kernels ==\n");
+
+    struct SceneCase { const char* name; std::function<void(Scene&)> setup; };
+    std::vector<SceneCase> scenes = {
+        { "cornell_box0", [](Scene& scene) { setup_cornell_box_scene(scene, 0); } },
+        { "balls2", [](Scene& scene) { setup_balls_scene(scene, 2); } },
+        { "city3", [](Scene& scene) { setup_city_scene(scene, 3); } },
+    };
+
+    // The primitive tests run each ray against this many shapes of the scene (or all of them if there are fewer).
+    const size_t MAX_TESTED_SHAPES = 64;
+    for(const SceneCase& scene_case: scenes) {
+        Scene scene;
+        scene.set_use_bvh(true);
+        scene_case.setup(scene);
+        std::string prefix = std::string("kernels/") + scene_case.name + "/";
+        std::vector<KernelRaySet> ray_sets = capture_ray_sets(scene, glm::ivec2(128, 128), glm::ivec2(16, 16));
+
+        std::vector<AABB> boxes;
+        std::vector<const Triangle*> triangles;
+        std::vector<const Sphere*> spheres;
+        for(const Shape* shape: scene.get_shapes()) {
+            if(boxes.size() < MAX_TESTED_SHAPES) boxes.push_back(shape->get_bounds());
+            if(auto triangle = dynamic_cast<const Triangle*>(shape); triangle && triangles.size() < MAX_TESTED_SHAPES) triangles.push_back(triangle);
+            if(auto sphere = dynamic_cast<const Sphere*>(shape); sphere && spheres.size() < MAX_TESTED_SHAPES) spheres.push_back(sphere);
+        }
+
+        for(const KernelRaySet& ray_set: ray_sets) {
+            const std::vector<Ray>& rays = ray_set.rays;
+            std::string suffix = std::string("-") + ray_set.name;
+
+            print_benchmark_result(run_benchmark(prefix + "aabb" + suffix, rays.size() * boxes.size(), [&]() {
+                float sum = 0.0f;
+                for(const Ray& ray: rays) {
+                    for(const AABB& box: boxes) {
+                        float distance;
+                        if(box.intersect_ray(ray, distance)) sum += distance;
+                    }
+                }
+                benchmark_sink = benchmark_sink + sum;
+            }, "tests"));
+            auto bench_shapes = [&](const std::string& kernel, const auto& shapes) {
+                if(shapes.empty()) return;
+                print_benchmark_result(run_benchmark(prefix + kernel + suffix, rays.size() * shapes.size(), [&]() {
+                    float sum = 0.0f;
+                    for(const Ray& ray: rays) {
+                        for(const auto* shape: shapes) {
+                            RayHit hit;
+                            if(shape->intersect(ray, hit)) sum += hit.distance;
+                        }
+                    }
+                    benchmark_sink = benchmark_sink + sum;
+                }, "tests"));
+            };
+            bench_shapes("triangle", triangles);
+            bench_shapes("sphere", spheres);
+
+            print_benchmark_result(run_benchmark(prefix + "bvh-intersect" + suffix, rays.size(), [&]() {
+                float sum = 0.0f;
+                for(const Ray& ray: rays) {
+                    RayHit hit;
+                    if(scene.intersect(ray, hit)) sum += hit.distance;
+                }
+                benchmark_sink = benchmark_sink + sum;
+            }, "rays"));
+
+            // The material is sampled at every hit of the ray set.
+            struct MaterialQuery { RayHit hit; glm::vec3 direction, point; };
+            std::vector<MaterialQuery> queries;
+            for(const Ray& ray: rays) {
+                RayHit hit;
+                if(scene.intersect(ray, hit)) queries.push_back({ hit, ray.direction, ray.origin + ray.direction * hit.distance });
+            }
+            if(!queries.empty()) {
+                print_benchmark_result(run_benchmark(prefix + "material-sample" + suffix, queries.size(), [&]() {
+                    float sum = 0.0f;
+                    for(const MaterialQuery& query: queries) {
+                        MaterialSample sample = scene.sample_material(query.hit, query.direction, query.point);
+                        sum += sample.factor.x + sample.emission.x + sample.outgoing_ray_direction.x;
+                    }
+                    benchmark_sink = benchmark_sink + sum;
+                }, "samples"));
+            }
+        }
+
+        // Each build starts from a copy of the shapes in the order of the scene, since the BVH reorders them.
+        for(AcceleratorType type: { AcceleratorType::BVH, AcceleratorType::GRID, AcceleratorType::TWO_LEVEL_GRID }) {
+            std::vector<Shape*> shapes;
+            print_benchmark_result(run_benchmark(prefix + "build-" + get_accelerator_name(type), scene.get_shapes().size(), [&]() {
+                shapes = scene.get_shapes();
+                Arena arena(MemoryCategory::ACCELERATORS);
+                benchmark_sink = benchmark_sink + (create_accelerator(type, shapes, arena, scene.get_bvh_leaf_size()) != nullptr);
+            }, "prims"));
+        }
+    }
+}
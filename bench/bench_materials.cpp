@@ -0,0 +1,67 @@
+#include "bench.hpp"
+
+#include <material.hpp>
+
+#include <memory>
+#include <vector>
+#include <random>
+
+// Compares the throughput of sampling materials through the virtual Material hierarchy 
+// against the tagged MaterialTable (both one by one and batched per material type).
+void bench_materials() {
+    printf("== Materials ==\n");
+
+    // A mix of materials similar to the built-in scenes.
+    std::vector<std::shared_ptr<Material>> hierarchy = {
+        std::make_shared<LambertMaterial>(Color(0.8f, 0.8f, 0.8f)),
+        std::make_shared<LambertMaterial>(Color(0.8f, 0.2f, 0.1f)),
+        std::make_shared<SmoothMetalMaterial>(Color(0.3f, 0.4f, 0.5f)),
+        std::make_shared<EmissiveMaterial>(Color(5.0f)),
+        std::make_shared<LambertMaterial>(Color(0.0f, 0.8f, 0.0f)),
+        std::make_shared<SmoothMetalMaterial>(Colors::YELLOW),
+    };
+    MaterialTable table;
+    for(const auto& material: hierarchy) table.add(*material);
+
+    // Generate random queries with a fixed seed so that the runs are reproducible.
+    const int QUERY_COUNT = 4096;
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int32_t> material_distribution(0, static_cast<int32_t>(hierarchy.size()) - 1);
+    std::normal_distribution<float> direction_distribution;
+    auto random_direction = [&]() {
+        return glm::normalize(glm::vec3(direction_distribution(rng), direction_distribution(rng), direction_distribution(rng)) + 1e-6f);
+    };
+    std::vector<MaterialQuery> queries(QUERY_COUNT);
+    for(MaterialQuery& query: queries) {
+        query.material_id = material_distribution(rng);
+        query.incoming_ray_direction = random_direction();
+        query.hit_point = random_direction() * 10.0f;
+        query.hit_normal = random_direction();
+    }
+    std::vector<MaterialSample> samples(QUERY_COUNT);
+
+    auto checksum = [&]() {
+        float sum = 0.0f;
+        for(const MaterialSample& sample: samples) sum += sample.factor.x + sample.emission.x + sample.outgoing_ray_direction.x;
+        benchmark_sink = benchmark_sink + sum;
+    };
+
+    print_benchmark_result(run_benchmark("material/virtual", QUERY_COUNT, [&]() {
+        for(int i = 0; i < QUERY_COUNT; ++i) {
+            const MaterialQuery& query = queries[i];
+            samples[i] = hierarchy[query.material_id]->sample(query.incoming_ray_direction, query.hit_point, query.hit_normal);
+        }
+        checksum();
+    }));
+    print_benchmark_result(run_benchmark("material/table", QUERY_COUNT, [&]() {
+        for(int i = 0; i < QUERY_COUNT; ++i) {
+            const MaterialQuery& query = queries[i];
+            samples[i] = table.sample(query.material_id, query.incoming_ray_direction, query.hit_point, query.hit_normal);
+        }
+        checksum();
+    }));
+    print_benchmark_result(run_benchmark("material/table-batched", QUERY_COUNT, [&]() {
+        table.sample(queries, samples);
+        checksum();
+    }));
+}
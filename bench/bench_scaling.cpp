@@ -0,0 +1,51 @@
+#include "bench.hpp"
+
+#include <scene.hpp>
+#include <scene_setup.hpp>
+#include <memory.hpp>
+
+#include <vector>
+#include <random>
+
+// Measures how the setup time (with the BVH build), the memory and the cost of intersecting rays grow with the size
+// of the generated scenes (see setup_generated_scene), from a thousand to a million primitives.
+// The rays are shot from the camera of each scene towards random points of its bounds, with a fixed seed.
+void bench_scaling() {
+    printf("== Scaling ==\n");
+
+    const int RAY_COUNT = 1 << 14;
+    for(const char* type: { "spheres", "terrain", "blocks" }) {
+        for(const char* count: { "1e3", "1e4", "1e5", "1e6" }) {
+            std::string name = std::string(type) + "-" + count;
+            size_t memory_before = get_tracked_memory(MemoryCategory::PRIMITIVES) + get_tracked_memory(MemoryCategory::ACCELERATORS);
+            Scene scene;
+            scene.set_accelerator_type(AcceleratorType::BVH);
+            auto start = std::chrono::high_resolution_clock::now();
+            setup_generated_scene(scene, name);
+            std::chrono::duration<double, std::milli> setup_duration = std::chrono::high_resolution_clock::now() - start;
+            size_t memory_after = get_tracked_memory(MemoryCategory::PRIMITIVES) + get_tracked_memory(MemoryCategory::ACCELERATORS);
+            print_benchmark_value("scaling/setup-" + name, setup_duration.count(), "ms");
+            print_benchmark_value("scaling/memory-" + name, (memory_after - memory_before) / 1048576.0, "MB");
+
+            std::mt19937 rng(42);
+            AABB bounds = scene.get_bounds();
+            std::vector<Ray> rays(RAY_COUNT);
+            for(Ray& ray: rays) {
+                float x = get_random_unit(rng);
+                float y = get_random_unit(rng);
+                float z = get_random_unit(rng);
+                glm::vec3 target = glm::mix(bounds.vmin, bounds.vmax, glm::vec3(x, y, z));
+                ray.origin = scene.get_camera().get_position();
+                ray.direction = glm::normalize(target - ray.origin);
+            }
+            print_benchmark_result(run_benchmark("scaling/intersect-" + name, RAY_COUNT, [&]() {
+                float sum = 0.0f;
+                for(const Ray& ray: rays) {
+                    RayHit hit;
+                    if(scene.intersect(ray, hit)) sum += hit.distance;
+                }
+                benchmark_sink = benchmark_sink + sum;
+            }, "rays"));
+        }
+    }
+}
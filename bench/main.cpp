@@ -0,0 +1,57 @@
+#include "bench.hpp"
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <fstream>
+
+// Writes all the recorded results and values to a JSON file, so that they can be compared across commits.
+static bool write_json(const std::string& path) {
+    std::ofstream file(path);
+    if(!file) return false;
+    file << "{\n  \"results\": [";
+    for(size_t index = 0; index < benchmark_results.size(); ++index) {
+        const BenchmarkResult& result = benchmark_results[index];
+        file << (index == 0 ? "\n" : ",\n")
+             << "    { \"name\": \"" << result.name << "\", \"unit\": \"" << result.unit << "\""
+             << ", \"operations\": " << result.operations << ", \"seconds\": " << result.seconds
+             << ", \"ns_per_op\": " << result.get_ns_per_op() << ", \"mops_per_second\": " << result.get_mops_per_second() << " }";
+    }
+    file << "\n  ],\n  \"values\": [";
+    for(size_t index = 0; index < benchmark_values.size(); ++index) {
+        const BenchmarkValue& value = benchmark_values[index];
+        file << (index == 0 ? "\n" : ",\n")
+             << "    { \"name\": \"" << value.name << "\", \"value\": " << value.value << ", \"unit\": \"" << value.unit << "\" }";
+    }
+    file << "\n  ]\n}\n";
+    return static_cast<bool>(file);
+}
+
+int main(int argc, char** argv) {
+    // The suites to run can be filtered by passing their names as arguments (all of them run by default).
+    // "--json path" also writes the results to a JSON file.
+    std::vector<std::string> suites;
+    std::string json_path;
+    for(int i = 1; i < argc; ++i) {
+        if(std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) json_path = argv[++i];
+        else suites.push_back(argv[i]);
+    }
+    auto should_run = [&](const char* suite) {
+        if(suites.empty()) return true;
+        for(const std::string& name: suites) if(name == suite) return true;
+        return false;
+    };
+
+    if(should_run("materials")) bench_materials();
+    if(should_run("camera")) bench_camera();
+    if(should_run("geometry")) bench_geometry();
+    if(should_run("accelerators")) bench_accelerators();
+    if(should_run("kernels")) bench_kernels();
+    if(should_run("scaling")) bench_scaling();
+
+    if(!json_path.empty() && !write_json(json_path)) {
+        printf("Could not write the results to %s\n", json_path.c_str());
+        return 1;
+    }
+    return 0;
+}
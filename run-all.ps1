@@ -10,6 +10,6 @@ $scenes = @(
 
 New-Item -Path .\output -ItemType Directory -Force
 
-foreach ($scene in $scenes) {
-    & .\build\path-tracer.exe $scene -o .\output\$scene.png -s 1000 -b 5
-}
\ No newline at end of file
+# All the scenes are rendered by a single process, which writes each image while the next one renders.
+$scenes | ForEach-Object { "$_ .\output\$_.png 1000 5" } | Set-Content -Path .\output\jobs.txt
+& .\build\path-tracer.exe batch .\output\jobs.txt
\ No newline at end of file
@@ -1,9 +1,5 @@
 #include "aabb.hpp"
 
-AABB AABB::merge(const AABB& other) const {
-    return {glm::min(vmin, other.vmin), glm::max(vmax, other.vmax)};
-}
-
 bool AABB::intersect_ray(const Ray& ray, float& hit_distance) const {
     // Ray vs AABB using the Slab Method
     glm::vec3 frac = 1.0f / ray.direction;
@@ -19,9 +15,4 @@ bool AABB::intersect_ray(const Ray& ray, float& hit_distance) const {
     if (tmin > tmax) return false; // no intersection
     hit_distance = tmin;
     return true;
-}
-
-float AABB::compute_surface_area() const {
-    glm::vec3 size = vmax - vmin;
-    return 2 * (size.x * size.y + size.y * size.z + size.z * size.x);
 }
\ No newline at end of file
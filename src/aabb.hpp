@@ -9,9 +9,26 @@ struct AABB {
     glm::vec3 vmin, vmax;
 
     // Generate an AABB that encompasses this AABB and the other AABB.
-    AABB merge(const AABB& other) const;
+    // Defined inline since the BVH builders call it for every primitive at every level.
+    inline AABB merge(const AABB& other) const {
+        return {glm::min(vmin, other.vmin), glm::max(vmax, other.vmax)};
+    }
     // Intersect a ray with the bounding box. Returns true if the ray intersects the AABB and the distance to the hit.
     bool intersect_ray(const Ray& ray, float& hit_distance) const;
+    // The same test given the inverse of the ray direction, for the BVH traversals which compute it once per ray instead of once per box.
+    inline bool intersect_ray(const Ray& ray, const glm::vec3& inverse_direction, float& hit_distance) const {
+        glm::vec3 t0 = (vmin - ray.origin) * inverse_direction;
+        glm::vec3 t1 = (vmax - ray.origin) * inverse_direction;
+        glm::vec3 t_near = glm::min(t0, t1), t_far = glm::max(t0, t1);
+        float tmin = glm::max(glm::max(t_near.x, t_near.y), t_near.z);
+        float tmax = glm::min(glm::min(t_far.x, t_far.y), t_far.z);
+        if(tmax < 0 || tmin > tmax) return false;
+        hit_distance = tmin;
+        return true;
+    }
     // Compute the surface area of the AABB.
-    float compute_surface_area() const;
+    inline float compute_surface_area() const {
+        glm::vec3 size = vmax - vmin;
+        return 2 * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
 };
\ No newline at end of file
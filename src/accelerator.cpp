@@ -0,0 +1,31 @@
+#include "accelerator.hpp"
+#include "bvh.hpp"
+#include "grid.hpp"
+
+#include <iterator>
+
+// The commandline names of the accelerator types indexed by the AcceleratorType enum.
+static const char* ACCELERATOR_NAMES[] = { "none", "bvh", "grid", "grid2" };
+
+const Accelerator* create_accelerator(AcceleratorType type, std::span<Shape*> shapes, Arena& arena, uint32_t bvh_leaf_size) {
+    switch(type) {
+    case AcceleratorType::BVH: return arena.create<BVHAccelerator>(shapes, bvh_leaf_size);
+    case AcceleratorType::GRID: return arena.create<GridAccelerator>(shapes, false);
+    case AcceleratorType::TWO_LEVEL_GRID: return arena.create<GridAccelerator>(shapes, true);
+    default: return nullptr;
+    }
+}
+
+bool parse_accelerator_type(const std::string& name, AcceleratorType& type) {
+    for(size_t index = 0; index < std::size(ACCELERATOR_NAMES); ++index) {
+        if(name == ACCELERATOR_NAMES[index]) {
+            type = static_cast<AcceleratorType>(index);
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* get_accelerator_name(AcceleratorType type) {
+    return ACCELERATOR_NAMES[static_cast<int>(type)];
+}
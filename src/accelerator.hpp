@@ -0,0 +1,37 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <cstdint>
+
+#include <ray.hpp>
+#include <arena.hpp>
+#include <shapes.hpp>
+
+// The acceleration structures the scene can use to find the closest shape hit by a ray.
+enum class AcceleratorType {
+    NONE, // Test the ray against every shape.
+    BVH, // A bounding volume hierarchy (see bvh.hpp), which adapts to any distribution of the shapes.
+    GRID, // A uniform grid (see grid.hpp), which is the fastest to build and traverse when the shapes are spread evenly.
+    TWO_LEVEL_GRID, // A coarse grid whose crowded cells hold finer grids (see grid.hpp), for scenes with an uneven density.
+};
+
+// The common interface of the acceleration structures built over the shapes of a scene.
+// They are created in the scene's arena next to the shapes, and only keep plain pointers to them.
+class Accelerator {
+public:
+    virtual ~Accelerator() = default;
+    // Intersects the ray with the shapes and returns true if it hits any of them.
+    // hit will contain the closest hit (including the material id of its shape).
+    virtual bool intersect(const Ray& ray, RayHit& hit) const = 0;
+};
+
+// Builds an accelerator of the given type over the shapes in the arena, or returns null for AcceleratorType::NONE.
+// The BVH is built with at most about bvh_leaf_size shapes per leaf.
+// Warning: this function may reorder the shapes in the given span.
+const Accelerator* create_accelerator(AcceleratorType type, std::span<Shape*> shapes, Arena& arena, uint32_t bvh_leaf_size);
+
+// Parses the name of an accelerator type (none, bvh, grid or grid2). Returns false if the name is invalid.
+bool parse_accelerator_type(const std::string& name, AcceleratorType& type);
+// Returns the name of the accelerator type (as used on the commandline).
+const char* get_accelerator_name(AcceleratorType type);
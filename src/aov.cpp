@@ -0,0 +1,74 @@
+#include "aov.hpp"
+
+#include <cmath>
+#include <sstream>
+
+// The commandline names of the AOVs indexed by the AOV enum.
+static const char* AOV_NAMES[] = { "depth", "normal", "albedo", "id", "bounces", "direct", "indirect" };
+
+bool parse_aov(const std::string& name, AOV& aov) {
+    for(size_t index = 0; index < std::size(AOV_NAMES); ++index) {
+        if(name == AOV_NAMES[index]) {
+            aov = static_cast<AOV>(index);
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* get_aov_name(AOV aov) {
+    return AOV_NAMES[static_cast<int>(aov)];
+}
+
+bool is_aov_recorded(AOV aov) {
+    // The path AOVs are only filled once path_trace_1spp records its paths into SampleContext::records (see its TODO),
+    // otherwise they would always be written black.
+    return aov != AOV::BOUNCES && aov != AOV::DIRECT && aov != AOV::INDIRECT;
+}
+
+bool parse_aov_list(const std::string& list, std::vector<AOV>& aovs) {
+    std::stringstream stream(list);
+    std::string name;
+    while(std::getline(stream, name, ',')) {
+        if(name.empty()) continue;
+        AOV aov;
+        if(!parse_aov(name, aov) || !is_aov_recorded(aov)) return false;
+        aovs.push_back(aov);
+    }
+    return true;
+}
+
+// Generates a distinct color for each material id using the golden ratio to spread the hues.
+static Color get_material_id_color(int32_t id) {
+    if(id < 0) return Colors::BLACK;
+    float hue = id * 0.618033988749895f;
+    return convert_HSL_to_RGB(hue - glm::floor(hue), 0.75f, 0.5f);
+}
+
+Image make_aov_image(const AOVBuffers& buffers, AOV aov, uint32_t max_bounces) {
+    Image image(buffers.width, buffers.height);
+    for(int y = 0; y < buffers.height; ++y) {
+        for(int x = 0; x < buffers.width; ++x) {
+            Color color;
+            switch(aov) {
+            case AOV::DEPTH: {
+                // Same mapping as the distance debug mode (the background is drawn as white).
+                float depth = buffers.depth_at(x, y);
+                color = Color(std::isfinite(depth) ? depth * 0.1f : 1000000.0f);
+                break;
+            }
+            case AOV::NORMAL: 
+                // Same mapping as the normal debug mode (the background is drawn as white).
+                color = std::isfinite(buffers.depth_at(x, y)) ? buffers.normal(x, y) * 0.5f + 0.5f : Color(1000000.0f); 
+                break;
+            case AOV::ALBEDO: color = buffers.albedo(x, y); break;
+            case AOV::MATERIAL_ID: color = get_material_id_color(buffers.material_id_at(x, y)); break;
+            case AOV::BOUNCES: color = Color(buffers.bounces_at(x, y) / glm::max(max_bounces, 1u)); break;
+            case AOV::DIRECT: color = buffers.direct(x, y); break;
+            case AOV::INDIRECT: color = buffers.indirect(x, y); break;
+            }
+            image(x, y) = color;
+        }
+    }
+    return image;
+}
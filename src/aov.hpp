@@ -0,0 +1,70 @@
+#pragma once
+
+#include <image.hpp>
+
+#include <string>
+#include <vector>
+#include <limits>
+#include <cstdint>
+
+// The statistics of a single path that the path tracer records for each pixel of a sample.
+struct PathRecord {
+    Color direct = Colors::BLACK; // The light reaching the camera directly from the first hit (its emission or the background).
+    Color indirect = Colors::BLACK; // The light reaching the camera after bouncing at least once.
+    uint32_t bounces = 0; // The number of bounces made by the path.
+};
+
+// Arbitrary Output Variables (AOVs) that are written alongside the rendered image in the same pass.
+// The first hit AOVs describe the first visible surface seen through each pixel. They are noise-free guides that 
+// post-processing stages (such as the denoiser) can use to detect edges. 
+// The path AOVs are averaged over all the samples like the rendered image.
+struct AOVBuffers {
+    AOVBuffers(int width, int height) : 
+        width(width), height(height), 
+        albedo(width, height), normal(width, height), 
+        depth(width * height, std::numeric_limits<float>::infinity()), material_id(width * height, -1),
+        direct(width, height), indirect(width, height), bounces(width * height, 0.0f) {}
+
+    int width, height;
+    // First hit AOVs
+    Image albedo; // The albedo of the material at the first hit (black if the background was hit).
+    Image normal; // The surface normal at the first hit (zero if the background was hit).
+    TrackedVector<float, MemoryCategory::FRAMEBUFFERS> depth; // The distance to the first hit (infinity if the background was hit).
+    TrackedVector<int32_t, MemoryCategory::FRAMEBUFFERS> material_id; // The scene material id at the first hit (-1 if the background was hit).
+    // Path AOVs
+    Image direct; // The average light reaching the camera directly from the first hit.
+    Image indirect; // The average light reaching the camera after bouncing at least once.
+    TrackedVector<float, MemoryCategory::FRAMEBUFFERS> bounces; // The average number of bounces per path.
+
+    // Access the per-pixel scalars by pixel coordinates
+    inline float& depth_at(int x, int y) { return depth[y * width + x]; }
+    inline float depth_at(int x, int y) const { return depth[y * width + x]; }
+    inline int32_t& material_id_at(int x, int y) { return material_id[y * width + x]; }
+    inline int32_t material_id_at(int x, int y) const { return material_id[y * width + x]; }
+    inline float& bounces_at(int x, int y) { return bounces[y * width + x]; }
+    inline float bounces_at(int x, int y) const { return bounces[y * width + x]; }
+};
+
+// The kinds of AOVs that can be written to files.
+enum class AOV {
+    DEPTH,
+    NORMAL,
+    ALBEDO,
+    MATERIAL_ID,
+    BOUNCES,
+    DIRECT,
+    INDIRECT
+};
+
+// Parses an AOV name (as used on the commandline) and returns true if it is valid.
+bool parse_aov(const std::string& name, AOV& aov);
+// Returns the name of the AOV (as used on the commandline and in the output file names).
+const char* get_aov_name(AOV aov);
+// Returns true if the renderer fills the AOV. The path AOVs (bounces, direct & indirect) are not filled yet.
+bool is_aov_recorded(AOV aov);
+// Parses a comma separated list of AOV names. Returns false if any of the names is invalid or names an AOV which is not recorded.
+bool parse_aov_list(const std::string& list, std::vector<AOV>& aovs);
+
+// Converts an AOV to a viewable image.
+// The bounce count is divided by `max_bounces` so that it fits in the range [0,1].
+Image make_aov_image(const AOVBuffers& buffers, AOV aov, uint32_t max_bounces);
@@ -0,0 +1,47 @@
+#include "arena.hpp"
+
+#include <algorithm>
+
+Arena::Arena(Arena&& other) noexcept : category(other.category) {
+    *this = std::move(other);
+}
+
+Arena& Arena::operator=(Arena&& other) noexcept {
+    if(this != &other) {
+        reset();
+        std::swap(blocks, other.blocks);
+        std::swap(destructors, other.destructors);
+        std::swap(cursor, other.cursor);
+        std::swap(block_end, other.block_end);
+        std::swap(capacity, other.capacity);
+        std::swap(category, other.category);
+    }
+    return *this;
+}
+
+void Arena::reset() {
+    // The objects are destroyed in the reverse order of their construction.
+    for(auto it = destructors.rbegin(); it != destructors.rend(); ++it) it->destroy(it->object);
+    destructors.clear();
+    blocks.clear();
+    track_memory(category, -static_cast<int64_t>(capacity));
+    cursor = block_end = nullptr;
+    capacity = 0;
+}
+
+void* Arena::allocate_in_new_block(size_t size, size_t alignment) {
+    size_t block_size = std::clamp(capacity, MIN_BLOCK_SIZE, MAX_BLOCK_SIZE);
+    block_size = std::max(block_size, size + alignment);
+    blocks.push_back(std::make_unique_for_overwrite<std::byte[]>(block_size));
+    capacity += block_size;
+    track_memory(category, static_cast<int64_t>(block_size));
+    // A block that only fits this allocation is used for it alone, so the current block can still be filled.
+    std::byte* block = blocks.back().get();
+    if(cursor != nullptr && block_size > MAX_BLOCK_SIZE) {
+        uintptr_t address = (reinterpret_cast<uintptr_t>(block) + alignment - 1) & ~uintptr_t(alignment - 1);
+        return reinterpret_cast<void*>(address);
+    }
+    cursor = block;
+    block_end = block + block_size;
+    return allocate(size, alignment);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <new>
+#include <span>
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <type_traits>
+
+#include <memory.hpp>
+
+// A monotonic memory arena which allocates objects one after the other in large blocks and frees them all at once.
+// Allocating is a pointer increment, the objects created together are next to each other in memory,
+// and freeing everything costs one deallocation per block instead of one per object.
+// The destructors of trivially destructible objects are never called. The others are recorded and called by reset.
+// The blocks are counted in the memory category given to the arena.
+class Arena {
+public:
+    explicit Arena(MemoryCategory category) : category(category) {}
+    ~Arena() { reset(); }
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    Arena(Arena&& other) noexcept;
+    Arena& operator=(Arena&& other) noexcept;
+
+    // Allocates uninitialized memory which stays valid until reset is called.
+    inline void* allocate(size_t size, size_t alignment) {
+        uintptr_t address = (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~uintptr_t(alignment - 1);
+        if(cursor == nullptr || address + size > reinterpret_cast<uintptr_t>(block_end)) return allocate_in_new_block(size, alignment);
+        cursor = reinterpret_cast<std::byte*>(address + size);
+        return reinterpret_cast<void*>(address);
+    }
+
+    // Constructs an object in the arena and returns a pointer to it (which does not own it).
+    template<typename T, typename... Args>
+    T* create(Args&&... args) {
+        T* object = new(allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if constexpr(!std::is_trivially_destructible_v<T>) {
+            destructors.push_back({ object, [](void* pointer) { static_cast<T*>(pointer)->~T(); } });
+        }
+        return object;
+    }
+
+    // Allocates an array of trivial values in the arena (the values are not initialized).
+    template<typename T>
+    std::span<T> create_array(size_t count) {
+        static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>, "Arena arrays only hold trivial values");
+        return std::span<T>(static_cast<T*>(allocate(count * sizeof(T), alignof(T))), count);
+    }
+
+    // Destroys all the objects and frees all the memory of the arena.
+    void reset();
+
+    // Returns the total size of the blocks allocated by the arena.
+    inline size_t get_capacity() const { return capacity; }
+
+private:
+    // The first block is small, then each block doubles the capacity up to MAX_BLOCK_SIZE, so small scenes stay small
+    // and large scenes need few blocks. Allocations larger than a block get a block of their own.
+    static constexpr size_t MIN_BLOCK_SIZE = 64 << 10;
+    static constexpr size_t MAX_BLOCK_SIZE = 16 << 20;
+
+    struct Destructor {
+        void* object;
+        void (*destroy)(void*);
+    };
+
+    std::vector<std::unique_ptr<std::byte[]>> blocks;
+    std::vector<Destructor> destructors;
+    std::byte* cursor = nullptr;
+    std::byte* block_end = nullptr;
+    size_t capacity = 0;
+    MemoryCategory category;
+
+    void* allocate_in_new_block(size_t size, size_t alignment);
+};
@@ -11,17 +11,21 @@ public:
     virtual Color sample(glm::vec3 direction) = 0;
 };
 
+// The sample functions of the final backgrounds are defined inline, so that the render kernels specialized for them
+// (see render_kernel.hpp) can inline them without a virtual call.
+
 // A simple background that returns a constant color everywhere.
-class SimpleBackground : public Background {
+class SimpleBackground final : public Background {
 public:
     SimpleBackground(Color color) : color(color) {}
-    Color sample(glm::vec3 direction) override;
+    inline Color sample(glm::vec3 direction) override { return color; }
+    inline Color get_color() const { return color; }
 private:
     Color color;
 };
 
 // A simplified sky background that returns a gradient of colors based on the direction, then adds a sun over it.
-class SkyBackground : public Background {
+class SkyBackground final : public Background {
 public:
     // The sky color is defined as a gradient from the top to bottom using the colors in order [top, horizon, bottom].
     // Then a sun with the sun color is added over the sky in the given direction. The sun size is defined by the sun angle and feathering.
@@ -29,9 +33,25 @@ public:
         Color top, Color horizon, Color bottom, 
         Color sun, glm::vec3 sun_direction, float sun_angle = glm::radians(1.0f), float sun_feathering = glm::radians(1.0f)
     );
-    Color sample(glm::vec3 direction) override;
+    inline Color sample(glm::vec3 direction) override {
+        // First, we sample the sky color from the gradient defined by [top, horizon, bottom].
+        Color sky = glm::mix(horizon, (direction.y > 0.0f ? top : bottom), direction.y * direction.y);
+        // Then we mix it with the sun color if the ray is facing towards the sun.
+        float sun_mixing_factor = glm::smoothstep(sun_cos_angles.y, sun_cos_angles.x, glm::dot(direction, sun_direction));
+        return glm::mix(sky, sun, sun_mixing_factor);
+    }
+
+    // Getters for the parameters given to the constructor
+    inline Color get_top() const { return top; }
+    inline Color get_horizon() const { return horizon; }
+    inline Color get_bottom() const { return bottom; }
+    inline Color get_sun() const { return sun; }
+    inline glm::vec3 get_sun_direction() const { return sun_direction; }
+    inline float get_sun_angle() const { return sun_angle; }
+    inline float get_sun_feathering() const { return sun_feathering; }
 private:
     Color top, horizon, bottom, sun;
+    float sun_angle, sun_feathering;
     glm::vec2 sun_cos_angles;
     glm::vec3 sun_direction;
 };
\ No newline at end of file
@@ -3,146 +3,184 @@
 #include <vector>
 #include <algorithm>
 
-BVHNode::BVHNode() {
-    this->left = this->right = nullptr;
-    this->shapes = {};
-}
+//////////////
+// Flat BVH //
+//////////////
 
-BVHNode::BVHNode(std::span<std::shared_ptr<Shape>> shapes) {
-    build(shapes);
-}
+// The state shared by the recursive steps of build_flat_bvh.
+struct FlatBVHBuilder {
+    static constexpr int BIN_COUNT = 16;
 
-void BVHNode::build(std::span<std::shared_ptr<Shape>> shapes) {
-    this->left = this->right = nullptr;
-    this->shapes = {};
-    if(shapes.size() == 0) return;
-    // Compute the AABB of this node.
-    bounds = shapes[0]->get_bounds();
-    for(int i = 1; i < shapes.size(); ++i)
-        bounds = bounds.merge(shapes[i]->get_bounds());
-    // Call the internal build function to take the work from here.
-    _build(shapes, bounds);
-}
+    // The primitives are partitioned in place with their bounds, so each step reads a contiguous range of memory.
+    struct Primitive {
+        AABB bounds;
+        glm::vec3 centroid;
+        uint32_t index;
+    };
+    std::vector<Primitive> primitives;
+    std::vector<FlatBVHNode>& nodes;
+    uint32_t max_leaf_size;
 
-bool BVHNode::intersect_ray(const Ray& ray, RayHit& hit) const {
-    hit.distance = std::numeric_limits<float>::max();
-    float t;
-    // The ray doesn't hit this node's AABB, we can skip it.
-    if(!bounds.intersect_ray(ray, t)) return false;
-    // Call the internal intersect function to take the work from here.
-    return _intersect_ray(ray, hit);
-}
+    void build(uint32_t begin, uint32_t end, int depth) {
+        // Compute the bounds of the node and of the centroids of its primitives.
+        AABB bounds = primitives[begin].bounds;
+        AABB centroid_bounds = { primitives[begin].centroid, primitives[begin].centroid };
+        for(uint32_t i = begin + 1; i < end; ++i) {
+            bounds = bounds.merge(primitives[i].bounds);
+            centroid_bounds.vmin = glm::min(centroid_bounds.vmin, primitives[i].centroid);
+            centroid_bounds.vmax = glm::max(centroid_bounds.vmax, primitives[i].centroid);
+        }
+        size_t index = nodes.size();
+        nodes.push_back({ bounds.vmin, begin, bounds.vmax, end - begin });
+        uint32_t count = end - begin;
+        if(count <= max_leaf_size) return;
+
+        // Select the splitting dimension. We choose the dimension with the maximum extent of the centroids.
+        glm::vec3 extent = centroid_bounds.vmax - centroid_bounds.vmin;
+        int split_dim = 0;
+        if(extent[1] > extent[split_dim]) split_dim = 1;
+        if(extent[2] > extent[split_dim]) split_dim = 2;
+        // All the centroids are at the same position, so no split can separate them.
+        if(extent[split_dim] <= 0.0f) return;
+
+        Primitive* first = primitives.data() + begin;
+        Primitive* last = primitives.data() + end;
+        Primitive* middle = first;
+        if(depth < MAX_FLAT_BVH_DEPTH - 32) {
+            // Put the primitives in bins along the splitting dimension, and evaluate the SAH at each boundary between bins.
+            float bin_scale = BIN_COUNT / extent[split_dim] * 0.9999f;
+            float bin_start = centroid_bounds.vmin[split_dim];
+            auto get_bin = [=](const Primitive& primitive) {
+                return static_cast<int>((primitive.centroid[split_dim] - bin_start) * bin_scale);
+            };
+            uint32_t bin_counts[BIN_COUNT] = {};
+            AABB bin_bounds[BIN_COUNT];
+            for(const Primitive* primitive = first; primitive != last; ++primitive) {
+                int bin = get_bin(*primitive);
+                bin_bounds[bin] = bin_counts[bin] == 0 ? primitive->bounds : bin_bounds[bin].merge(primitive->bounds);
+                bin_counts[bin]++;
+            }
+            float right_areas[BIN_COUNT];
+            uint32_t right_counts[BIN_COUNT];
+            AABB right_bounds;
+            uint32_t right_count = 0;
+            for(int bin = BIN_COUNT - 1; bin > 0; --bin) {
+                if(bin_counts[bin] > 0) right_bounds = right_count == 0 ? bin_bounds[bin] : right_bounds.merge(bin_bounds[bin]);
+                right_count += bin_counts[bin];
+                right_counts[bin] = right_count;
+                right_areas[bin] = right_count > 0 ? right_bounds.compute_surface_area() : 0.0f;
+            }
+            // Initially, the best choice is not to split and its cost is the SAH of this node.
+            int best_split = 0;
+            float best_cost = count * bounds.compute_surface_area();
+            AABB left_bounds;
+            uint32_t left_count = 0;
+            for(int bin = 1; bin < BIN_COUNT; ++bin) {
+                if(bin_counts[bin - 1] > 0) left_bounds = left_count == 0 ? bin_bounds[bin - 1] : left_bounds.merge(bin_bounds[bin - 1]);
+                left_count += bin_counts[bin - 1];
+                if(left_count == 0 || right_counts[bin] == 0) continue;
+                float cost = left_count * left_bounds.compute_surface_area() + right_counts[bin] * right_areas[bin];
+                if(cost < best_cost) {
+                    best_cost = cost;
+                    best_split = bin;
+                }
+            }
+            // Small nodes stay leaves when splitting does not pay off. Larger ones are split anyway to keep the leaves short.
+            if(best_split == 0 && count <= 4 * max_leaf_size) return;
+            if(best_split > 0) {
+                middle = std::partition(first, last, [&](const Primitive& primitive) { return get_bin(primitive) < best_split; });
+            }
+        }
+        if(middle == first || middle == last) {
+            // Split at the median when the SAH gave no split (or when the tree is getting too deep), which halves the depth left.
+            middle = first + count / 2;
+            std::nth_element(first, middle, last, [split_dim](const Primitive& a, const Primitive& b) {
+                return a.centroid[split_dim] < b.centroid[split_dim];
+            });
+        }
 
-void BVHNode::_build(std::span<std::shared_ptr<Shape>> shapes, AABB bounds) {
-    this->bounds = bounds;
-    // We stop the construction if the remaining shape count is 1 or 0.
-    if(shapes.size() <= 1) {
-        this->shapes = shapes;
-        left = right = nullptr;
-        return;
+        uint32_t split = static_cast<uint32_t>(middle - primitives.data());
+        nodes[index].count = 0;
+        build(begin, split, depth + 1);
+        nodes[index].offset = static_cast<uint32_t>(nodes.size());
+        build(split, end, depth + 1);
     }
+};
 
-    // Select the splitting dimension. We choose the dimension with the maximum length on the AABB.
-    glm::vec3 aabb_size = bounds.vmax - bounds.vmin;
-    int split_dim = 0;
-    if(aabb_size[1] > aabb_size[split_dim]) split_dim = 1;
-    if(aabb_size[2] > aabb_size[split_dim]) split_dim = 2;
+void build_flat_bvh(std::span<const AABB> primitive_bounds, std::vector<FlatBVHNode>& nodes, std::vector<uint32_t>& order, uint32_t max_leaf_size) {
+    nodes.clear();
+    order.resize(primitive_bounds.size());
+    if(primitive_bounds.empty()) return;
+    FlatBVHBuilder builder = { std::vector<FlatBVHBuilder::Primitive>(primitive_bounds.size()), nodes, glm::max(max_leaf_size, 1u) };
+    for(uint32_t i = 0; i < primitive_bounds.size(); ++i) {
+        builder.primitives[i] = { primitive_bounds[i], 0.5f * (primitive_bounds[i].vmin + primitive_bounds[i].vmax), i };
+    }
+    nodes.reserve(2 * primitive_bounds.size() / builder.max_leaf_size + 1);
+    builder.build(0, static_cast<uint32_t>(primitive_bounds.size()), 0);
+    for(uint32_t i = 0; i < primitive_bounds.size(); ++i) order[i] = builder.primitives[i].index;
+}
 
-    // We sort the shapes along the splitting dimension, so that we can split later by just taking slices.
-    std::sort(shapes.begin(), shapes.end(), [split_dim](const auto& a, const auto& b) { 
-        return a->get_bounds().vmin[split_dim] < b->get_bounds().vmin[split_dim]; 
-    });
+/////////////////////
+// BVH Accelerator //
+/////////////////////
 
-    // At each possible splitting point, we compute that the AABBs for both sides of the split.  
-    std::vector<AABB> aabbs_left, aabbs_right;
-    aabbs_left.resize(shapes.size());
-    aabbs_left[0] = shapes[0]->get_bounds();
-    for(int i = 1; i < shapes.size(); ++i) aabbs_left[i] = aabbs_left[i-1].merge(shapes[i]->get_bounds());
-    aabbs_right.resize(shapes.size());
-    aabbs_right[shapes.size()-1] = shapes[shapes.size()-1]->get_bounds();
-    for(int i = shapes.size()-2; i >= 0; --i) aabbs_right[i] = aabbs_right[i+1].merge(shapes[i]->get_bounds());
+// The order of the shape types in the lanes of a packet.
+static int get_packet_order(const Shape* shape) {
+    if(dynamic_cast<const Sphere*>(shape)) return 0;
+    if(dynamic_cast<const Triangle*>(shape)) return 1;
+    return 2;
+}
 
-    // We will select the splitting point using the Surface Area Heuristic (SAH)
-    // Initially, the best choice is not the split and it is cost is the SAH of this node.
-    int best_split_point = 0;
-    float best_cost = shapes.size() * bounds.compute_surface_area();
-    // Then we loop over the split points, compute the SAH, and check if it is better than our current choice.
-    for(int split_point = 1; split_point < shapes.size() - 1; split_point++) {
-        AABB aabb_left = aabbs_left[split_point-1];
-        AABB aabb_right = aabbs_right[split_point];
-        float cost = split_point * aabb_left.compute_surface_area() + (shapes.size() - split_point) * aabb_right.compute_surface_area();
-        if(cost < best_cost) {
-            best_cost = cost;
-            best_split_point = split_point;
-        }
-    }
+BVHAccelerator::BVHAccelerator(std::span<Shape*> shapes, uint32_t leaf_size) {
+    if(shapes.empty()) return;
+    std::vector<AABB> shape_bounds(shapes.size());
+    for(size_t index = 0; index < shapes.size(); ++index) shape_bounds[index] = shapes[index]->get_bounds();
+    std::vector<FlatBVHNode> flat_nodes;
+    std::vector<uint32_t> order;
+    build_flat_bvh(shape_bounds, flat_nodes, order, leaf_size);
+
+    // Sort the shapes in the order of the leaves.
+    std::vector<Shape*> sorted_shapes(shapes.size());
+    for(size_t index = 0; index < shapes.size(); ++index) sorted_shapes[index] = shapes[order[index]];
+    std::copy(sorted_shapes.begin(), sorted_shapes.end(), shapes.begin());
 
-    if(best_split_point == 0) {
-        // If not splitting is still the best option based on SAH, we make this a leaf node.
-        this->shapes = shapes;
-        left = right = nullptr;
-    } else {
-        // Otherwise, we split the shapes at the splitting point, recursively construct two children, one for each split.
-        left = std::make_shared<BVHNode>();
-        left->_build(shapes.subspan(0, best_split_point), aabbs_left[best_split_point-1]);
-        right = std::make_shared<BVHNode>();
-        right->_build(shapes.subspan(best_split_point), aabbs_right[best_split_point]);
-        this->shapes = {};
+    // Then group the shapes of each leaf by type and split them into packets, so the leaves refer to ranges of packets.
+    nodes.assign(flat_nodes.begin(), flat_nodes.end());
+    packets.reserve(shapes.size() / SHAPE_PACKET_WIDTH + nodes.size() / 2 + 1);
+    this->shapes.reserve(shapes.size());
+    for(FlatBVHNode& node: nodes) {
+        if(node.count == 0) continue;
+        std::span<Shape*> leaf_shapes = shapes.subspan(node.offset, node.count);
+        std::stable_sort(leaf_shapes.begin(), leaf_shapes.end(), [](const Shape* a, const Shape* b) { return get_packet_order(a) < get_packet_order(b); });
+        uint32_t first_packet = static_cast<uint32_t>(packets.size());
+        for(uint32_t first = 0; first < node.count; first += SHAPE_PACKET_WIDTH) {
+            add_packet(leaf_shapes.subspan(first, std::min(SHAPE_PACKET_WIDTH, node.count - first)));
+        }
+        node.offset = first_packet;
+        node.count = static_cast<uint32_t>(packets.size()) - first_packet;
     }
 }
 
-bool BVHNode::_intersect_ray(const Ray& ray, RayHit& hit) const {
-    // Note: we assume the hit.distance constains the best hit distance found till now while traversing the BVH.
-    if(left) { // If left (or right) is not null, then this is not a leaf node.
-        // First, we check if the ray intersects the AABBs of the children and if they yield a closer intersection than the current best.
-        float left_dist;
-        bool left_hit = left->bounds.intersect_ray(ray, left_dist) && left_dist < hit.distance;
-        float right_dist;
-        bool right_hit = right->bounds.intersect_ray(ray, right_dist) && right_dist < hit.distance;
-
-        if(left_hit && right_hit) {
-            // If it hits both, we start at the child with the closer AABB hit first,
-            // since it may yield a hit that occludes the other child's AABB, so we can skip the other child; 
-            if(left_dist < right_dist) {
-                // Intersect ray with left child first.
-                left_hit = left->_intersect_ray(ray, hit);
-                // If the best hit distance is still farther than the right child's AABB hit, 
-                // we intersect the ray with the right child.
-                if(right_dist < hit.distance) {
-                    right_hit = right->_intersect_ray(ray, hit);    
-                }
-                return left_hit || right_hit;
-            } else {
-                // Intersect ray with left child first.
-                right_hit = right->_intersect_ray(ray, hit);
-                // If the best hit distance is still farther than the left child's AABB hit, 
-                // we intersect the ray with the left child.
-                if(left_dist < hit.distance) {
-                    left_hit = left->_intersect_ray(ray, hit);    
-                }
-                // Return true if either child was a hit.
-                return left_hit || right_hit;
-            }
-        } else if(left_hit) {
-            // If only the left AABBs intersected the ray, intersect ray with left child only.
-            return left->_intersect_ray(ray, hit);
-        } else if(right_hit) {
-            // If only the right AABBs intersected the ray, intersect ray with right child only.
-            return right->_intersect_ray(ray, hit);
-        } else {
-            // No hit
-            return false;
+void BVHAccelerator::add_packet(std::span<Shape* const> packet_shapes) {
+    ShapePacket& packet = packets.emplace_back();
+    packet.first_shape = static_cast<uint32_t>(shapes.size());
+    packet.first_sphere = static_cast<uint32_t>(spheres.size());
+    packet.first_triangle = static_cast<uint32_t>(triangles.size() / 3);
+    packet.shape_count = static_cast<uint8_t>(packet_shapes.size());
+    for(uint32_t lane = 0; lane < packet_shapes.size(); ++lane) {
+        const Shape* shape = packet_shapes[lane];
+        AABB bounds = shape->get_bounds();
+        for(int axis = 0; axis < 3; ++axis) {
+            packet.bounds_min[axis][lane] = bounds.vmin[axis];
+            packet.bounds_max[axis][lane] = bounds.vmax[axis];
         }
-    } else {
-        // If this is a child node, we loop over the shapes and intersect the ray against them.
-        bool has_hit = false;
-        for(auto shape: shapes) {
-            RayHit shape_hit;
-            if(shape->intersect(ray, shape_hit) && shape_hit.distance < hit.distance) {
-                has_hit = true;
-                hit = shape_hit;
-            }
+        if(auto sphere = dynamic_cast<const Sphere*>(shape)) {
+            spheres.emplace_back(sphere->get_center(), sphere->get_radius());
+            packet.sphere_count++;
+        } else if(auto triangle = dynamic_cast<const Triangle*>(shape)) {
+            for(int vertex = 0; vertex < 3; ++vertex) triangles.push_back(triangle->get_vertex(vertex));
+            packet.triangle_count++;
         }
-        return has_hit;
+        shapes.push_back(shape);
     }
-}
\ No newline at end of file
+}
@@ -1,32 +1,329 @@
 #pragma once
 
 #include <span>
+#include <bit>
+#include <cmath>
+#include <algorithm>
 #include <memory>
+#include <vector>
+#include <limits>
+#include <cstdint>
 
 #include <ray.hpp>
 #include <shapes.hpp>
+#include <accelerator.hpp>
+#include <memory.hpp>
 
-// A Bounding Volume Hierarchy (BVH) node which contains a bounding box and either a list of shapes or two child BVH nodes.
-class BVHNode {
+// A node of a BVH stored in a flat array (32 bytes), so it can be written to and read from a file as is.
+// The nodes are in depth-first order, so the left child of an inner node always follows it.
+struct FlatBVHNode {
+    glm::vec3 vmin;
+    uint32_t offset; // The index of the right child in inner nodes, or of the first shape in leaves.
+    glm::vec3 vmax;
+    uint32_t count; // The number of shapes in leaves (0 in inner nodes).
+};
+
+// The maximum depth of the flat BVHs built by build_flat_bvh (the traversal stack is sized for it).
+constexpr int MAX_FLAT_BVH_DEPTH = 64;
+
+// Builds a BVH over primitives given their bounds, and stores it as flat nodes in depth-first order.
+// The leaves refer to ranges of `order`, which receives the indices of the primitives sorted in the order of the leaves.
+// The splits are chosen using the binned Surface Area Heuristic, which is fast enough to build models with millions of triangles when they are loaded.
+void build_flat_bvh(std::span<const AABB> primitive_bounds, std::vector<FlatBVHNode>& nodes, std::vector<uint32_t>& order, uint32_t max_leaf_size = 4);
+
+// Traverses a flat BVH front to back and calls `intersect_leaf(first, count)` on each leaf that the ray may hit closer than hit.distance.
+// intersect_leaf must return true if it found a closer hit (after updating hit.distance).
+// Returns true if any leaf found a hit. The BVH must be at most MAX_FLAT_BVH_DEPTH levels deep.
+template<typename F>
+bool intersect_flat_bvh(std::span<const FlatBVHNode> nodes, const Ray& ray, const RayHit& hit, F&& intersect_leaf) {
+    if(nodes.empty()) return false;
+    glm::vec3 inverse_direction = 1.0f / ray.direction;
+    struct StackEntry { uint32_t node; float distance; };
+    StackEntry stack[MAX_FLAT_BVH_DEPTH + 1];
+    int stack_size = 0;
+    float root_distance;
+    if(!AABB{ nodes[0].vmin, nodes[0].vmax }.intersect_ray(ray, inverse_direction, root_distance)) return false;
+    stack[stack_size++] = { 0, root_distance };
+
+    bool has_hit = false;
+    while(stack_size > 0) {
+        StackEntry entry = stack[--stack_size];
+        // A closer hit may have been found since the node was pushed.
+        if(entry.distance >= hit.distance) continue;
+        const FlatBVHNode& node = nodes[entry.node];
+        if(node.count > 0) {
+            has_hit |= intersect_leaf(node.offset, node.count);
+            continue;
+        }
+        // A BVH deeper than MAX_FLAT_BVH_DEPTH has its deepest nodes skipped instead of overflowing the stack.
+        if(stack_size + 2 > MAX_FLAT_BVH_DEPTH + 1) continue;
+        uint32_t children[2] = { entry.node + 1, node.offset };
+        // A missed child keeps an infinite distance, so it is never taken for the closer one.
+        float distances[2] = { std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity() };
+        bool hits[2];
+        for(int child = 0; child < 2; ++child) {
+            const FlatBVHNode& child_node = nodes[children[child]];
+            hits[child] = AABB{ child_node.vmin, child_node.vmax }.intersect_ray(ray, inverse_direction, distances[child]) && distances[child] < hit.distance;
+        }
+        // Push the farther child first, so the closer one is visited first.
+        int farther = distances[0] <= distances[1] ? 1 : 0;
+        if(hits[farther]) stack[stack_size++] = { children[farther], distances[farther] };
+        if(hits[1 - farther]) stack[stack_size++] = { children[1 - farther], distances[1 - farther] };
+    }
+    return has_hit;
+}
+
+// A flat BVH in which the bounds of the children of each inner node are quantized to integers of type T (uint8_t or uint16_t)
+// relative to the bounds of the node, so a node takes 20 bytes (8-bit) or 32 bytes (16-bit) and the leaves only take 4 bytes.
+// The bounds are decoded during the traversal, and they are rounded outwards so they always contain the exact bounds.
+template<typename T>
+class QuantizedBVH {
 public:
-    // Construct an Empty BVH node (you can call build later to construct it from shapes).
-    BVHNode();
-    // Construct a BVH node from a list of shapes (Similar to calling the default constructor then build).
-    // Warning: this function will probably reorder the shapes in the given span.
-    BVHNode(std::span<std::shared_ptr<Shape>> shapes);
-
-    // Builds a BVH from a list of shapes.
-    // Warning: this function will probably reorder the shapes in the given span.
-    void build(std::span<std::shared_ptr<Shape>> shapes);
-    // Intersects the ray with the BVH and returns true if the ray intersects any of the shapes in the BVH.
-    bool intersect_ray(const Ray& ray, RayHit& hit) const;
+    static constexpr uint32_t LEAF_FLAG = 0x80000000u; // Set in the references to leaves.
+
+    // An inner node with the quantized bounds of its two children.
+    struct Node {
+        T child_bounds[2][6]; // The min xyz then the max xyz of each child, between 0 (the node's min) and the max of T (the node's max).
+        uint32_t children[2]; // The index of each child node, or LEAF_FLAG | the index of the leaf.
+    };
+
+    // Builds the quantized BVH from a flat BVH (which can be freed afterwards). The leaves refer to the same primitive ranges.
+    void build(std::span<const FlatBVHNode> flat_nodes) {
+        nodes.clear();
+        leaf_starts.clear();
+        if(flat_nodes.empty()) return;
+        bounds = { flat_nodes[0].vmin, flat_nodes[0].vmax };
+        root = build_node(flat_nodes, 0, bounds);
+        // The leaves are in depth-first order, so each one ends where the next one starts.
+        const FlatBVHNode& last_leaf = flat_nodes[find_last_leaf(flat_nodes)];
+        leaf_starts.push_back(last_leaf.offset + last_leaf.count);
+    }
+
+    // Traverses the BVH front to back like intersect_flat_bvh (with the same `intersect_leaf(first, count)` callback).
+    template<typename F>
+    bool intersect(const Ray& ray, const RayHit& hit, F&& intersect_leaf) const {
+        if(leaf_starts.empty()) return false;
+        glm::vec3 inverse_direction = 1.0f / ray.direction;
+        struct StackEntry { uint32_t reference; float distance; AABB bounds; };
+        StackEntry stack[MAX_FLAT_BVH_DEPTH + 1];
+        int stack_size = 0;
+        float root_distance;
+        if(!bounds.intersect_ray(ray, inverse_direction, root_distance)) return false;
+        stack[stack_size++] = { root, root_distance, bounds };
+
+        bool has_hit = false;
+        while(stack_size > 0) {
+            StackEntry entry = stack[--stack_size];
+            // A closer hit may have been found since the node was pushed.
+            if(entry.distance >= hit.distance) continue;
+            if(entry.reference & LEAF_FLAG) {
+                uint32_t leaf = entry.reference & ~LEAF_FLAG;
+                has_hit |= intersect_leaf(leaf_starts[leaf], leaf_starts[leaf + 1] - leaf_starts[leaf]);
+                continue;
+            }
+            const Node& node = nodes[entry.reference];
+            AABB child_bounds[2];
+            // A missed child keeps an infinite distance, so it is never taken for the closer one.
+            float distances[2] = { std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity() };
+            bool hits[2];
+            for(int child = 0; child < 2; ++child) {
+                child_bounds[child] = decode(node.child_bounds[child], entry.bounds);
+                hits[child] = child_bounds[child].intersect_ray(ray, inverse_direction, distances[child]) && distances[child] < hit.distance;
+            }
+            // Push the farther child first, so the closer one is visited first.
+            int farther = distances[0] <= distances[1] ? 1 : 0;
+            if(hits[farther]) stack[stack_size++] = { node.children[farther], distances[farther], child_bounds[farther] };
+            if(hits[1 - farther]) stack[stack_size++] = { node.children[1 - farther], distances[1 - farther], child_bounds[1 - farther] };
+        }
+        return has_hit;
+    }
+
+    // Returns the memory used by the nodes and the leaves in bytes.
+    inline size_t get_memory_size() const { return nodes.size() * sizeof(Node) + leaf_starts.size() * sizeof(uint32_t); }
 
 private:
-    AABB bounds; // the AABB of the shape.
-    std::shared_ptr<BVHNode> left, right; // The two children BVH nodes (we be null in leaf nodes).
-    std::span<std::shared_ptr<Shape>> shapes; // The shapes in this node (will be empty except in leaf nodes).
-
-    // Internal functions.
-    void _build(std::span<std::shared_ptr<Shape>> shapes, AABB bounds);
-    bool _intersect_ray(const Ray& ray, RayHit& hit) const;
-};
\ No newline at end of file
+    static constexpr float QUANTIZED_MAX = static_cast<float>(std::numeric_limits<T>::max());
+    // The step between two quantized values is slightly larger than extent / QUANTIZED_MAX,
+    // so that the largest value decodes to at least the max of the node despite the rounding errors.
+    static constexpr float QUANTIZED_STEP = (1.0f + 1e-6f) / QUANTIZED_MAX;
+
+    AABB bounds; // The bounds of the root.
+    uint32_t root = 0; // The reference to the root (which is a leaf if the BVH has a single node).
+    std::vector<Node> nodes;
+    std::vector<uint32_t> leaf_starts; // The leaf i refers to the primitives between leaf_starts[i] and leaf_starts[i + 1].
+
+    static inline AABB decode(const T quantized[6], const AABB& parent) {
+        glm::vec3 step = (parent.vmax - parent.vmin) * QUANTIZED_STEP;
+        return {
+            parent.vmin + glm::vec3(quantized[0], quantized[1], quantized[2]) * step,
+            parent.vmin + glm::vec3(quantized[3], quantized[4], quantized[5]) * step
+        };
+    }
+
+    uint32_t build_node(std::span<const FlatBVHNode> flat_nodes, uint32_t index, const AABB& decoded_bounds) {
+        const FlatBVHNode& flat_node = flat_nodes[index];
+        if(flat_node.count > 0) {
+            leaf_starts.push_back(flat_node.offset);
+            return LEAF_FLAG | static_cast<uint32_t>(leaf_starts.size() - 1);
+        }
+        uint32_t node_index = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+        uint32_t flat_children[2] = { index + 1, flat_node.offset };
+        for(int child = 0; child < 2; ++child) {
+            const FlatBVHNode& flat_child = flat_nodes[flat_children[child]];
+            T quantized[6];
+            // Round the min down and the max up, then step outwards while the decoded bounds do not contain the exact ones.
+            glm::vec3 step = (decoded_bounds.vmax - decoded_bounds.vmin) * QUANTIZED_STEP;
+            for(int axis = 0; axis < 3; ++axis) {
+                float low = step[axis] > 0.0f ? std::floor((flat_child.vmin[axis] - decoded_bounds.vmin[axis]) / step[axis]) : 0.0f;
+                float high = step[axis] > 0.0f ? std::ceil((flat_child.vmax[axis] - decoded_bounds.vmin[axis]) / step[axis]) : 0.0f;
+                quantized[axis] = static_cast<T>(glm::clamp(low, 0.0f, QUANTIZED_MAX));
+                quantized[axis + 3] = static_cast<T>(glm::clamp(high, 0.0f, QUANTIZED_MAX));
+            }
+            for(AABB decoded = decode(quantized, decoded_bounds);; decoded = decode(quantized, decoded_bounds)) {
+                bool contained = true;
+                for(int axis = 0; axis < 3; ++axis) {
+                    if(decoded.vmin[axis] > flat_child.vmin[axis] && quantized[axis] > 0) {
+                        quantized[axis]--;
+                        contained = false;
+                    }
+                    if(decoded.vmax[axis] < flat_child.vmax[axis] && quantized[axis + 3] < std::numeric_limits<T>::max()) {
+                        quantized[axis + 3]++;
+                        contained = false;
+                    }
+                }
+                if(contained) break;
+            }
+            std::copy(quantized, quantized + 6, nodes[node_index].child_bounds[child]);
+            uint32_t reference = build_node(flat_nodes, flat_children[child], decode(quantized, decoded_bounds));
+            nodes[node_index].children[child] = reference;
+        }
+        return node_index;
+    }
+
+    static uint32_t find_last_leaf(std::span<const FlatBVHNode> flat_nodes) {
+        // The last leaf in depth-first order is reached by always following the right child.
+        uint32_t index = 0;
+        while(flat_nodes[index].count == 0) index = flat_nodes[index].offset;
+        return index;
+    }
+};
+
+// The number of shapes a BVHAccelerator tests against a ray at once in its leaves (see ShapePacket).
+constexpr uint32_t SHAPE_PACKET_WIDTH = 8;
+// The default maximum number of shapes in the leaves of a BVHAccelerator.
+// The leaves are tested a packet at a time, so a full packet costs about as much as a single shape and makes the BVH shallower.
+constexpr uint32_t DEFAULT_BVH_LEAF_SIZE = SHAPE_PACKET_WIDTH;
+
+// Up to SHAPE_PACKET_WIDTH shapes of a BVH leaf, grouped by type: the spheres first, then the triangles, then the other shapes (the meshes).
+// Their bounds are stored as a structure of arrays (one array per coordinate), so a ray is tested against all of them at once:
+// the loop over the lanes in intersect_bounds has no branches and the compiler turns it into SIMD instructions.
+struct alignas(32) ShapePacket {
+    float bounds_min[3][SHAPE_PACKET_WIDTH]; // The min x, y & z of the bounds of each lane.
+    float bounds_max[3][SHAPE_PACKET_WIDTH]; // The max x, y & z of the bounds of each lane.
+    uint32_t first_shape; // The index of the shape of the first lane (the lanes are consecutive shapes).
+    uint32_t first_sphere, first_triangle; // The index of the geometry of the first sphere and the first triangle.
+    uint8_t shape_count, sphere_count, triangle_count;
+
+    // Returns the mask of the lanes whose bounds the ray hits closer than max_distance.
+    inline uint32_t intersect_bounds(const glm::vec3& origin, const glm::vec3& inverse_direction, float max_distance) const {
+        // The lanes are written to an array and gathered into a mask afterwards, since the compiler does not vectorize the loop otherwise.
+        int32_t hits[SHAPE_PACKET_WIDTH];
+        for(uint32_t lane = 0; lane < SHAPE_PACKET_WIDTH; ++lane) {
+            // Slab Method (as in AABB::intersect_ray), clipped to the distances between 0 and max_distance.
+            float tx0 = (bounds_min[0][lane] - origin.x) * inverse_direction.x;
+            float tx1 = (bounds_max[0][lane] - origin.x) * inverse_direction.x;
+            float ty0 = (bounds_min[1][lane] - origin.y) * inverse_direction.y;
+            float ty1 = (bounds_max[1][lane] - origin.y) * inverse_direction.y;
+            float tz0 = (bounds_min[2][lane] - origin.z) * inverse_direction.z;
+            float tz1 = (bounds_max[2][lane] - origin.z) * inverse_direction.z;
+            float t_near = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), 0.0f));
+            float t_far = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::min(std::max(tz0, tz1), max_distance));
+            hits[lane] = t_near <= t_far ? 1 : 0;
+        }
+        uint32_t mask = 0;
+        for(uint32_t lane = 0; lane < SHAPE_PACKET_WIDTH; ++lane) mask |= static_cast<uint32_t>(hits[lane]) << lane;
+        // The unused lanes are masked out.
+        return mask & ((1u << shape_count) - 1);
+    }
+};
+
+// A BVH built over the shapes of a scene, exposed through the Accelerator interface.
+// It is stored as a flat BVH (see build_flat_bvh) whose leaves hold packets of shapes, and the geometry of the spheres and
+// the triangles is copied next to it grouped by type, so the leaves test them without virtual calls or pointer chasing.
+// Only the shapes whose bounds the ray hits get the exact intersection test (intersect_sphere and intersect_triangle, as
+// for the other accelerators), and only the closest hit is written out.
+class BVHAccelerator final : public Accelerator {
+public:
+    // Builds the BVH with at most about leaf_size shapes per leaf (this reorders the shapes in the given span).
+    BVHAccelerator(std::span<Shape*> shapes, uint32_t leaf_size = DEFAULT_BVH_LEAF_SIZE);
+    bool intersect(const Ray& ray, RayHit& hit) const override;
+
+    // Getters
+    inline std::span<const FlatBVHNode> get_nodes() const { return nodes; }
+    inline std::span<const ShapePacket> get_packets() const { return packets; }
+
+private:
+    TrackedVector<FlatBVHNode, MemoryCategory::ACCELERATORS> nodes; // The leaves refer to ranges of packets.
+    TrackedVector<ShapePacket, MemoryCategory::ACCELERATORS> packets;
+    TrackedVector<const Shape*, MemoryCategory::ACCELERATORS> shapes; // The shapes in the order of the lanes of the packets.
+    TrackedVector<glm::vec4, MemoryCategory::ACCELERATORS> spheres; // The center & radius of each sphere.
+    TrackedVector<glm::vec3, MemoryCategory::ACCELERATORS> triangles; // The 3 vertices of each triangle.
+
+    // Adds a packet holding the given shapes, which must be sorted by type.
+    void add_packet(std::span<Shape* const> packet_shapes);
+    // Intersects the ray with the shapes of a packet and updates the hit (and the index of the hit shape) if one is closer than hit.distance.
+    bool intersect_packet(const ShapePacket& packet, const Ray& ray, const glm::vec3& inverse_direction, RayHit& hit, uint32_t& hit_shape) const;
+};
+
+///////////////////
+// BVH Traversal //
+///////////////////
+
+// The render kernels call BVHAccelerator::intersect without a virtual call, so the traversal and the packet tests
+// are defined here for the compiler to inline them into the bounce loop of the path tracer.
+
+inline bool BVHAccelerator::intersect_packet(const ShapePacket& packet, const Ray& ray, const glm::vec3& inverse_direction, RayHit& hit, uint32_t& hit_shape) const {
+    bool has_hit = false;
+    // Only the lanes whose bounds are hit are tested exactly, in order, by type.
+    for(uint32_t mask = packet.intersect_bounds(ray.origin, inverse_direction, hit.distance); mask != 0; mask &= mask - 1) {
+        uint32_t lane = std::countr_zero(mask);
+        RayHit shape_hit;
+        bool shape_intersected;
+        if(lane < packet.sphere_count) {
+            const glm::vec4& sphere = spheres[packet.first_sphere + lane];
+            shape_intersected = intersect_sphere(glm::vec3(sphere), sphere.w, ray, shape_hit);
+        } else if(lane < packet.sphere_count + packet.triangle_count) {
+            const glm::vec3* vertices = &triangles[3 * (packet.first_triangle + lane - packet.sphere_count)];
+            shape_intersected = intersect_triangle(vertices[0], vertices[1], vertices[2], ray, shape_hit);
+        } else {
+            shape_intersected = shapes[packet.first_shape + lane]->intersect(ray, shape_hit);
+        }
+        if(shape_intersected && shape_hit.distance < hit.distance) {
+            has_hit = true;
+            hit.distance = shape_hit.distance;
+            hit.normal = shape_hit.normal;
+            hit_shape = packet.first_shape + lane;
+        }
+    }
+    return has_hit;
+}
+
+inline bool BVHAccelerator::intersect(const Ray& ray, RayHit& hit) const {
+    hit.distance = std::numeric_limits<float>::max();
+    glm::vec3 inverse_direction = 1.0f / ray.direction;
+    uint32_t hit_shape = 0;
+    bool has_hit = intersect_flat_bvh(nodes, ray, hit, [&](uint32_t first, uint32_t count) {
+        bool leaf_hit = false;
+        for(uint32_t packet = first; packet < first + count; ++packet) {
+            leaf_hit |= intersect_packet(packets[packet], ray, inverse_direction, hit, hit_shape);
+        }
+        return leaf_hit;
+    });
+    // The material is only looked up for the closest hit.
+    if(has_hit) {
+        hit.material = shapes[hit_shape]->get_material();
+        hit.material_id = shapes[hit_shape]->get_material_id();
+    }
+    return has_hit;
+}
@@ -1,5 +1,7 @@
 #include "camera.hpp"
 
+#include <cmath>
+
 Camera::Camera() {
     // Default camera parameters
     viewport_size = glm::ivec2(1, 1);
@@ -9,11 +11,17 @@ Camera::Camera() {
     w = glm::vec3(0.0f, 0.0f, 1.0f);
     l = b = -1.0f; t = b = 1.0f;
     d = 1.0f;
+    look_at = glm::vec3(0.0f, 0.0f, -1.0f);
+    up = v;
+    fovy = glm::radians(90.0f);
 }
 
 Camera::Camera(glm::vec3 center, glm::vec3 look_at, glm::vec3 up, float fovy, glm::ivec2 viewport_size) {
     this->viewport_size = viewport_size;
     this->e = center;
+    this->look_at = look_at;
+    this->up = up;
+    this->fovy = fovy;
     // Compute the u, v, w directions from the given arguments
     w = glm::normalize(center - look_at);
     u = glm::normalize(glm::cross(up, w));
@@ -29,6 +37,14 @@ Camera::Camera(glm::vec3 center, glm::vec3 look_at, glm::vec3 up, float fovy, gl
     l = -r;
 }
 
+void Camera::set_viewport_size(glm::ivec2 viewport_size) {
+    this->viewport_size = viewport_size;
+    // Only the horizontal extent of the near plane depends on the aspect ratio.
+    float aspect_ratio = static_cast<float>(viewport_size.x) / viewport_size.y;
+    r = aspect_ratio * t;
+    l = -r;
+}
+
 Ray Camera::get_ray(glm::vec2 pixel_pos) const {
     //TODO: Get ray for a given position in pixel space.
     // Note: the given pixel position is defined with floats, since it will be used for sub-pixel sampling.
@@ -37,4 +53,74 @@ Ray Camera::get_ray(glm::vec2 pixel_pos) const {
         glm::vec3(0.0f, 0.0f, 0.0f),
         glm::vec3(0.0f, 0.0f, -1.0f)
     };
-}
\ No newline at end of file
+}
+
+void RayBatch::resize(int width, int height) {
+    this->width = width;
+    this->height = height;
+    direction_x.resize(width * height);
+    direction_y.resize(width * height);
+    direction_z.resize(width * height);
+}
+
+TileRayGenerator::TileRayGenerator(const Camera& camera) {
+    // The directions returned by get_ray are normalized, so they are projected back onto the image plane 
+    // (perpendicular to the direction through the viewport center) to recover the linear map.
+    glm::vec2 viewport_size = camera.get_viewport_size();
+    Ray center_ray = camera.get_ray(0.5f * viewport_size);
+    glm::vec3 forward = center_ray.direction;
+    auto get_plane_direction = [&](glm::vec2 pixel_pos) {
+        glm::vec3 direction = camera.get_ray(pixel_pos).direction;
+        return direction / glm::dot(direction, forward);
+    };
+    origin = center_ray.origin;
+    corner_direction = get_plane_direction(glm::vec2(0.0f));
+    column_step = (get_plane_direction(glm::vec2(viewport_size.x, 0.0f)) - corner_direction) / viewport_size.x;
+    row_step = (get_plane_direction(glm::vec2(0.0f, viewport_size.y)) - corner_direction) / viewport_size.y;
+}
+
+void TileRayGenerator::generate(glm::ivec2 tile_origin, glm::ivec2 tile_size, const float* jitter_x, const float* jitter_y, RayBatch& batch) {
+    batch.resize(tile_size.x, tile_size.y);
+    batch.origin = origin;
+    for(int axis = 0; axis < 3; ++axis) {
+        column_terms[axis].resize(tile_size.x);
+        row_terms[axis].resize(tile_size.y);
+    }
+
+    // Without jitter, the rays go through the pixel centers, so the half pixel offset is folded into the column & row terms.
+    float center_offset = jitter_x ? 0.0f : 0.5f;
+    for(int axis = 0; axis < 3; ++axis) {
+        for(int x = 0; x < tile_size.x; ++x) column_terms[axis][x] = (tile_origin.x + x + center_offset) * column_step[axis];
+        for(int y = 0; y < tile_size.y; ++y) row_terms[axis][y] = corner_direction[axis] + (tile_origin.y + y + center_offset) * row_step[axis];
+    }
+
+    for(int y = 0; y < tile_size.y; ++y) {
+        const float row_x = row_terms[0][y], row_y = row_terms[1][y], row_z = row_terms[2][y];
+        const float* column_x = column_terms[0].data();
+        const float* column_y = column_terms[1].data();
+        const float* column_z = column_terms[2].data();
+        float* direction_x = &batch.direction_x[y * tile_size.x];
+        float* direction_y = &batch.direction_y[y * tile_size.x];
+        float* direction_z = &batch.direction_z[y * tile_size.x];
+        for(int x = 0; x < tile_size.x; ++x) {
+            direction_x[x] = row_x + column_x[x];
+            direction_y[x] = row_y + column_y[x];
+            direction_z[x] = row_z + column_z[x];
+        }
+        if(jitter_x) {
+            const float* row_jitter_x = jitter_x + y * tile_size.x;
+            const float* row_jitter_y = jitter_y + y * tile_size.x;
+            for(int x = 0; x < tile_size.x; ++x) {
+                direction_x[x] += row_jitter_x[x] * column_step.x + row_jitter_y[x] * row_step.x;
+                direction_y[x] += row_jitter_x[x] * column_step.y + row_jitter_y[x] * row_step.y;
+                direction_z[x] += row_jitter_x[x] * column_step.z + row_jitter_y[x] * row_step.z;
+            }
+        }
+        for(int x = 0; x < tile_size.x; ++x) {
+            float inverse_length = 1.0f / std::sqrt(direction_x[x] * direction_x[x] + direction_y[x] * direction_y[x] + direction_z[x] * direction_z[x]);
+            direction_x[x] *= inverse_length;
+            direction_y[x] *= inverse_length;
+            direction_z[x] *= inverse_length;
+        }
+    }
+}
@@ -3,6 +3,8 @@
 #include <glm.hpp>
 #include <ray.hpp>
 
+#include <vector>
+
 // A camera class that defines the camera position, orientation, field of view and resolution.
 class Camera {
 public:
@@ -15,6 +17,13 @@ public:
     Camera(glm::vec3 center, glm::vec3 look_at, glm::vec3 up, float fovy, glm::ivec2 viewport_size);
     // Get the viewport size (resolution)
     inline glm::ivec2 get_viewport_size() const { return viewport_size; }    
+    // Get the parameters the camera was constructed with
+    inline glm::vec3 get_position() const { return e; }
+    inline glm::vec3 get_look_at() const { return look_at; }
+    inline glm::vec3 get_up() const { return up; }
+    inline float get_fovy() const { return fovy; }
+    // Change the viewport size (resolution) while keeping the vertical field of view.
+    void set_viewport_size(glm::ivec2 viewport_size);
     
     // Get a ray from the eye through a pixel position on the viewport.
     // Note: the given pixel position is defined with floats, since it will be used for sub-pixel sampling.
@@ -26,4 +35,40 @@ private:
     glm::vec3 e; // the position of the camera (eye)
     glm::vec3 u, v, w; // right, up & backward vectors
     float l, r, b, t, d; // the left, right, bottom & top of the near plane and the distance to the near plane.
-};
\ No newline at end of file
+    glm::vec3 look_at, up; // The look at point and up vector given to the constructor (kept to save the camera).
+    float fovy; // The vertical field of view given to the constructor.
+};
+
+// The primary rays of a tile stored as a structure of arrays, ready to be traced as a packet or a stream.
+// All the rays start at the camera position. The ray of the tile pixel (x, y) is at index y * width + x.
+struct RayBatch {
+    int width = 0, height = 0;
+    glm::vec3 origin = glm::vec3(0.0f);
+    std::vector<float> direction_x, direction_y, direction_z; // Normalized directions.
+
+    // Resizes the batch for a tile of the given size.
+    void resize(int width, int height);
+    inline int size() const { return width * height; }
+    inline Ray get_ray(int index) const { return { origin, glm::vec3(direction_x[index], direction_y[index], direction_z[index]) }; }
+};
+
+// Generates the primary rays of whole tiles at once.
+// Since the camera is a pinhole, the (unnormalized) direction through a pixel position is linear in that position.
+// The generator recovers that linear map from Camera::get_ray once, so each ray only costs a few multiply-adds,
+// with the column and row terms precomputed per tile, and a normalization. The loops are branch-free over contiguous
+// arrays, so the compiler vectorizes them.
+class TileRayGenerator {
+public:
+    TileRayGenerator(const Camera& camera);
+
+    // Fills the batch with the rays of the tile of the given size whose bottom left pixel is `tile_origin`.
+    // Each ray goes through its pixel offset by (jitter_x[i], jitter_y[i]) which should be in [0,1).
+    // If the jitters are null, the rays go through the pixel centers.
+    void generate(glm::ivec2 tile_origin, glm::ivec2 tile_size, const float* jitter_x, const float* jitter_y, RayBatch& batch);
+
+private:
+    glm::vec3 origin;
+    glm::vec3 corner_direction; // The direction through the pixel position (0, 0).
+    glm::vec3 column_step, row_step; // The change of the direction per pixel along x & y.
+    std::vector<float> column_terms[3], row_terms[3]; // The per-column and per-row terms of the current tile.
+};
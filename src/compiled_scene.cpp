@@ -0,0 +1,240 @@
+#include "compiled_scene.hpp"
+
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+static_assert(std::endian::native == std::endian::little, "Compiled scenes are stored in little-endian order");
+static_assert(sizeof(CompiledPrimitive) == 48, "Compiled primitives must be tightly packed");
+static_assert(sizeof(FlatBVHNode) == 32, "BVH nodes must be tightly packed");
+static_assert(sizeof(MaterialRecord) == 16, "Material records must be tightly packed");
+
+// Rounds an offset up to the alignment of the arrays.
+static inline uint64_t align_offset(uint64_t offset) {
+    return (offset + 15) & ~uint64_t(15);
+}
+
+/////////////
+// Loading //
+/////////////
+
+// Checks the content of the arrays, so that a truncated or edited file cannot make the traversal read out of bounds:
+// the material types, the primitive types and material ids, the child and leaf ranges of the nodes and the depth of the BVH.
+// This is a single pass over the arrays, which is still much faster than parsing or building the scene.
+static bool validate_arrays(std::span<const MaterialRecord> materials, std::span<const CompiledPrimitive> primitives, std::span<const FlatBVHNode> nodes) {
+    for(const MaterialRecord& material: materials) {
+        if(material.type != MaterialType::EMISSIVE && material.type != MaterialType::LAMBERT && material.type != MaterialType::SMOOTH_METAL) return false;
+    }
+    for(const CompiledPrimitive& primitive: primitives) {
+        if(primitive.material_id < 0 || static_cast<uint64_t>(primitive.material_id) >= materials.size()) return false;
+        if(primitive.type != CompiledPrimitive::TRIANGLE && primitive.type != CompiledPrimitive::SPHERE) return false;
+    }
+    // The children of a node always come after it (the nodes are in depth-first order), so the depth of each node
+    // is known by the time it is reached, and the BVH cannot have cycles.
+    std::vector<uint8_t> depths(nodes.size(), 0);
+    if(!nodes.empty()) depths[0] = 1;
+    for(size_t index = 0; index < nodes.size(); ++index) {
+        const FlatBVHNode& node = nodes[index];
+        if(node.count > 0) {
+            if(static_cast<uint64_t>(node.offset) + node.count > primitives.size()) return false;
+            continue;
+        }
+        if(index + 1 >= nodes.size() || node.offset <= index + 1 || node.offset >= nodes.size()) return false;
+        uint8_t child_depth = depths[index] + 1;
+        if(child_depth > MAX_FLAT_BVH_DEPTH) return false;
+        depths[index + 1] = std::max(depths[index + 1], child_depth);
+        depths[node.offset] = std::max(depths[node.offset], child_depth);
+    }
+    return true;
+}
+
+bool CompiledScene::open(const std::string& path, std::string& error) {
+    if(!file.open_read(path)) {
+        error = "could not open " + path;
+        return false;
+    }
+    if(file.size() < sizeof(CompiledSceneHeader)) {
+        error = path + " is not a compiled scene (too small)";
+        return false;
+    }
+    header = reinterpret_cast<const CompiledSceneHeader*>(file.data());
+    if(std::memcmp(header->magic, CompiledSceneHeader::MAGIC, sizeof(header->magic)) != 0) {
+        error = path + " is not a compiled scene";
+        return false;
+    }
+    if(header->version != CompiledSceneHeader::VERSION) {
+        error = path + " was compiled with version " + std::to_string(header->version) +
+            " of the format, but version " + std::to_string(CompiledSceneHeader::VERSION) + " is expected (compile it again)";
+        return false;
+    }
+
+    // Check that every array is aligned and inside the file before pointing into it.
+    auto get_array = [&]<typename T>(uint64_t offset, uint64_t count, std::span<const T>& array) {
+        if(offset % 16 != 0 || offset > file.size() || count > (file.size() - offset) / sizeof(T)) return false;
+        array = std::span<const T>(reinterpret_cast<const T*>(file.data() + offset), count);
+        return true;
+    };
+    if(!get_array(header->material_offset, header->material_count, materials)
+        || !get_array(header->primitive_offset, header->primitive_count, primitives)
+        || !get_array(header->node_offset, header->node_count, nodes)) {
+        error = path + " is truncated or corrupted";
+        return false;
+    }
+    if(!validate_arrays(materials, primitives, nodes)) {
+        error = path + " is corrupted (its primitives or its BVH refer to missing elements)";
+        return false;
+    }
+    return true;
+}
+
+bool CompiledScene::intersect_primitives(const Ray& ray, RayHit& hit, size_t first, size_t count) const {
+    bool has_hit = false;
+    for(size_t index = first; index < first + count; ++index) {
+        const CompiledPrimitive& primitive = primitives[index];
+        RayHit primitive_hit;
+        bool primitive_intersected = primitive.type == CompiledPrimitive::SPHERE
+            ? intersect_sphere(primitive.vertices[0], primitive.vertices[1].x, ray, primitive_hit)
+            : intersect_triangle(primitive.vertices[0], primitive.vertices[1], primitive.vertices[2], ray, primitive_hit);
+        if(primitive_intersected && primitive_hit.distance < hit.distance) {
+            has_hit = true;
+            hit.distance = primitive_hit.distance;
+            hit.normal = primitive_hit.normal;
+            hit.material_id = primitive.material_id;
+        }
+    }
+    return has_hit;
+}
+
+bool CompiledScene::intersect(const Ray& ray, RayHit& hit) const {
+    hit.distance = std::numeric_limits<float>::max();
+    if(nodes.empty()) return intersect_primitives(ray, hit, 0, primitives.size());
+    return intersect_flat_bvh(nodes, ray, hit, [&](uint32_t first, uint32_t count) {
+        return intersect_primitives(ray, hit, first, count);
+    });
+}
+
+bool load_compiled_scene(const std::string& path, Scene& scene, std::string& error) {
+    auto compiled_scene = std::make_shared<CompiledScene>();
+    if(!compiled_scene->open(path, error)) return false;
+
+    const CompiledSceneHeader& header = compiled_scene->get_header();
+    scene.set_camera(Camera(header.camera_position, header.camera_look_at, header.camera_up, header.camera_fovy, header.viewport_size));
+    if(header.background_type == CompiledSceneHeader::SKY_BACKGROUND) {
+        scene.set_background(std::make_shared<SkyBackground>(
+            header.background_colors[0], header.background_colors[1], header.background_colors[2], header.background_colors[3],
+            header.sun_direction, header.sun_angle, header.sun_feathering
+        ));
+    } else if(header.background_type == CompiledSceneHeader::SIMPLE_BACKGROUND) {
+        scene.set_background(std::make_shared<SimpleBackground>(header.background_colors[0]));
+    } else {
+        scene.set_background(nullptr);
+    }
+    scene.set_compiled_scene(compiled_scene);
+    return true;
+}
+
+/////////////
+// Writing //
+/////////////
+
+bool compile_scene(const Scene& scene, const std::string& path) {
+    CompiledSceneHeader header = {};
+    std::memcpy(header.magic, CompiledSceneHeader::MAGIC, sizeof(header.magic));
+    header.version = CompiledSceneHeader::VERSION;
+
+    const Camera& camera = scene.get_camera();
+    header.camera_position = camera.get_position();
+    header.camera_look_at = camera.get_look_at();
+    header.camera_up = camera.get_up();
+    header.camera_fovy = camera.get_fovy();
+    header.viewport_size = camera.get_viewport_size();
+
+    const Background* background = scene.get_background().get();
+    if(auto sky = dynamic_cast<const SkyBackground*>(background)) {
+        header.background_type = CompiledSceneHeader::SKY_BACKGROUND;
+        header.background_colors[0] = sky->get_top();
+        header.background_colors[1] = sky->get_horizon();
+        header.background_colors[2] = sky->get_bottom();
+        header.background_colors[3] = sky->get_sun();
+        header.sun_direction = sky->get_sun_direction();
+        header.sun_angle = sky->get_sun_angle();
+        header.sun_feathering = sky->get_sun_feathering();
+    } else if(auto simple = dynamic_cast<const SimpleBackground*>(background)) {
+        header.background_type = CompiledSceneHeader::SIMPLE_BACKGROUND;
+        header.background_colors[0] = simple->get_color();
+    }
+    header.bounds = scene.get_bounds();
+
+    // The meshes are expanded into their triangles.
+    std::vector<CompiledPrimitive> primitives;
+    for(const Shape* shape: scene.get_shapes()) {
+        CompiledPrimitive primitive = {};
+        primitive.material_id = shape->get_material_id();
+        if(auto sphere = dynamic_cast<const Sphere*>(shape)) {
+            primitive.type = CompiledPrimitive::SPHERE;
+            primitive.vertices[0] = sphere->get_center();
+            primitive.vertices[1] = glm::vec3(sphere->get_radius(), 0.0f, 0.0f);
+            primitives.push_back(primitive);
+        } else if(auto triangle = dynamic_cast<const Triangle*>(shape)) {
+            primitive.type = CompiledPrimitive::TRIANGLE;
+            for(int vertex = 0; vertex < 3; ++vertex) primitive.vertices[vertex] = triangle->get_vertex(vertex);
+            primitives.push_back(primitive);
+        } else if(auto mesh = dynamic_cast<const TriangleMesh*>(shape)) {
+            primitive.type = CompiledPrimitive::TRIANGLE;
+            for(size_t triangle = 0; triangle < mesh->get_triangle_count(); ++triangle) {
+                for(int vertex = 0; vertex < 3; ++vertex) primitive.vertices[vertex] = mesh->get_vertex(triangle, vertex);
+                primitives.push_back(primitive);
+            }
+        } else {
+            return false;
+        }
+    }
+
+    // The BVH is built over all the primitives (including the triangles of the meshes), and they are stored in the order of its leaves.
+    // Compiled scenes only store BVHs, so one is built whichever acceleration structure the scene was constructed with.
+    std::vector<FlatBVHNode> nodes;
+    if(scene.get_accelerator() && !primitives.empty()) {
+        std::vector<AABB> primitive_bounds(primitives.size());
+        for(size_t index = 0; index < primitives.size(); ++index) {
+            const CompiledPrimitive& primitive = primitives[index];
+            if(primitive.type == CompiledPrimitive::SPHERE) {
+                primitive_bounds[index] = { primitive.vertices[0] - primitive.vertices[1].x, primitive.vertices[0] + primitive.vertices[1].x };
+            } else {
+                primitive_bounds[index] = {
+                    glm::min(primitive.vertices[0], glm::min(primitive.vertices[1], primitive.vertices[2])),
+                    glm::max(primitive.vertices[0], glm::max(primitive.vertices[1], primitive.vertices[2]))
+                };
+            }
+        }
+        std::vector<uint32_t> order;
+        build_flat_bvh(primitive_bounds, nodes, order);
+        std::vector<CompiledPrimitive> sorted_primitives(primitives.size());
+        for(size_t index = 0; index < primitives.size(); ++index) sorted_primitives[index] = primitives[order[index]];
+        primitives = std::move(sorted_primitives);
+    }
+    std::span<const MaterialRecord> materials = scene.get_materials().get_records();
+
+    header.material_offset = align_offset(sizeof(CompiledSceneHeader));
+    header.material_count = materials.size();
+    header.primitive_offset = align_offset(header.material_offset + materials.size_bytes());
+    header.primitive_count = primitives.size();
+    header.node_offset = align_offset(header.primitive_offset + primitives.size() * sizeof(CompiledPrimitive));
+    header.node_count = nodes.size();
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if(!file) return false;
+    uint64_t position = 0;
+    auto write_at = [&](uint64_t offset, const void* data, size_t size) {
+        static const char zeros[16] = {};
+        fwrite(zeros, 1, offset - position, file);
+        fwrite(data, 1, size, file);
+        position = offset + size;
+    };
+    write_at(0, &header, sizeof(header));
+    write_at(header.material_offset, materials.data(), materials.size_bytes());
+    write_at(header.primitive_offset, primitives.data(), primitives.size() * sizeof(CompiledPrimitive));
+    write_at(header.node_offset, nodes.data(), nodes.size() * sizeof(FlatBVHNode));
+    bool success = !ferror(file);
+    return fclose(file) == 0 && success;
+}
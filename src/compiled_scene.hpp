@@ -0,0 +1,83 @@
+#pragma once
+
+#include <scene.hpp>
+#include <mapped_file.hpp>
+
+#include <span>
+#include <string>
+#include <cstdint>
+
+// A binary scene file holding everything needed to render the scene in flat arrays:
+// the camera, the background, the material table, the primitives and optionally the built BVH.
+// The file is memory-mapped when it is loaded and the arrays are used in place, so loading only takes a quick validation pass
+// over the arrays (there is no parsing, no allocation per primitive and no BVH construction).
+// All the values are little-endian, and every array starts at a multiple of 16 bytes.
+
+// A primitive in a compiled scene (48 bytes).
+struct CompiledPrimitive {
+    enum Type : uint32_t { TRIANGLE, SPHERE };
+
+    glm::vec3 vertices[3]; // The vertices of a triangle, or the center of a sphere followed by (radius, 0, 0).
+    int32_t material_id; // The index of the material in the material table.
+    Type type;
+    uint32_t padding = 0;
+};
+
+// The header at the start of a compiled scene file.
+struct CompiledSceneHeader {
+    static constexpr char MAGIC[8] = { 'P', 'T', 'S', 'C', 'E', 'N', 'E', '\0' };
+    static constexpr uint32_t VERSION = 2; // Version 2 builds the BVH with build_flat_bvh, which bounds its depth.
+    enum BackgroundType : uint32_t { NO_BACKGROUND, SIMPLE_BACKGROUND, SKY_BACKGROUND };
+
+    char magic[8];
+    uint32_t version;
+    uint32_t background_type;
+    // The camera parameters (the fovy is in radians).
+    glm::vec3 camera_position, camera_look_at, camera_up;
+    float camera_fovy;
+    glm::ivec2 viewport_size;
+    // The background parameters. A simple background only uses the first color.
+    Color background_colors[4]; // top, horizon, bottom & sun.
+    glm::vec3 sun_direction;
+    float sun_angle, sun_feathering;
+    // The bounds of the whole scene.
+    AABB bounds;
+    // The arrays stored after the header (offsets are from the start of the file).
+    uint64_t material_offset, material_count; // MaterialRecord[]
+    uint64_t primitive_offset, primitive_count; // CompiledPrimitive[] (in the order of the BVH leaves)
+    uint64_t node_offset, node_count; // FlatBVHNode[] (empty if the BVH was not compiled, at most MAX_FLAT_BVH_DEPTH levels deep)
+};
+
+// A compiled scene mapped into memory. Its arrays point directly into the file.
+class CompiledScene {
+public:
+    // Maps the compiled scene file and validates it. Returns false and sets `error` on failure.
+    bool open(const std::string& path, std::string& error);
+
+    // Getters
+    inline const CompiledSceneHeader& get_header() const { return *header; }
+    inline std::span<const MaterialRecord> get_materials() const { return materials; }
+    inline std::span<const CompiledPrimitive> get_primitives() const { return primitives; }
+    inline std::span<const FlatBVHNode> get_nodes() const { return nodes; }
+
+    // Intersects a ray with the primitives (through the BVH if it was compiled) and returns true on a hit.
+    // The hit material is only given by hit.material_id, since there are no Material objects.
+    bool intersect(const Ray& ray, RayHit& hit) const;
+
+private:
+    MappedFile file;
+    const CompiledSceneHeader* header = nullptr;
+    std::span<const MaterialRecord> materials;
+    std::span<const CompiledPrimitive> primitives;
+    std::span<const FlatBVHNode> nodes;
+
+    // Intersects the ray with a range of primitives and updates the hit if one is closer than hit.distance.
+    bool intersect_primitives(const Ray& ray, RayHit& hit, size_t first, size_t count) const;
+};
+
+// Writes a constructed scene to a compiled scene file. Returns true if the file was written.
+// The BVH is included if the scene was constructed with an acceleration structure. It is rebuilt over all the primitives (the meshes are expanded into triangles).
+bool compile_scene(const Scene& scene, const std::string& path);
+
+// Loads a compiled scene file into the scene. Returns false and sets `error` on failure.
+bool load_compiled_scene(const std::string& path, Scene& scene, std::string& error);
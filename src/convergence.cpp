@@ -0,0 +1,130 @@
+#include "convergence.hpp"
+#include "pathtracer.hpp"
+#include "denoiser.hpp"
+
+#include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <filesystem>
+
+ImageError compute_image_error(const Image& image, const Image& reference) {
+    // The relative error is regularized, so that it does not explode on the black pixels of the reference.
+    const double EPSILON = 1e-2;
+    double squared_error = 0.0, relative_squared_error = 0.0;
+    for(int y = 0; y < image.get_height(); ++y) {
+        const Color* row = image.get_row(y);
+        const Color* reference_row = reference.get_row(y);
+        for(int x = 0; x < image.get_width(); ++x) {
+            for(int channel = 0; channel < 3; ++channel) {
+                double difference = row[x][channel] - reference_row[x][channel];
+                double value = reference_row[x][channel];
+                squared_error += difference * difference;
+                relative_squared_error += difference * difference / (value * value + EPSILON);
+            }
+        }
+    }
+    double count = 3.0 * image.get_width() * image.get_height();
+    return { std::sqrt(squared_error / count), relative_squared_error / count };
+}
+
+// Finds or renders the reference of a scene.
+static bool get_reference(const Scene& scene, const std::string& scene_name, const ConvergenceSettings& settings, ConvergenceCurve& curve, Image& reference, std::string& error) {
+    std::filesystem::path directory = settings.reference_directory;
+    for(const char* extension: { ".pfm", ".png" }) {
+        std::filesystem::path path = directory / (scene_name + extension);
+        if(!std::filesystem::exists(path)) continue;
+        curve.reference_path = path.string();
+        curve.display_colors = path.extension() != ".pfm";
+        return Image::load(curve.reference_path, reference, error);
+    }
+    if(settings.reference_samples == 0) {
+        error = "no reference for " + scene_name + " in " + directory.string() + " (use --reference-samples to render one)";
+        return false;
+    }
+    // Render the reference without any of the features being judged, and keep it for the next runs.
+    printf("Rendering the reference of %s with %u samples\n", scene_name.c_str(), settings.reference_samples);
+    reference = path_trace(scene, settings.reference_samples, settings.max_bounces);
+    std::filesystem::create_directories(directory);
+    curve.reference_path = (directory / (scene_name + ".pfm")).string();
+    curve.display_colors = false;
+    if(!reference.save(curve.reference_path)) {
+        error = "could not write " + curve.reference_path;
+        return false;
+    }
+    return true;
+}
+
+bool measure_convergence(const Scene& scene, const std::string& scene_name, const ConvergenceSettings& settings, ConvergenceCurve& curve, std::string& error) {
+    curve = ConvergenceCurve();
+    curve.scene_name = scene_name;
+    Image reference(0, 0);
+    if(!get_reference(scene, scene_name, settings, curve, reference, error)) return false;
+    glm::ivec2 viewport_size = scene.get_camera().get_viewport_size();
+    if(reference.get_width() != viewport_size.x || reference.get_height() != viewport_size.y) {
+        error = "the reference " + curve.reference_path + " is " + std::to_string(reference.get_width()) + "x" + std::to_string(reference.get_height())
+            + " but the scene is rendered at " + std::to_string(viewport_size.x) + "x" + std::to_string(viewport_size.y);
+        return false;
+    }
+
+    // The denoiser is guided by the first hit AOVs, which are collected once (and counted in the time of every checkpoint).
+    using clock = std::chrono::high_resolution_clock;
+    std::optional<AOVBuffers> aovs;
+    double overhead_seconds = 0.0;
+    if(settings.use_denoiser) {
+        auto start = clock::now();
+        aovs.emplace(viewport_size.x, viewport_size.y);
+        collect_first_hit_aovs(scene, *aovs);
+        overhead_seconds = std::chrono::duration<double>(clock::now() - start).count();
+    }
+
+    // The checkpoints double in time up to the budget. A sample may cross several of them at once, in which case it is measured once.
+    int next_checkpoint = 0;
+    auto get_checkpoint_time = [&](int checkpoint) { return settings.time_budget / std::exp2(settings.checkpoint_count - 1 - checkpoint); };
+    auto measure = [&](uint32_t sample_count, double seconds, const Image& image) {
+        double total_seconds = seconds + overhead_seconds;
+        std::optional<Image> denoised;
+        if(aovs) {
+            auto start = clock::now();
+            denoised.emplace(image);
+            denoise(*denoised, *aovs);
+            total_seconds += std::chrono::duration<double>(clock::now() - start).count();
+        }
+        const Image& result = denoised ? *denoised : image;
+        ImageError image_error = curve.display_colors ? compute_image_error(result.to_display(), reference) : compute_image_error(result, reference);
+        curve.points.push_back({ total_seconds, sample_count, image_error });
+    };
+    PathTracerOptions options;
+    options.time_limit = settings.time_budget;
+    options.on_sample = [&](uint32_t sample_count, double seconds, const Image& image) {
+        if(next_checkpoint >= settings.checkpoint_count || seconds < get_checkpoint_time(next_checkpoint)) return;
+        while(next_checkpoint < settings.checkpoint_count && seconds >= get_checkpoint_time(next_checkpoint)) next_checkpoint++;
+        measure(sample_count, seconds, image);
+    };
+    path_trace(scene, std::numeric_limits<uint32_t>::max(), settings.max_bounces, options);
+    return true;
+}
+
+bool save_convergence_curves(const std::string& path, const std::vector<ConvergenceCurve>& curves) {
+    std::ofstream file(path);
+    if(!file) return false;
+    file << "scene,seconds,samples,rmse,relmse\n";
+    for(const ConvergenceCurve& curve: curves) {
+        for(const ConvergencePoint& point: curve.points) {
+            file << curve.scene_name << "," << point.seconds << "," << point.sample_count << "," << point.error.rmse << "," << point.error.relmse << "\n";
+        }
+    }
+    return static_cast<bool>(file);
+}
+
+void print_convergence_summary(const std::vector<ConvergenceCurve>& curves) {
+    printf("%-16s %10s %10s %12s %12s %12s  %s\n", "scene", "samples", "seconds", "samples/s", "rmse", "relmse", "reference");
+    for(const ConvergenceCurve& curve: curves) {
+        if(curve.points.empty()) continue;
+        const ConvergencePoint& last = curve.points.back();
+        printf("%-16s %10u %10.2f %12.1f %12.6f %12.6f  %s%s\n", curve.scene_name.c_str(), last.sample_count, last.seconds, last.sample_count / last.seconds,
+            last.error.rmse, last.error.relmse, curve.reference_path.c_str(), curve.display_colors ? " (8-bit)" : "");
+    }
+}
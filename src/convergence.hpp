@@ -0,0 +1,55 @@
+#pragma once
+
+#include <image.hpp>
+#include <scene.hpp>
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// The error of a rendered image against a reference image.
+struct ImageError {
+    double rmse = 0.0; // The root mean squared error over all the channels.
+    double relmse = 0.0; // The mean squared error relative to the squared reference, so the dark regions weigh as much as the bright ones.
+};
+
+// Computes the error of an image against a reference of the same size.
+ImageError compute_image_error(const Image& image, const Image& reference);
+
+// The settings of the equal-time convergence benchmark, which judges the rendering features on their quality per second.
+struct ConvergenceSettings {
+    double time_budget = 4.0; // The render time given to each scene in seconds.
+    int checkpoint_count = 5; // The error is measured after time_budget / 2^(checkpoint_count - 1), ..., time_budget / 2 and time_budget.
+    uint32_t max_bounces = 5;
+    std::string reference_directory = "expected_output";
+    // If positive, a reference is rendered with this many samples for the scenes without one, and saved in the reference directory.
+    uint32_t reference_samples = 0;
+    // The rendering features being judged (only the denoiser for now).
+    bool use_denoiser = false;
+};
+
+// A point of an error-vs-time curve.
+struct ConvergencePoint {
+    double seconds; // The time spent rendering the image (including the denoising if it is enabled).
+    uint32_t sample_count;
+    ImageError error;
+};
+
+// The error-vs-time curve of a scene.
+struct ConvergenceCurve {
+    std::string scene_name;
+    std::string reference_path;
+    // Whether the errors were measured on the tone mapped 8-bit colors (against an 8-bit reference) instead of the linear colors.
+    bool display_colors = false;
+    std::vector<ConvergencePoint> points;
+};
+
+// Renders the scene within the time budget and measures its error against its reference at each checkpoint.
+// The reference is looked up in the reference directory as scene-name.pfm (linear colors) then scene-name.png (8-bit colors).
+// Returns false and sets `error` if there is no reference and none could be rendered.
+bool measure_convergence(const Scene& scene, const std::string& scene_name, const ConvergenceSettings& settings, ConvergenceCurve& curve, std::string& error);
+
+// Writes the curves to a CSV file with one row per point (scene, seconds, samples, rmse, relmse). Returns true if the file was written.
+bool save_convergence_curves(const std::string& path, const std::vector<ConvergenceCurve>& curves);
+// Prints a table with the samples and the error reached by each scene within the time budget.
+void print_convergence_summary(const std::vector<ConvergenceCurve>& curves);
@@ -0,0 +1,204 @@
+#include "denoiser.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
+
+#include <bit>
+#include <cmath>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+// The 1D B3-spline kernel used by the à-trous transform (the 2D kernel is the outer product of it with itself).
+static const float KERNEL[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+// A small epsilon used to avoid dividing by a zero albedo while demodulating.
+static const float ALBEDO_EPSILON = 1e-3f;
+
+// log2(e), to compute exp(x) as exp2(x * LOG2_E).
+static const float LOG2_E = 1.44269504f;
+
+// The number of pixels of a row filtered together by an à-trous pass (their sums fit in the L1 cache).
+static const int ATROUS_BLOCK_SIZE = 256;
+
+// The smallest cosine between normals given to approx_log2 (the weight of the smaller ones is zero).
+static const float MIN_COSINE = 1e-30f;
+
+// Added to the weight sums before dividing by them (it is far below the weight of the center tap, so it only matters for zero sums).
+static const float MIN_WEIGHT_SUM = 1e-30f;
+
+// The edge stopping functions need exp and pow for every tap. The ones of the standard library are calls the compiler cannot
+// vectorize, so they are approximated with polynomials instead, which only use arithmetic and bit operations.
+
+// Returns 2^x for x <= 0 (with a relative error below 2e-5). The values below 2^-126 are clamped to it.
+static inline float approx_exp2(float x) {
+    x = std::max(x, -126.0f);
+    // Split x into its integer part (rounded down) and its fractional part in [0, 1).
+    int32_t integer = static_cast<int32_t>(x);
+    integer -= x < static_cast<float>(integer);
+    float fraction = x - static_cast<float>(integer);
+    // The Taylor series of 2^fraction, then the integer part is added to the exponent.
+    float power = 1.0f + fraction * (0.693147181f + fraction * (0.240226507f + fraction * (0.0555041087f
+        + fraction * (0.00961812911f + fraction * (0.00133335581f + fraction * 0.000154035304f)))));
+    return std::bit_cast<float>(std::bit_cast<int32_t>(power) + integer * (1 << 23));
+}
+
+// Returns log2(x) for a positive and normal x (with an absolute error below 1e-6).
+static inline float approx_log2(float x) {
+    // Split x into its exponent and its mantissa in [1, 2).
+    int32_t bits = std::bit_cast<int32_t>(x);
+    float exponent = static_cast<float>((bits >> 23) - 127);
+    float mantissa = std::bit_cast<float>((bits & 0x007fffff) | 0x3f800000);
+    // ln(m) = 2 * atanh(s) with s = (m - 1) / (m + 1) in [0, 1/3), whose series converges quickly.
+    float s = (mantissa - 1.0f) / (mantissa + 1.0f);
+    float s2 = s * s;
+    float ln_mantissa = 2.0f * s * (1.0f + s2 * (1.0f / 3.0f + s2 * (1.0f / 5.0f + s2 * (1.0f / 7.0f + s2 * (1.0f / 9.0f)))));
+    return exponent + ln_mantissa * LOG2_E;
+}
+
+// An image or a guide of the filter stored as one plane of floats per channel (a structure of arrays),
+// so that the taps of a row of pixels are read from contiguous memory and the loops over them can be vectorized.
+struct FloatPlanes {
+    FloatPlanes(size_t pixel_count, int channel_count) : planes(channel_count, TrackedVector<float, MemoryCategory::FRAMEBUFFERS>(pixel_count)) {}
+
+    inline float* operator[](int channel) { return planes[channel].data(); }
+    inline const float* operator[](int channel) const { return planes[channel].data(); }
+
+    std::vector<TrackedVector<float, MemoryCategory::FRAMEBUFFERS>> planes;
+};
+
+// Runs one à-trous pass with the given step (distance between taps) from `input` to `output` (3 planes each: r, g, b).
+// The guides are the normal (3 planes), the depth and a mask (1 for the pixels with a hit, 0 for the background).
+static void atrous_pass(
+    const FloatPlanes& input, FloatPlanes& output, const FloatPlanes& normal, const float* depth, const float* mask,
+    int width, int height, int step, float sigma_color, const DenoiserSettings& settings
+) {
+    const float color_factor = -LOG2_E / (sigma_color * sigma_color);
+    const float sigma_normal = settings.sigma_normal;
+    const float depth_scale = settings.sigma_depth * step;
+
+    // The constants are captured by value, so the compiler knows that the writes to the sums do not change them.
+    parallel_for(0, height, [&, color_factor, sigma_normal, depth_scale](int y) {
+        const size_t row = static_cast<size_t>(y) * width;
+        const float* center_r = input[0] + row;
+        const float* center_g = input[1] + row;
+        const float* center_b = input[2] + row;
+        const float* center_nx = normal[0] + row;
+        const float* center_ny = normal[1] + row;
+        const float* center_nz = normal[2] + row;
+        const float* center_depth = depth + row;
+        const float* center_mask = mask + row;
+        // The row is filtered in blocks of pixels whose sums are local arrays, so the compiler knows that they do not alias the planes.
+        for(int block_begin = 0; block_begin < width; block_begin += ATROUS_BLOCK_SIZE) {
+            const int block_end = std::min(width, block_begin + ATROUS_BLOCK_SIZE);
+            float sums[3][ATROUS_BLOCK_SIZE] = {}, weight_sum[ATROUS_BLOCK_SIZE] = {};
+            float* sum_r = sums[0];
+            float* sum_g = sums[1];
+            float* sum_b = sums[2];
+            // The depth tolerance only depends on the center pixel, so it is divided once per pixel instead of once per tap.
+            float depth_factor[ATROUS_BLOCK_SIZE];
+            for(int i = 0; i < block_end - block_begin; ++i) {
+                depth_factor[i] = -LOG2_E / (depth_scale * center_depth[block_begin + i] + 1e-6f);
+            }
+            // The filter runs one tap at a time over the whole block instead of one pixel at a time over its taps,
+            // so the inner loop has no branches and reads every plane at consecutive pixels.
+            for(int ky = -2; ky <= 2; ++ky) {
+                int qy = y + ky * step;
+                if(qy < 0 || qy >= height) continue;
+                for(int kx = -2; kx <= 2; ++kx) {
+                    // The taps of the pixels [x_begin, x_end) of the block are inside the image.
+                    const int offset = kx * step;
+                    const int x_begin = std::max(block_begin, -offset), x_end = std::min(block_end, width - offset);
+                    const float kernel_weight = KERNEL[kx + 2] * KERNEL[ky + 2];
+                    const size_t tap_row = static_cast<size_t>(qy) * width + offset;
+                    const float* tap_r = input[0] + tap_row;
+                    const float* tap_g = input[1] + tap_row;
+                    const float* tap_b = input[2] + tap_row;
+                    const float* tap_nx = normal[0] + tap_row;
+                    const float* tap_ny = normal[1] + tap_row;
+                    const float* tap_nz = normal[2] + tap_row;
+                    const float* tap_depth = depth + tap_row;
+                    const float* tap_mask = mask + tap_row;
+                    for(int x = x_begin; x < x_end; ++x) {
+                        // Edge stopping functions for the color, normal and depth (the background taps are masked out).
+                        // They are powers of two, so they are multiplied by adding their exponents and computing a single power.
+                        int i = x - block_begin;
+                        float dr = tap_r[x] - center_r[x], dg = tap_g[x] - center_g[x], db = tap_b[x] - center_b[x];
+                        float exponent_color = (dr * dr + dg * dg + db * db) * color_factor;
+                        float cosine = center_nx[x] * tap_nx[x] + center_ny[x] * tap_ny[x] + center_nz[x] * tap_nz[x];
+                        float exponent_normal = sigma_normal * approx_log2(std::max(cosine, MIN_COSINE));
+                        float exponent_depth = std::abs(center_depth[x] - tap_depth[x]) * depth_factor[i];
+                        float weight_edges = approx_exp2(exponent_color + exponent_normal + exponent_depth);
+                        weight_edges = cosine > 0.0f ? weight_edges : 0.0f;
+
+                        float weight = kernel_weight * weight_edges * tap_mask[x];
+                        sum_r[i] += tap_r[x] * weight;
+                        sum_g[i] += tap_g[x] * weight;
+                        sum_b[i] += tap_b[x] * weight;
+                        weight_sum[i] += weight;
+                    }
+                }
+            }
+            // Background pixels have no geometric features, so we leave them untouched (by blending with the mask, which is 0 or 1,
+            // so the loops have no branches). The weight sum of the others is never zero since their center pixel always contributes.
+            // A tiny value is added to it anyway to keep the (discarded) result of the background pixels finite.
+            float filtered_weight[ATROUS_BLOCK_SIZE], unfiltered_weight[ATROUS_BLOCK_SIZE];
+            for(int i = 0; i < block_end - block_begin; ++i) {
+                float has_hit = center_mask[block_begin + i];
+                filtered_weight[i] = has_hit / (weight_sum[i] + MIN_WEIGHT_SUM);
+                unfiltered_weight[i] = 1.0f - has_hit;
+            }
+            // One channel at a time, so that the compiler has few pointers to check for aliasing before vectorizing the loop.
+            for(int channel = 0; channel < 3; ++channel) {
+                const float* center = input[channel] + row;
+                float* filtered = output[channel] + row;
+                for(int i = 0; i < block_end - block_begin; ++i) {
+                    int x = block_begin + i;
+                    filtered[x] = sums[channel][i] * filtered_weight[i] + center[x] * unfiltered_weight[i];
+                }
+            }
+        }
+    });
+}
+
+void denoise(Image& image, const AOVBuffers& aovs, const DenoiserSettings& settings) {
+    TraceScope trace("denoise");
+    const int width = image.get_width(), height = image.get_height();
+    const size_t pixel_count = static_cast<size_t>(width) * height;
+    FloatPlanes current(pixel_count, 3), next(pixel_count, 3), normal(pixel_count, 3), guides(pixel_count, 2);
+    float* depth = guides[0];
+    float* mask = guides[1];
+
+    // Demodulate the albedo so that we only filter the (smooth) lighting, and split the image and the guides into planes.
+    // The background pixels get a zero depth instead of an infinite one, so the edge stopping functions stay finite.
+    parallel_for(0, height, [&](int y) {
+        for(int x = 0; x < width; ++x) {
+            size_t index = static_cast<size_t>(y) * width + x;
+            Color color = image(x, y) / glm::max(aovs.albedo(x, y), Color(ALBEDO_EPSILON));
+            glm::vec3 pixel_normal = aovs.normal(x, y);
+            bool has_hit = std::isfinite(aovs.depth[index]);
+            for(int channel = 0; channel < 3; ++channel) {
+                current[channel][index] = color[channel];
+                normal[channel][index] = pixel_normal[channel];
+            }
+            depth[index] = has_hit ? aovs.depth[index] : 0.0f;
+            mask[index] = has_hit ? 1.0f : 0.0f;
+        }
+    });
+
+    // Apply the à-trous passes with a growing step and a shrinking color tolerance.
+    float sigma_color = settings.sigma_color;
+    for(int iteration = 0; iteration < settings.iterations; ++iteration) {
+        atrous_pass(current, next, normal, depth, mask, width, height, 1 << iteration, sigma_color, settings);
+        std::swap(current, next);
+        sigma_color *= 0.5f;
+    }
+
+    // Remodulate the albedo and write the result back into the image.
+    parallel_for(0, height, [&](int y) {
+        for(int x = 0; x < width; ++x) {
+            size_t index = static_cast<size_t>(y) * width + x;
+            Color color(current[0][index], current[1][index], current[2][index]);
+            image(x, y) = color * glm::max(aovs.albedo(x, y), Color(ALBEDO_EPSILON));
+        }
+    });
+}
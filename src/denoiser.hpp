@@ -0,0 +1,16 @@
+#pragma once
+
+#include <image.hpp>
+#include <aov.hpp>
+
+// The parameters of the edge-avoiding à-trous denoiser.
+struct DenoiserSettings {
+    int iterations = 5; // The number of filter passes. The filter footprint doubles at each pass.
+    float sigma_color = 4.0f; // How much the filtered color may differ before a neighbor is rejected (it is halved every pass).
+    float sigma_normal = 64.0f; // The exponent applied to the cosine between normals (higher means sharper geometric edges).
+    float sigma_depth = 0.02f; // The relative depth difference (per pixel of filter step) tolerated between neighbors.
+};
+
+// Denoises the image in place using an edge-avoiding à-trous wavelet filter guided by the first hit albedo, normal and depth.
+// The lighting is demodulated by the albedo before filtering so that texture and color edges are preserved.
+void denoise(Image& image, const AOVBuffers& aovs, const DenoiserSettings& settings = {});
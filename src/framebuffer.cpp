@@ -0,0 +1,42 @@
+#include "framebuffer.hpp"
+
+TiledFramebuffer::TiledFramebuffer(const std::string& path, int width, int height, int tile_size) : tile_size(glm::max(tile_size, 1)) {
+    tile_count_x = (width + this->tile_size - 1) / this->tile_size;
+    tile_count_y = (height + this->tile_size - 1) / this->tile_size;
+    if(!FloatImageLayout::create(path, width, height, layout)) return;
+    if(!file.create(path, layout.get_file_size())) return;
+    layout.initialize(file.data());
+    band_remaining_tiles = std::make_unique<std::atomic<int>[]>(tile_count_y);
+    for(int band = 0; band < tile_count_y; ++band) band_remaining_tiles[band].store(tile_count_x);
+}
+
+glm::ivec2 TiledFramebuffer::get_tile_origin(int tile) const {
+    return glm::ivec2(tile % tile_count_x, tile / tile_count_x) * tile_size;
+}
+
+glm::ivec2 TiledFramebuffer::get_tile_size(int tile) const {
+    return glm::min(glm::ivec2(tile_size), glm::ivec2(layout.width, layout.height) - get_tile_origin(tile));
+}
+
+void TiledFramebuffer::write_tile(int tile, const Image& image) {
+    glm::ivec2 origin = get_tile_origin(tile);
+    for(int y = 0; y < image.get_height(); ++y) {
+        layout.write_pixels(file.data(), origin.x, origin.y + y, image.get_row(y), image.get_width());
+    }
+    // The last tile written in a band releases it.
+    int band = tile / tile_count_x;
+    if(band_remaining_tiles[band].fetch_sub(1, std::memory_order_acq_rel) == 1) release_band(band);
+}
+
+void TiledFramebuffer::release_band(int band) {
+    // The rows of the band are contiguous in the file, but stored in reverse order in EXR files.
+    int first_row = band * tile_size;
+    int last_row = glm::min(first_row + tile_size, layout.height) - 1;
+    size_t begin = glm::min(layout.get_row_offset(first_row), layout.get_row_offset(last_row)) - layout.row_prefix_size;
+    size_t end = glm::max(layout.get_row_offset(first_row), layout.get_row_offset(last_row)) - layout.row_prefix_size + layout.row_stride;
+    file.flush(begin, end - begin, true);
+}
+
+void TiledFramebuffer::close() {
+    file.close();
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <image.hpp>
+#include <mapped_file.hpp>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+// A framebuffer for images too large to be kept in memory, which is filled one tile at a time.
+// The pixels live in the output file itself (an uncompressed PFM or EXR file mapped into memory), so each finished tile
+// is written straight to its final place in the file. Once every tile of a band (a row of tiles) is written, the band is
+// flushed to disk and released from memory, so only the tiles being rendered (and the unfinished bands) use memory.
+class TiledFramebuffer {
+public:
+    // Creates the output file for an image of the given size split in square tiles of `tile_size` pixels.
+    // The format is picked from the extension of the path (".pfm" or ".exr"). Check is_open() to know if it succeeded.
+    TiledFramebuffer(const std::string& path, int width, int height, int tile_size);
+
+    // Getters
+    inline bool is_open() const { return file.is_open(); }
+    inline int get_width() const { return layout.width; }
+    inline int get_height() const { return layout.height; }
+    inline int get_tile_size() const { return tile_size; }
+    inline int get_tile_count_x() const { return tile_count_x; }
+    inline int get_tile_count_y() const { return tile_count_y; }
+    inline int get_tile_count() const { return tile_count_x * tile_count_y; }
+    // Returns the pixel coordinates of the bottom left corner of a tile, and its size (smaller on the right and top borders).
+    glm::ivec2 get_tile_origin(int tile) const;
+    glm::ivec2 get_tile_size(int tile) const;
+
+    // Writes a finished tile into the file. The image must have the size of the tile.
+    // It is safe to call it from multiple threads for different tiles.
+    void write_tile(int tile, const Image& image);
+    // Flushes everything to disk and closes the file.
+    void close();
+
+private:
+    FloatImageLayout layout;
+    MappedFile file;
+    int tile_size, tile_count_x, tile_count_y;
+    std::unique_ptr<std::atomic<int>[]> band_remaining_tiles; // The number of tiles not written yet in each band.
+
+    // Writes the rows of a band back to the file and releases them from memory.
+    void release_band(int band);
+};
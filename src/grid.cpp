@@ -0,0 +1,89 @@
+#include "grid.hpp"
+
+#include <cmath>
+
+// Computes the AABB encompassing a list of shapes.
+static AABB compute_bounds(std::span<Shape* const> shapes) {
+    if(shapes.empty()) return { glm::vec3(0.0f), glm::vec3(0.0f) };
+    AABB bounds = shapes[0]->get_bounds();
+    for(const Shape* shape: shapes) bounds = bounds.merge(shape->get_bounds());
+    return bounds;
+}
+
+//////////////////
+// Uniform Grid //
+//////////////////
+
+void UniformGrid::build(std::span<Shape* const> shapes, const AABB& bounds, float density) {
+    // Pad the bounds slightly, so that a flat scene still has a volume and the shapes on its faces are inside the cells.
+    glm::vec3 extent = bounds.vmax - bounds.vmin;
+    glm::vec3 padding(std::max(std::max(extent.x, extent.y), extent.z) * 1e-4f + 1e-6f);
+    this->bounds = { bounds.vmin - padding, bounds.vmax + padding };
+    extent = this->bounds.vmax - this->bounds.vmin;
+
+    // Pick the resolution so that the cells are as close to cubes as possible and there are about `density` cells per shape.
+    float cells_per_unit = std::cbrt(density * std::max<size_t>(shapes.size(), 1) / (extent.x * extent.y * extent.z));
+    for(int axis = 0; axis < 3; ++axis) {
+        float cells = std::min(std::round(extent[axis] * cells_per_unit), static_cast<float>(MAX_RESOLUTION));
+        resolution[axis] = std::max(1, static_cast<int>(cells));
+    }
+    cell_size = extent / glm::vec3(resolution);
+    inverse_cell_size = 1.0f / cell_size;
+
+    // Count the shapes overlapping each cell, then compute where the list of each cell starts and fill them.
+    size_t cell_count = static_cast<size_t>(resolution.x) * resolution.y * resolution.z;
+    cell_starts.assign(cell_count + 1, 0);
+    auto for_each_cell = [&](const Shape* shape, auto&& fn) {
+        glm::ivec3 first, last;
+        get_cell_range(shape->get_bounds(), first, last);
+        for(int z = first.z; z <= last.z; ++z)
+            for(int y = first.y; y <= last.y; ++y)
+                for(int x = first.x; x <= last.x; ++x)
+                    fn(get_cell_index(glm::ivec3(x, y, z)));
+    };
+    for(const Shape* shape: shapes) for_each_cell(shape, [&](size_t cell) { cell_starts[cell + 1]++; });
+    for(size_t cell = 1; cell <= cell_count; ++cell) cell_starts[cell] += cell_starts[cell - 1];
+    references.resize(cell_starts.back());
+    std::vector<uint32_t> cursors(cell_starts.begin(), cell_starts.end() - 1);
+    for(Shape* shape: shapes) for_each_cell(shape, [&](size_t cell) { references[cursors[cell]++] = shape; });
+}
+
+AABB UniformGrid::get_cell_bounds(size_t cell) const {
+    glm::ivec3 coordinates(
+        cell % resolution.x,
+        (cell / resolution.x) % resolution.y,
+        cell / (static_cast<size_t>(resolution.x) * resolution.y)
+    );
+    glm::vec3 vmin = bounds.vmin + glm::vec3(coordinates) * cell_size;
+    return { vmin, vmin + cell_size };
+}
+
+void UniformGrid::get_cell_range(const AABB& box, glm::ivec3& first, glm::ivec3& last) const {
+    first = glm::clamp(glm::ivec3(glm::floor((box.vmin - bounds.vmin) * inverse_cell_size)), glm::ivec3(0), resolution - 1);
+    last = glm::clamp(glm::ivec3(glm::floor((box.vmax - bounds.vmin) * inverse_cell_size)), glm::ivec3(0), resolution - 1);
+}
+
+//////////////////////
+// Grid Accelerator //
+//////////////////////
+
+GridAccelerator::GridAccelerator(std::span<Shape* const> shapes, bool two_level) {
+    AABB bounds = compute_bounds(shapes);
+    if(!two_level) {
+        top_grid.build(shapes, bounds, DENSITY);
+        return;
+    }
+
+    // The top grid is coarse, then each crowded cell gets a grid covering the part of the cell overlapped by its shapes.
+    top_grid.build(shapes, bounds, TOP_DENSITY);
+    cell_sub_grids.assign(top_grid.get_cell_count(), -1);
+    for(size_t cell = 0; cell < top_grid.get_cell_count(); ++cell) {
+        std::span<Shape* const> cell_shapes = top_grid.get_cell_shapes(cell);
+        if(cell_shapes.size() <= SUB_GRID_MIN_SHAPES) continue;
+        AABB cell_bounds = top_grid.get_cell_bounds(cell);
+        AABB shape_bounds = compute_bounds(cell_shapes);
+        AABB sub_bounds = { glm::max(cell_bounds.vmin, shape_bounds.vmin), glm::min(cell_bounds.vmax, shape_bounds.vmax) };
+        cell_sub_grids[cell] = static_cast<int32_t>(sub_grids.size());
+        sub_grids.emplace_back().build(cell_shapes, sub_bounds, SUB_DENSITY);
+    }
+}
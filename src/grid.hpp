@@ -0,0 +1,178 @@
+#pragma once
+
+#include <span>
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <algorithm>
+
+#include <glm.hpp>
+#include <ray.hpp>
+#include <aabb.hpp>
+#include <shapes.hpp>
+#include <accelerator.hpp>
+#include <memory.hpp>
+
+// A uniform grid which splits a box into cells of the same size, each of them listing the shapes whose bounds overlap it.
+// A ray walks through the cells it crosses from front to back (3D-DDA), so it can stop at the first cell holding a hit.
+// It is built in linear time, but it only works well when the shapes are spread evenly in the box.
+class UniformGrid {
+public:
+    // Builds the grid over the bounds with about `density` cells per shape.
+    // The shapes should overlap the bounds (the ones outside are put in the nearest cells).
+    void build(std::span<Shape* const> shapes, const AABB& bounds, float density);
+
+    // Walks through the cells crossed by the ray between the distances t_min and t_max from front to back,
+    // and calls `visit(cell, t_enter, t_exit)` with the index of each cell and the distances at which the ray enters and leaves it.
+    // The walk stops when visit returns true.
+    template<typename F>
+    void traverse(const Ray& ray, float t_min, float t_max, F&& visit) const {
+        // Clip the ray to the bounds of the grid (Slab Method).
+        glm::vec3 inverse_direction = 1.0f / ray.direction;
+        glm::vec3 t0 = (bounds.vmin - ray.origin) * inverse_direction;
+        glm::vec3 t1 = (bounds.vmax - ray.origin) * inverse_direction;
+        glm::vec3 t_near = glm::min(t0, t1), t_far = glm::max(t0, t1);
+        float t_enter = std::max(t_min, std::max(std::max(t_near.x, t_near.y), t_near.z));
+        float t_end = std::min(t_max, std::min(std::min(t_far.x, t_far.y), t_far.z));
+        if(!(t_enter <= t_end)) return;
+
+        // Find the first cell, and the distances at which the ray crosses the next cell boundary along each axis.
+        glm::vec3 entry = (ray.origin + ray.direction * t_enter - bounds.vmin) * inverse_cell_size;
+        glm::ivec3 cell = glm::clamp(glm::ivec3(glm::floor(entry)), glm::ivec3(0), resolution - 1);
+        glm::ivec3 step;
+        glm::vec3 t_next, t_delta;
+        for(int axis = 0; axis < 3; ++axis) {
+            if(ray.direction[axis] > 0.0f) {
+                step[axis] = 1;
+                t_next[axis] = (bounds.vmin[axis] + (cell[axis] + 1) * cell_size[axis] - ray.origin[axis]) * inverse_direction[axis];
+                t_delta[axis] = cell_size[axis] * inverse_direction[axis];
+            } else if(ray.direction[axis] < 0.0f) {
+                step[axis] = -1;
+                t_next[axis] = (bounds.vmin[axis] + cell[axis] * cell_size[axis] - ray.origin[axis]) * inverse_direction[axis];
+                t_delta[axis] = -cell_size[axis] * inverse_direction[axis];
+            } else {
+                step[axis] = 0;
+                t_next[axis] = std::numeric_limits<float>::infinity();
+                t_delta[axis] = std::numeric_limits<float>::infinity();
+            }
+        }
+
+        while(true) {
+            // The ray leaves the cell through the closest boundary.
+            int axis = t_next.x < t_next.y ? (t_next.x < t_next.z ? 0 : 2) : (t_next.y < t_next.z ? 1 : 2);
+            float t_exit = std::min(t_next[axis], t_end);
+            if(visit(get_cell_index(cell), t_enter, t_exit)) return;
+            if(t_exit >= t_end) return;
+            cell[axis] += step[axis];
+            if(cell[axis] < 0 || cell[axis] >= resolution[axis]) return;
+            t_enter = t_exit;
+            t_next[axis] += t_delta[axis];
+        }
+    }
+
+    // Intersects the ray with the shapes in the cells it crosses between the distances t_min and t_max.
+    // Returns true if it found a hit closer than hit.distance, in which case hit contains it.
+    bool intersect(const Ray& ray, RayHit& hit, float t_min, float t_max) const;
+    // Intersects the ray with a list of shapes and returns true if one of them is hit closer than hit.distance.
+    static bool intersect_shapes(std::span<Shape* const> shapes, const Ray& ray, RayHit& hit);
+
+    // Getters
+    inline const AABB& get_bounds() const { return bounds; }
+    inline glm::ivec3 get_resolution() const { return resolution; }
+    inline size_t get_cell_count() const { return cell_starts.size() - 1; }
+    // Get the shapes overlapping a cell.
+    inline std::span<Shape* const> get_cell_shapes(size_t cell) const {
+        return std::span<Shape* const>(references.data() + cell_starts[cell], cell_starts[cell + 1] - cell_starts[cell]);
+    }
+    // Get the bounds of a cell.
+    AABB get_cell_bounds(size_t cell) const;
+
+private:
+    // The grids are clamped to this number of cells along each axis, so that scenes which are flat along one axis stay reasonable.
+    static constexpr int MAX_RESOLUTION = 256;
+
+    AABB bounds = { glm::vec3(0.0f), glm::vec3(0.0f) };
+    glm::ivec3 resolution = glm::ivec3(1);
+    glm::vec3 cell_size = glm::vec3(1.0f), inverse_cell_size = glm::vec3(1.0f);
+    TrackedVector<uint32_t, MemoryCategory::ACCELERATORS> cell_starts = { 0, 0 }; // The shapes of the cell i are between references[cell_starts[i]] and references[cell_starts[i + 1]].
+    TrackedVector<Shape*, MemoryCategory::ACCELERATORS> references;
+
+    inline size_t get_cell_index(const glm::ivec3& cell) const {
+        return cell.x + static_cast<size_t>(resolution.x) * (cell.y + static_cast<size_t>(resolution.y) * cell.z);
+    }
+    // Returns the range of cells overlapped by a box (clamped to the grid).
+    void get_cell_range(const AABB& box, glm::ivec3& first, glm::ivec3& last) const;
+};
+
+// An accelerator made of a uniform grid over the whole scene,
+// or of a two-level grid: a coarse grid in which each crowded cell holds a finer grid sized for the shapes it contains.
+// The second level adapts the resolution to the local density of the shapes, so a small detailed object
+// in a large sparse scene does not end up in a handful of crowded cells.
+class GridAccelerator final : public Accelerator {
+public:
+    GridAccelerator(std::span<Shape* const> shapes, bool two_level);
+    bool intersect(const Ray& ray, RayHit& hit) const override;
+
+    inline const UniformGrid& get_top_grid() const { return top_grid; }
+    inline size_t get_sub_grid_count() const { return sub_grids.size(); }
+
+private:
+    // The number of cells per shape of the uniform grid, and of each level of the two-level grid.
+    static constexpr float DENSITY = 4.0f;
+    static constexpr float TOP_DENSITY = 0.25f;
+    static constexpr float SUB_DENSITY = 4.0f;
+    // The cells of the top grid holding more shapes than this get a grid of their own.
+    static constexpr size_t SUB_GRID_MIN_SHAPES = 8;
+
+    UniformGrid top_grid;
+    TrackedVector<UniformGrid, MemoryCategory::ACCELERATORS> sub_grids;
+    TrackedVector<int32_t, MemoryCategory::ACCELERATORS> cell_sub_grids; // The index of the grid of each cell of the top grid, or -1 if its shapes are tested directly (empty for uniform grids).
+};
+
+////////////////////
+// Grid Traversal //
+////////////////////
+
+// Defined in the header so that the grid walks and the cell tests are inlined into the render kernels of the grids.
+
+inline bool UniformGrid::intersect_shapes(std::span<Shape* const> shapes, const Ray& ray, RayHit& hit) {
+    bool has_hit = false;
+    for(const Shape* shape: shapes) {
+        RayHit shape_hit;
+        if(shape->intersect(ray, shape_hit) && shape_hit.distance < hit.distance) {
+            has_hit = true;
+            hit = shape_hit;
+            hit.material_id = shape->get_material_id();
+        }
+    }
+    return has_hit;
+}
+
+inline bool UniformGrid::intersect(const Ray& ray, RayHit& hit, float t_min, float t_max) const {
+    bool has_hit = false;
+    traverse(ray, t_min, t_max, [&](size_t cell, float, float t_exit) {
+        has_hit |= intersect_shapes(get_cell_shapes(cell), ray, hit);
+        // A shape in the next cells can only be hit closer than t_exit if it also overlaps one of the cells already visited,
+        // so a hit inside the current cell is the closest one.
+        return hit.distance <= t_exit;
+    });
+    return has_hit;
+}
+
+inline bool GridAccelerator::intersect(const Ray& ray, RayHit& hit) const {
+    hit.distance = std::numeric_limits<float>::max();
+    if(cell_sub_grids.empty()) return top_grid.intersect(ray, hit, 0.0f, std::numeric_limits<float>::max());
+
+    bool has_hit = false;
+    top_grid.traverse(ray, 0.0f, std::numeric_limits<float>::max(), [&](size_t cell, float t_enter, float t_exit) {
+        int32_t sub_grid = cell_sub_grids[cell];
+        if(sub_grid >= 0) {
+            // Only walk through the part of the sub grid inside the cell, since the rest belongs to the neighbouring cells.
+            has_hit |= sub_grids[sub_grid].intersect(ray, hit, t_enter, t_exit);
+        } else {
+            has_hit |= UniformGrid::intersect_shapes(top_grid.get_cell_shapes(cell), ray, hit);
+        }
+        return hit.distance <= t_exit;
+    });
+    return has_hit;
+}
@@ -0,0 +1,249 @@
+#include "guiding.hpp"
+
+#include <gtc/constants.hpp>
+
+#include <cmath>
+#include <atomic>
+
+// Maps a direction to the unit square using the cylindrical mapping (cos(theta), phi). The mapping preserves area.
+static glm::vec2 direction_to_square(const glm::vec3& direction) {
+    float cos_theta = glm::clamp(direction.z, -1.0f, 1.0f);
+    float phi = std::atan2(direction.y, direction.x);
+    if(phi < 0.0f) phi += 2.0f * glm::pi<float>();
+    return glm::clamp(glm::vec2((cos_theta + 1.0f) * 0.5f, phi / (2.0f * glm::pi<float>())), glm::vec2(0.0f), glm::vec2(0.99999994f));
+}
+
+// The inverse of direction_to_square.
+static glm::vec3 square_to_direction(glm::vec2 point) {
+    float cos_theta = point.x * 2.0f - 1.0f;
+    float phi = point.y * 2.0f * glm::pi<float>();
+    float sin_theta = glm::sqrt(glm::max(0.0f, 1.0f - cos_theta * cos_theta));
+    return glm::vec3(sin_theta * glm::cos(phi), sin_theta * glm::sin(phi), cos_theta);
+}
+
+// Since the mapping preserves area, the solid angle pdf is the square pdf divided by the area of the sphere.
+static const float SQUARE_TO_SOLID_ANGLE_PDF = 1.0f / (4.0f * glm::pi<float>());
+
+// Returns the quadrant (0-3) containing the point, where bit 0 is the x half and bit 1 is the y half.
+static inline int get_quadrant(glm::vec2 point) {
+    return (point.x >= 0.5f ? 1 : 0) | (point.y >= 0.5f ? 2 : 0);
+}
+
+//////////////////////////
+// Directional Quadtree //
+//////////////////////////
+
+DirectionalQuadtree::DirectionalQuadtree() : nodes(1) {}
+
+void DirectionalQuadtree::record(const glm::vec3& direction, float energy) {
+    if(!(energy > 0.0f) || !std::isfinite(energy)) return;
+    glm::vec2 point = direction_to_square(direction);
+    uint32_t node_index = 0;
+    while(true) {
+        Node& node = nodes[node_index];
+        int quadrant = get_quadrant(point);
+        std::atomic_ref<float>(node.energy[quadrant]).fetch_add(energy, std::memory_order_relaxed);
+        if(node.children[quadrant] == 0) break;
+        // Move the point into the child's local space.
+        point = point * 2.0f - glm::vec2(quadrant & 1, quadrant >> 1);
+        node_index = node.children[quadrant];
+    }
+}
+
+glm::vec3 DirectionalQuadtree::sample(glm::vec2 random, float& pdf) const {
+    random = glm::clamp(random, glm::vec2(0.0f), glm::vec2(0.99999994f));
+    glm::vec2 origin(0.0f);
+    float scale = 1.0f;
+    float square_pdf = 1.0f;
+    uint32_t node_index = 0;
+    while(true) {
+        const Node& node = nodes[node_index];
+        float total = node.energy[0] + node.energy[1] + node.energy[2] + node.energy[3];
+        int quadrant;
+        if(total <= 0.0f) {
+            // Without any recorded energy, we sample the quadrants uniformly.
+            quadrant = get_quadrant(random);
+            random = random * 2.0f - glm::vec2(quadrant & 1, quadrant >> 1);
+        } else {
+            // Pick the x half then the y half proportionally to their energy, and reuse the random numbers.
+            float right = node.energy[1] + node.energy[3];
+            float right_probability = right / total;
+            int x_half = random.x < 1.0f - right_probability ? 0 : 1;
+            random.x = x_half == 0 ? random.x / (1.0f - right_probability) : (random.x - (1.0f - right_probability)) / right_probability;
+            float column = x_half == 0 ? total - right : right;
+            float top_probability = node.energy[x_half | 2] / column;
+            int y_half = random.y < 1.0f - top_probability ? 0 : 1;
+            random.y = y_half == 0 ? random.y / (1.0f - top_probability) : (random.y - (1.0f - top_probability)) / top_probability;
+            quadrant = x_half | (y_half << 1);
+            random = glm::clamp(random, glm::vec2(0.0f), glm::vec2(0.99999994f));
+        }
+        square_pdf *= total <= 0.0f ? 1.0f : 4.0f * node.energy[quadrant] / total;
+        scale *= 0.5f;
+        origin += scale * glm::vec2(quadrant & 1, quadrant >> 1);
+        if(node.children[quadrant] == 0) break;
+        node_index = node.children[quadrant];
+    }
+    pdf = square_pdf * SQUARE_TO_SOLID_ANGLE_PDF;
+    return square_to_direction(origin + random * scale);
+}
+
+float DirectionalQuadtree::pdf(const glm::vec3& direction) const {
+    glm::vec2 point = direction_to_square(direction);
+    float square_pdf = 1.0f;
+    uint32_t node_index = 0;
+    while(true) {
+        const Node& node = nodes[node_index];
+        float total = node.energy[0] + node.energy[1] + node.energy[2] + node.energy[3];
+        int quadrant = get_quadrant(point);
+        if(total > 0.0f) square_pdf *= 4.0f * node.energy[quadrant] / total;
+        if(node.children[quadrant] == 0) break;
+        point = point * 2.0f - glm::vec2(quadrant & 1, quadrant >> 1);
+        node_index = node.children[quadrant];
+    }
+    return square_pdf * SQUARE_TO_SOLID_ANGLE_PDF;
+}
+
+float DirectionalQuadtree::get_total_energy() const {
+    const Node& root = nodes[0];
+    return root.energy[0] + root.energy[1] + root.energy[2] + root.energy[3];
+}
+
+DirectionalQuadtree DirectionalQuadtree::refine(float subdivision_threshold, size_t max_nodes, int max_depth) const {
+    DirectionalQuadtree result;
+    float total = get_total_energy();
+    if(total <= 0.0f) return result;
+
+    // We build the new tree breadth first, so that the memory budget is spent on the shallow (most important) levels first.
+    // Each entry maps a node in the new tree to the node in this tree covering the same region (or to none if this tree is coarser),
+    // and carries the energy of that region when it comes from a coarser node (assuming the energy is uniform inside it).
+    struct Entry { uint32_t new_node; int64_t old_node; float energy[4]; int depth; };
+    std::vector<Entry> queue;
+    Entry root = { 0, 0, {}, 1 };
+    for(int quadrant = 0; quadrant < 4; ++quadrant) root.energy[quadrant] = nodes[0].energy[quadrant];
+    queue.push_back(root);
+    for(size_t head = 0; head < queue.size(); ++head) {
+        Entry entry = queue[head];
+        for(int quadrant = 0; quadrant < 4; ++quadrant) {
+            if(entry.energy[quadrant] / total <= subdivision_threshold) continue;
+            if(entry.depth >= max_depth || result.nodes.size() >= max_nodes) continue;
+            uint32_t child = static_cast<uint32_t>(result.nodes.size());
+            result.nodes.emplace_back();
+            result.nodes[entry.new_node].children[quadrant] = child;
+            Entry child_entry = { child, -1, {}, entry.depth + 1 };
+            uint32_t old_child = entry.old_node >= 0 ? nodes[entry.old_node].children[quadrant] : 0;
+            if(old_child != 0) {
+                child_entry.old_node = old_child;
+                for(int q = 0; q < 4; ++q) child_entry.energy[q] = nodes[old_child].energy[q];
+            } else {
+                for(int q = 0; q < 4; ++q) child_entry.energy[q] = entry.energy[quadrant] * 0.25f;
+            }
+            queue.push_back(child_entry);
+        }
+    }
+    return result;
+}
+
+////////////////
+// Path Guide //
+////////////////
+
+PathGuide::PathGuide(const AABB& bounds, const PathGuideSettings& settings) : settings(settings) {
+    // Make the bounds a cube (slightly enlarged), so that splitting along the axes in turn keeps the cells well shaped.
+    glm::vec3 center = (bounds.vmin + bounds.vmax) * 0.5f;
+    float half_size = glm::max(glm::max(bounds.vmax.x - bounds.vmin.x, bounds.vmax.y - bounds.vmin.y), bounds.vmax.z - bounds.vmin.z) * 0.5f;
+    half_size = glm::max(half_size * 1.001f, 1e-3f);
+    this->bounds = { center - half_size, center + half_size };
+    spatial_nodes.emplace_back();
+    leaves.emplace_back();
+}
+
+uint32_t PathGuide::find_leaf(const glm::vec3& position) const {
+    glm::vec3 local = (position - bounds.vmin) / (bounds.vmax - bounds.vmin);
+    uint32_t node_index = 0;
+    while(true) {
+        const SpatialNode& node = spatial_nodes[node_index];
+        if(node.children[0] == 0) return node.leaf;
+        // Move the position into the child's local space.
+        float coordinate = glm::clamp(local[node.axis], 0.0f, 1.0f) * 2.0f;
+        int child = coordinate >= 1.0f ? 1 : 0;
+        local[node.axis] = coordinate - child;
+        node_index = node.children[child];
+    }
+}
+
+void PathGuide::record(const glm::vec3& position, const glm::vec3& direction, const Color& radiance) {
+    SpatialLeaf& leaf = leaves[find_leaf(position)];
+    leaf.recording.record(direction, (radiance.r + radiance.g + radiance.b) / 3.0f);
+    leaf.record_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PathGuide::refine() {
+    training_passes++;
+
+    // Split the spatial cells that received enough records. Like in the SD-tree, the threshold grows with the square root
+    // of the sample count, which doubles every training pass.
+    uint32_t split_threshold = static_cast<uint32_t>(settings.spatial_split_threshold * std::sqrt(std::pow(2.0f, training_passes - 1)));
+    size_t spatial_budget = settings.max_memory / 2;
+    // Each split halves the record count of the children (assuming the records are uniform), and the new children are
+    // appended to the list, so they are split again until they are below the threshold.
+    for(size_t node_index = 0; node_index < spatial_nodes.size(); ++node_index) {
+        if(spatial_nodes[node_index].children[0] != 0) continue;
+        if((spatial_nodes.size() + 2) * sizeof(SpatialNode) + (leaves.size() + 1) * sizeof(SpatialLeaf) > spatial_budget) break;
+        uint32_t leaf_index = spatial_nodes[node_index].leaf;
+        if(leaves[leaf_index].record_count.load() <= split_threshold) continue;
+        // The first child reuses the leaf data, and the second child gets a copy of it.
+        uint32_t first = static_cast<uint32_t>(spatial_nodes.size());
+        int child_axis = (spatial_nodes[node_index].axis + 1) % 3;
+        leaves[leaf_index].record_count = leaves[leaf_index].record_count.load() / 2;
+        leaves.push_back(leaves[leaf_index]);
+        spatial_nodes.push_back({ {}, child_axis, leaf_index });
+        spatial_nodes.push_back({ {}, child_axis, static_cast<uint32_t>(leaves.size() - 1) });
+        spatial_nodes[node_index].children[0] = first;
+        spatial_nodes[node_index].children[1] = first + 1;
+    }
+
+    // The recorded distributions become the sampling distributions, and the recording quadtrees are adapted to them.
+    // The remaining memory budget is shared equally by the quadtrees.
+    size_t spatial_bytes = spatial_nodes.size() * sizeof(SpatialNode) + leaves.size() * sizeof(SpatialLeaf);
+    size_t directional_budget = settings.max_memory > spatial_bytes ? settings.max_memory - spatial_bytes : 0;
+    size_t max_nodes_per_tree = glm::max<size_t>(1, directional_budget / (leaves.size() * 2 * sizeof(DirectionalQuadtree::Node)));
+    for(SpatialLeaf& leaf: leaves) {
+        leaf.sampling = leaf.recording;
+        leaf.recording = leaf.sampling.refine(settings.directional_subdivision_threshold, max_nodes_per_tree, settings.max_directional_depth);
+        leaf.record_count = 0;
+    }
+}
+
+size_t PathGuide::get_memory_usage() const {
+    size_t bytes = spatial_nodes.capacity() * sizeof(SpatialNode) + leaves.capacity() * sizeof(SpatialLeaf);
+    for(const SpatialLeaf& leaf: leaves) {
+        bytes += (leaf.sampling.get_node_count() + leaf.recording.get_node_count()) * sizeof(DirectionalQuadtree::Node);
+    }
+    return bytes;
+}
+
+MaterialSample PathGuide::guide_diffuse_sample(
+    const glm::vec3& position, const glm::vec3& normal, const Color& albedo, const MaterialSample& bsdf_sample,
+    float selection, glm::vec2 random
+) const {
+    if(!is_trained()) return bsdf_sample;
+    const DirectionalQuadtree& distribution = leaves[find_leaf(position)].sampling;
+    if(distribution.get_total_energy() <= 0.0f) return bsdf_sample;
+
+    // Pick one of the strategies.
+    const float bsdf_fraction = settings.bsdf_sampling_fraction;
+    glm::vec3 direction = bsdf_sample.outgoing_ray_direction;
+    if(selection >= bsdf_fraction) {
+        float guide_pdf;
+        direction = distribution.sample(random, guide_pdf);
+    }
+
+    // The lambert BRDF is albedo / pi, and the cosine distributed BSDF sampling has a pdf of cos(theta) / pi.
+    float cos_theta = glm::dot(direction, normal);
+    if(cos_theta <= 0.0f) {
+        return { direction, Colors::BLACK, bsdf_sample.emission };
+    }
+    float bsdf_pdf = cos_theta / glm::pi<float>();
+    float pdf = bsdf_fraction * bsdf_pdf + (1.0f - bsdf_fraction) * distribution.pdf(direction);
+    return { direction, albedo * (bsdf_pdf / pdf), bsdf_sample.emission };
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <glm.hpp>
+#include <color.hpp>
+#include <aabb.hpp>
+#include <material.hpp>
+#include <memory.hpp>
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+
+// A directional distribution over the sphere of directions stored as a quadtree.
+// Directions are mapped to the unit square using the (area preserving) cylindrical mapping (cos(theta), phi),
+// and each quadtree node stores the energy recorded in each of its four quadrants.
+class DirectionalQuadtree {
+public:
+    // Construct a quadtree with a single (root) node.
+    DirectionalQuadtree();
+
+    // Adds the given energy to the leaf containing the direction. It is safe to call it from multiple threads.
+    void record(const glm::vec3& direction, float energy);
+    // Samples a direction proportionally to the energy stored in the quadtree, and returns its solid angle pdf.
+    glm::vec3 sample(glm::vec2 random, float& pdf) const;
+    // Returns the solid angle pdf of sampling the given direction.
+    float pdf(const glm::vec3& direction) const;
+    // Returns the total energy stored in the quadtree.
+    float get_total_energy() const;
+    // Returns the number of nodes in the quadtree.
+    inline size_t get_node_count() const { return nodes.size(); }
+
+    // Builds a new (empty) quadtree whose structure is adapted to the energy stored in this one:
+    // quadrants holding more than `subdivision_threshold` of the total energy are subdivided, and the others are collapsed.
+    // The quadtree never grows beyond `max_nodes` nodes or `max_depth` levels.
+    DirectionalQuadtree refine(float subdivision_threshold, size_t max_nodes, int max_depth) const;
+
+    // A quadtree node.
+    struct Node {
+        float energy[4] = {}; // The energy recorded in each quadrant.
+        uint32_t children[4] = {}; // The index of each quadrant's child node (0 if the quadrant is a leaf).
+    };
+
+private:
+    TrackedVector<Node, MemoryCategory::CACHES> nodes;
+};
+
+// The parameters that control how the path guide is trained.
+struct PathGuideSettings {
+    float bsdf_sampling_fraction = 0.5f; // The probability of sampling the BSDF instead of the guiding distribution.
+    uint32_t spatial_split_threshold = 4000; // A spatial cell is split when it receives more records than this in a training pass.
+    float directional_subdivision_threshold = 0.01f; // A directional quadrant is subdivided when it holds more than this fraction of the energy.
+    int max_directional_depth = 20; // The maximum depth of the directional quadtrees.
+    size_t max_memory = 64 * 1024 * 1024; // The memory budget (in bytes) of the guiding structure.
+};
+
+// An online path guiding structure (a simplified SD-tree): a spatial binary tree over the scene bounds whose leaves
+// contain directional quadtrees of the light arriving at that region of space.
+// Each leaf holds two quadtrees: one that is sampled and one that records the light in the current training pass.
+// Recording is thread-safe, while refine must be called between passes when no other thread is using the guide.
+class PathGuide {
+public:
+    PathGuide(const AABB& bounds, const PathGuideSettings& settings = {});
+
+    // Records the light `radiance` arriving at `position` from `direction`.
+    void record(const glm::vec3& position, const glm::vec3& direction, const Color& radiance);
+    // Builds the sampling distributions from the light recorded since the last call, and prepares the structure for the next pass.
+    // The number of spatial and directional cells is adapted to the recorded data while staying within the memory budget.
+    void refine();
+
+    // Returns true if the guide has been refined at least once (i.e. it has a distribution to sample from).
+    inline bool is_trained() const { return training_passes > 0; }
+    // Returns the memory used by the guiding structure in bytes.
+    size_t get_memory_usage() const;
+
+    // Samples a new direction for a diffuse (lambert) surface by mixing the guiding distribution with the given BSDF sample,
+    // which must be cosine distributed around the normal (like the LambertMaterial samples).
+    // The two strategies are combined using one-sample multiple importance sampling, so the result stays unbiased.
+    // `selection` and `random` are uniform random numbers in [0,1].
+    MaterialSample guide_diffuse_sample(
+        const glm::vec3& position, const glm::vec3& normal, const Color& albedo, const MaterialSample& bsdf_sample,
+        float selection, glm::vec2 random
+    ) const;
+
+private:
+    struct SpatialNode {
+        uint32_t children[2] = {}; // The index of the two children (0 in leaves).
+        int axis = 0; // The axis along which the node is split in half.
+        uint32_t leaf = 0; // The index of the leaf data (only valid in leaves).
+    };
+    struct SpatialLeaf {
+        DirectionalQuadtree sampling, recording;
+        std::atomic<uint32_t> record_count = 0;
+
+        SpatialLeaf() = default;
+        SpatialLeaf(const SpatialLeaf& other) : sampling(other.sampling), recording(other.recording), record_count(other.record_count.load()) {}
+    };
+
+    AABB bounds;
+    PathGuideSettings settings;
+    TrackedVector<SpatialNode, MemoryCategory::CACHES> spatial_nodes;
+    TrackedVector<SpatialLeaf, MemoryCategory::CACHES> leaves;
+    int training_passes = 0;
+
+    // Finds the index of the leaf containing the given position.
+    uint32_t find_leaf(const glm::vec3& position) const;
+};
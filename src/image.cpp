@@ -1,22 +1,313 @@
 #include "image.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image_write.h>
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
 
-void Image::save(const std::string& path) {
-    std::vector<uint8_t> encoded(width * height * 4);
-
-    for(size_t i = 0, j = 0; i < pixels.size(); ++i) {
-        // Apply reinhard tonemapping
-        Color color = tonemap_reinhard(pixels[i]);
-        // Encode to non-linear sRGB color space
-        ColorSRGB srgb = encode_srgb(color);
-        encoded[j++] = srgb.r;
-        encoded[j++] = srgb.g;
-        encoded[j++] = srgb.b;
-        encoded[j++] = 255;
-    }
-    
-    stbi_flip_vertically_on_write(true);
-    stbi_write_png(path.c_str(), width, height, 4, encoded.data(), width * 4);
-}
\ No newline at end of file
+#include <bit>
+#include <cstring>
+#include <array>
+#include <cstdint>
+#include <algorithm>
+#include <fstream>
+#include <filesystem>
+#include <mutex>
+
+// A lookup table that replaces the per-channel `pow` of encode_srgb.
+// It is indexed by the bits of the float value (its exponent and the top 8 bits of its mantissa), so its precision 
+// is relative to the value. This matters because the gamma curve is very steep near zero.
+// Since sRGB encoding is applied to each channel independently, the table is filled by calling encode_srgb on grey colors.
+class SRGBEncodingTable {
+public:
+    SRGBEncodingTable() {
+        for(uint32_t index = 0; index < SIZE; ++index) {
+            // Sample at the center of the range of floats mapped to this entry.
+            float value = std::bit_cast<float>(MIN_BITS + (index << MANTISSA_SHIFT) + (1u << (MANTISSA_SHIFT - 1)));
+            table[index] = encode_srgb(Color(value)).r;
+        }
+        zero = encode_srgb(Colors::BLACK).r;
+        one = encode_srgb(Colors::WHITE).r;
+    }
+
+    // Encodes a linear display value to non-linear sRGB.
+    inline uint8_t encode(float value) const {
+        if(!(value > MIN_VALUE)) return zero; // This also catches NaNs.
+        if(value >= 1.0f) return one;
+        return table[(std::bit_cast<uint32_t>(value) - MIN_BITS) >> MANTISSA_SHIFT];
+    }
+
+private:
+    // Values below 2^-24 are encoded as zero (even a pure 2.2 gamma curve maps them to less than 0.2/255).
+    static constexpr float MIN_VALUE = 1.0f / (1 << 24);
+    static constexpr uint32_t MIN_BITS = 0x33800000u; // The bits of MIN_VALUE.
+    static constexpr uint32_t MANTISSA_SHIFT = 23 - 8; // Keep the top 8 bits of the mantissa.
+    static constexpr uint32_t SIZE = 24 << 8; // 24 exponents (from 2^-24 to 1) with 256 entries each.
+
+    std::array<uint8_t, SIZE> table;
+    uint8_t zero, one;
+};
+
+bool Image::save(const std::string& path, const ImageSaveOptions& options) const {
+    TraceScope trace("save image");
+    std::string extension = std::filesystem::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return std::tolower(c); });
+    if(extension == ".pfm") return save_pfm(path);
+    if(extension == ".exr") return save_exr(path);
+
+    std::vector<uint8_t> encoded = encode_srgb8();
+    if(extension == ".bmp") {
+        return stbi_write_bmp(path.c_str(), width, height, 3, encoded.data()) != 0;
+    } else if(extension == ".tga") {
+        return stbi_write_tga(path.c_str(), width, height, 3, encoded.data()) != 0;
+    } else if(extension == ".jpg" || extension == ".jpeg") {
+        return stbi_write_jpg(path.c_str(), width, height, 3, encoded.data(), options.jpg_quality) != 0;
+    } else {
+        // The compression level is a global of stb, so the PNGs are written one at a time (e.g. by the background writers of the batch mode).
+        static std::mutex png_mutex;
+        std::lock_guard lock(png_mutex);
+        stbi_write_png_compression_level = options.png_compression_level;
+        return stbi_write_png(path.c_str(), width, height, 3, encoded.data(), width * 3) != 0;
+    }
+}
+
+std::vector<uint8_t> Image::encode_srgb8() const {
+    static const SRGBEncodingTable srgb_table;
+
+    // The image is stored bottom-up, so we write the rows in reverse order to flip it while encoding.
+    std::vector<uint8_t> encoded(static_cast<size_t>(width) * height * 3);
+    parallel_for(0, height, [&](int y) {
+        const Color* source = &pixels[static_cast<size_t>(y) * width];
+        uint8_t* destination = &encoded[static_cast<size_t>(height - 1 - y) * width * 3];
+        for(int x = 0; x < width; ++x) {
+            // Apply reinhard tonemapping
+            Color color = tonemap_reinhard(source[x]);
+            // Encode to non-linear sRGB color space
+            destination[3 * x + 0] = srgb_table.encode(color.r);
+            destination[3 * x + 1] = srgb_table.encode(color.g);
+            destination[3 * x + 2] = srgb_table.encode(color.b);
+        }
+    });
+    return encoded;
+}
+
+Image Image::to_display() const {
+    std::vector<uint8_t> encoded = encode_srgb8();
+    Image display(width, height);
+    for(int y = 0; y < height; ++y) {
+        const uint8_t* source = &encoded[static_cast<size_t>(height - 1 - y) * width * 3];
+        for(int x = 0; x < width; ++x) display(x, y) = Color(source[3 * x], source[3 * x + 1], source[3 * x + 2]) / 255.0f;
+    }
+    return display;
+}
+
+bool Image::load(const std::string& path, Image& image, std::string& error) {
+    std::string extension = std::filesystem::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return std::tolower(c); });
+    if(extension == ".pfm") return load_pfm(path, image, error);
+
+    int file_width, file_height, channels;
+    uint8_t* data = stbi_load(path.c_str(), &file_width, &file_height, &channels, 3);
+    if(data == nullptr) {
+        error = "could not read " + path + " (" + stbi_failure_reason() + ")";
+        return false;
+    }
+    // The rows of the 8-bit formats are stored from top to bottom.
+    image = Image(file_width, file_height);
+    for(int y = 0; y < file_height; ++y) {
+        const uint8_t* source = &data[(file_height - 1 - y) * file_width * 3];
+        for(int x = 0; x < file_width; ++x) image(x, y) = Color(source[3 * x], source[3 * x + 1], source[3 * x + 2]) / 255.0f;
+    }
+    stbi_image_free(data);
+    return true;
+}
+
+
+// Helpers to append the little-endian binary fields of an OpenEXR header.
+template<typename T>
+static void append_exr_value(std::string& header, T value) {
+    static_assert(std::endian::native == std::endian::little, "The EXR writer assumes a little-endian machine");
+    header.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+static void append_exr_attribute_header(std::string& header, const char* name, const char* type, int32_t size) {
+    header.append(name, std::strlen(name) + 1);
+    header.append(type, std::strlen(type) + 1);
+    append_exr_value<int32_t>(header, size);
+}
+
+// Builds the header of an uncompressed single-part scanline OpenEXR file with 32-bit float B, G & R channels.
+static std::string make_exr_header(int width, int height) {
+    std::string header;
+    // The magic number and the version (2, single-part scanline).
+    append_exr_value<int32_t>(header, 20000630);
+    append_exr_value<int32_t>(header, 2);
+
+    // The header attributes. The channels must be sorted by name.
+    const char* channel_names[] = { "B", "G", "R" };
+    append_exr_attribute_header(header, "channels", "chlist", 3 * 18 + 1);
+    for(const char* channel_name: channel_names) {
+        header.append(channel_name, 2);
+        append_exr_value<int32_t>(header, 2); // The pixel type (FLOAT).
+        append_exr_value<uint8_t>(header, 0); // pLinear
+        append_exr_value<uint8_t>(header, 0); append_exr_value<uint8_t>(header, 0); append_exr_value<uint8_t>(header, 0); // Reserved
+        append_exr_value<int32_t>(header, 1); // x sampling
+        append_exr_value<int32_t>(header, 1); // y sampling
+    }
+    append_exr_value<uint8_t>(header, 0);
+    append_exr_attribute_header(header, "compression", "compression", 1);
+    append_exr_value<uint8_t>(header, 0); // NO_COMPRESSION
+    for(const char* window_name: { "dataWindow", "displayWindow" }) {
+        append_exr_attribute_header(header, window_name, "box2i", 16);
+        append_exr_value<int32_t>(header, 0);
+        append_exr_value<int32_t>(header, 0);
+        append_exr_value<int32_t>(header, width - 1);
+        append_exr_value<int32_t>(header, height - 1);
+    }
+    append_exr_attribute_header(header, "lineOrder", "lineOrder", 1);
+    append_exr_value<uint8_t>(header, 0); // INCREASING_Y
+    append_exr_attribute_header(header, "pixelAspectRatio", "float", 4);
+    append_exr_value<float>(header, 1.0f);
+    append_exr_attribute_header(header, "screenWindowCenter", "v2f", 8);
+    append_exr_value<float>(header, 0.0f);
+    append_exr_value<float>(header, 0.0f);
+    append_exr_attribute_header(header, "screenWindowWidth", "float", 4);
+    append_exr_value<float>(header, 1.0f);
+    append_exr_value<uint8_t>(header, 0); // End of the header
+
+    // The offset table: the file position of each scanline block (one scanline per block without compression).
+    const uint64_t block_size = 2 * sizeof(int32_t) + width * 3 * sizeof(float);
+    const uint64_t first_block = header.size() + height * sizeof(uint64_t);
+    for(int y = 0; y < height; ++y) append_exr_value<uint64_t>(header, first_block + y * block_size);
+    return header;
+}
+
+bool FloatImageLayout::create(const std::string& path, int width, int height, FloatImageLayout& layout) {
+    std::string extension = std::filesystem::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return std::tolower(c); });
+    layout.width = width;
+    layout.height = height;
+    if(extension == ".pfm") {
+        // A PFM file is a small text header followed by the RGB floats of the rows from bottom to top.
+        // A negative scale marks the data as little-endian.
+        const char* scale = std::endian::native == std::endian::little ? "-1.0" : "1.0";
+        layout.planar = false;
+        layout.header = "PF\n" + std::to_string(width) + " " + std::to_string(height) + "\n" + scale + "\n";
+        layout.row_stride = width * sizeof(Color);
+        layout.row_prefix_size = 0;
+    } else if(extension == ".exr") {
+        // Each EXR scanline block starts with its line number and its size, and the lines are stored from top to bottom.
+        layout.planar = true;
+        layout.header = make_exr_header(width, height);
+        layout.row_prefix_size = 2 * sizeof(int32_t);
+        layout.row_stride = layout.row_prefix_size + width * sizeof(Color);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+size_t FloatImageLayout::get_row_offset(int y) const {
+    int file_row = planar ? height - 1 - y : y;
+    return header.size() + static_cast<size_t>(file_row) * row_stride + row_prefix_size;
+}
+
+void FloatImageLayout::initialize(char* file) const {
+    std::memcpy(file, header.data(), header.size());
+    if(!planar) return;
+    for(int line = 0; line < height; ++line) {
+        int32_t prefix[2] = { line, static_cast<int32_t>(width * sizeof(Color)) };
+        std::memcpy(file + header.size() + static_cast<size_t>(line) * row_stride, prefix, sizeof(prefix));
+    }
+}
+
+void FloatImageLayout::write_pixels(char* file, int x, int y, const Color* colors, int count) const {
+    char* row = file + get_row_offset(y);
+    if(!planar) {
+        std::memcpy(row + x * sizeof(Color), colors, count * sizeof(Color));
+        return;
+    }
+    // The EXR lines store all of their B values, then G, then R.
+    float* blue = reinterpret_cast<float*>(row) + x;
+    float* green = blue + width;
+    float* red = green + width;
+    for(int i = 0; i < count; ++i) {
+        blue[i] = colors[i].b;
+        green[i] = colors[i].g;
+        red[i] = colors[i].r;
+    }
+}
+
+bool Image::save_pfm(const std::string& path) const {
+    // The PFM rows are stored from bottom to top, which is exactly how the pixels are stored in memory,
+    // so they are written in a single call without any conversion.
+    static_assert(sizeof(Color) == 3 * sizeof(float), "Colors must be tightly packed to be written directly");
+    FloatImageLayout layout;
+    FloatImageLayout::create(path, width, height, layout);
+    std::ofstream file(path, std::ios::binary);
+    if(!file) return false;
+    file << layout.header;
+    file.write(reinterpret_cast<const char*>(pixels.data()), pixels.size() * sizeof(Color));
+    return static_cast<bool>(file);
+}
+
+bool Image::save_exr(const std::string& path) const {
+    FloatImageLayout layout;
+    FloatImageLayout::create(path, width, height, layout);
+    std::ofstream file(path, std::ios::binary);
+    if(!file) return false;
+    file << layout.header;
+
+    // The scanlines are stored from top to bottom, and each one stores all of its B values, then G, then R.
+    // The line is the only copy made, so the file is streamed with a constant amount of extra memory.
+    const int32_t line_size = width * 3 * sizeof(float);
+    std::vector<float> line(width * 3);
+    for(int y = 0; y < height; ++y) {
+        const Color* source = &pixels[(height - 1 - y) * width];
+        for(int x = 0; x < width; ++x) {
+            line[x] = source[x].b;
+            line[width + x] = source[x].g;
+            line[2 * width + x] = source[x].r;
+        }
+        int32_t prefix[2] = { y, line_size };
+        file.write(reinterpret_cast<const char*>(prefix), sizeof(prefix));
+        file.write(reinterpret_cast<const char*>(line.data()), line_size);
+    }
+    return static_cast<bool>(file);
+}
+
+bool Image::load_pfm(const std::string& path, Image& image, std::string& error) {
+    std::ifstream file(path, std::ios::binary);
+    if(!file) {
+        error = "could not open " + path;
+        return false;
+    }
+    // The header is "PF" (RGB), the size and the scale, whose sign gives the endianness (negative for little-endian),
+    // each followed by a single whitespace character.
+    std::string magic;
+    int file_width = 0, file_height = 0;
+    float scale = 0.0f;
+    file >> magic >> file_width >> file_height >> scale;
+    file.get();
+    if(!file || magic != "PF" || file_width <= 0 || file_height <= 0) {
+        error = path + " is not an RGB PFM file";
+        return false;
+    }
+    image = Image(file_width, file_height);
+    file.read(reinterpret_cast<char*>(image.pixels.data()), image.pixels.size() * sizeof(Color));
+    if(!file) {
+        error = path + " is truncated";
+        return false;
+    }
+    if((scale < 0.0f) != (std::endian::native == std::endian::little)) {
+        for(Color& color: image.pixels) {
+            for(int channel = 0; channel < 3; ++channel) {
+                uint32_t bits = std::bit_cast<uint32_t>(color[channel]);
+                bits = (bits >> 24) | ((bits >> 8) & 0xff00u) | ((bits << 8) & 0xff0000u) | (bits << 24);
+                color[channel] = std::bit_cast<float>(bits);
+            }
+        }
+    }
+    return true;
+}
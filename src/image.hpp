@@ -1,10 +1,41 @@
 #pragma once
 
 #include <color.hpp>
+#include <memory.hpp>
 
 #include <string>
 #include <vector>
 
+// The options controlling how an image is encoded when it is saved.
+struct ImageSaveOptions {
+    int png_compression_level = 8; // The zlib compression level of PNG files, from 0 (fastest) to 9 (smallest).
+    int jpg_quality = 95; // The quality of JPG files, from 1 to 100.
+};
+
+// The layout of an uncompressed floating point image file (PFM or EXR), in which every pixel is stored at a fixed offset.
+// It allows writing the pixels directly into a (memory-mapped) file, in any order.
+// As in Image, the rows are numbered from the bottom.
+struct FloatImageLayout {
+    int width = 0, height = 0;
+    bool planar = false; // EXR rows store all the B values, then G, then R. PFM rows store RGB triplets.
+    std::string header; // The bytes at the start of the file.
+    size_t row_stride = 0; // The distance between consecutive rows in the file.
+    size_t row_prefix_size = 0; // The size of the data stored before each row (the EXR scanline block header).
+
+    // Makes the layout of the file at `path`, picking the format from its extension.
+    // Returns false if the extension is not ".pfm" or ".exr".
+    static bool create(const std::string& path, int width, int height, FloatImageLayout& layout);
+
+    // Returns the size of the whole file in bytes.
+    inline size_t get_file_size() const { return header.size() + height * row_stride; }
+    // Returns the offset in the file of the first pixel of row `y`.
+    size_t get_row_offset(int y) const;
+    // Writes the header and the row prefixes into the file content (which must be get_file_size() bytes).
+    void initialize(char* file) const;
+    // Writes `count` pixels starting at (x, y) into the file content.
+    void write_pixels(char* file, int x, int y, const Color* colors, int count) const;
+};
+
 // A simple image class where each pixel is a Color in linear scene RGB color space
 class Image {
 public:
@@ -13,14 +44,37 @@ public:
     // Access pixel by coordinates
     inline Color& operator()(int x, int y) { return pixels[y * width + x]; }
     inline Color operator()(int x, int y) const { return pixels[y * width + x]; }
+    // Access the contiguous pixels of a row
+    inline const Color* get_row(int y) const { return &pixels[y * width]; }
     // Getters for dimensions
     inline int get_width() const { return width; }
     inline int get_height() const { return height; }
     
-    // Save the image to a PNG file after applying tone mapping and gamma correction.
-    void save(const std::string& path);
+    // Save the image to a file. Returns true if the file was written.
+    // The format is picked from the extension of the path:
+    // - ".pfm" and ".exr" store the raw linear scene colors as 32-bit floats (no tone mapping).
+    // - ".bmp" and ".tga" are the fastest to encode, ".jpg" is lossy, and any other extension is saved as PNG.
+    //   These are 8-bit formats, so tone mapping and gamma correction are applied first.
+    bool save(const std::string& path, const ImageSaveOptions& options = {}) const;
+    // Load an image from a file. Returns false and sets `error` if it could not be read.
+    // The format is picked from the extension of the path:
+    // - ".pfm" files are read as is (linear scene colors).
+    // - Any other extension is decoded by stb_image as an 8-bit image, whose non-linear sRGB values are divided by 255.
+    //   These are the same values as returned by to_display, since the tone mapping can not be undone.
+    static bool load(const std::string& path, Image& image, std::string& error);
+
+    // Returns the image as it is displayed once saved to an 8-bit format (tone mapped and encoded to sRGB),
+    // with the channels divided by 255, so that it can be compared to 8-bit images.
+    Image to_display() const;
 
 private:
-    std::vector<Color> pixels;
+    TrackedVector<Color, MemoryCategory::FRAMEBUFFERS> pixels;
     int width, height;
-};
\ No newline at end of file
+
+    // Tone maps the image and encodes it to 8-bit sRGB with the rows from top to bottom (as stored in the 8-bit formats).
+    std::vector<uint8_t> encode_srgb8() const;
+    // Writers and readers for the floating point formats.
+    bool save_pfm(const std::string& path) const;
+    bool save_exr(const std::string& path) const;
+    static bool load_pfm(const std::string& path, Image& image, std::string& error);
+};
@@ -0,0 +1,124 @@
+#include "irradiance_cache.hpp"
+
+#include <cmath>
+
+// Atomically loads a value that other threads may be updating with atomic adds.
+template<typename T>
+static inline T load_relaxed(const T& value) {
+    return std::atomic_ref<T>(const_cast<T&>(value)).load(std::memory_order_relaxed);
+}
+
+IrradianceCache::IrradianceCache(const AABB& scene_bounds, const IrradianceCacheSettings& settings) : settings(settings) {
+    glm::vec3 size = scene_bounds.vmax - scene_bounds.vmin;
+    float scene_size = glm::max(glm::max(size.x, size.y), size.z);
+    radius = glm::max(scene_size * settings.record_spacing, 1e-4f);
+    // A record can only be used up to a distance of max_error * radius, so with cells twice as large, 
+    // the usable records are always in the 2x2x2 cells closest to the position.
+    cell_size = 2.0f * settings.max_error * radius;
+    // The records are left uninitialized, so that the memory is only committed when they are used.
+    records.reset(new Record[settings.max_records]);
+    buckets = std::make_unique<std::atomic<int32_t>[]>(settings.bucket_count);
+    for(size_t bucket = 0; bucket < settings.bucket_count; ++bucket) buckets[bucket].store(-1, std::memory_order_relaxed);
+    bucket_memory = TrackedMemory(MemoryCategory::CACHES, settings.bucket_count * sizeof(std::atomic<int32_t>));
+}
+
+IrradianceCache::~IrradianceCache() {
+    track_memory(MemoryCategory::CACHES, -static_cast<int64_t>(get_record_count() * sizeof(Record)));
+}
+
+glm::ivec3 IrradianceCache::get_first_neighbor_cell(const glm::vec3& position) const {
+    return glm::ivec3(glm::floor(position / cell_size - 0.5f));
+}
+
+size_t IrradianceCache::get_bucket(glm::ivec3 cell) const {
+    // A simple spatial hash (from "Optimized Spatial Hashing for Collision Detection of Deformable Objects").
+    uint32_t hash = (static_cast<uint32_t>(cell.x) * 73856093u) ^ (static_cast<uint32_t>(cell.y) * 19349663u) ^ (static_cast<uint32_t>(cell.z) * 83492791u);
+    return hash & (settings.bucket_count - 1);
+}
+
+float IrradianceCache::get_weight(const Record& record, const glm::vec3& position, const glm::vec3& normal) const {
+    // Reject the records that are too far or facing away first, since it is cheaper.
+    glm::vec3 offset = position - record.position;
+    float max_distance = settings.max_error * radius;
+    if(glm::dot(offset, offset) >= max_distance * max_distance) return 0.0f;
+    float normal_cos = glm::dot(record.normal, normal);
+    if(normal_cos <= 0.0f) return 0.0f;
+    // Ward's weight: the inverse of the estimated interpolation error.
+    float error = glm::length(offset) / radius + glm::sqrt(glm::max(0.0f, 1.0f - normal_cos));
+    if(error >= settings.max_error) return 0.0f;
+    return 1.0f / glm::max(error, 1e-4f);
+}
+
+bool IrradianceCache::lookup(const glm::vec3& position, const glm::vec3& normal, Color& irradiance) const {
+    glm::ivec3 first_cell = get_first_neighbor_cell(position);
+    Color sum = Colors::BLACK;
+    float weight_sum = 0.0f;
+    for(int z = 0; z <= 1; ++z) for(int y = 0; y <= 1; ++y) for(int x = 0; x <= 1; ++x) {
+        int32_t index = buckets[get_bucket(first_cell + glm::ivec3(x, y, z))].load(std::memory_order_acquire);
+        for(; index >= 0; index = records[index].next) {
+            const Record& record = records[index];
+            uint32_t sample_count = load_relaxed(record.sample_count);
+            if(sample_count < settings.min_samples) continue;
+            float weight = get_weight(record, position, normal);
+            if(weight <= 0.0f) continue;
+            Color mean = Color(
+                load_relaxed(record.irradiance_sum[0]),
+                load_relaxed(record.irradiance_sum[1]),
+                load_relaxed(record.irradiance_sum[2])
+            ) / static_cast<float>(sample_count);
+            sum += weight * mean;
+            weight_sum += weight;
+        }
+    }
+    if(weight_sum <= 0.0f) return false;
+    irradiance = sum / weight_sum;
+    return true;
+}
+
+void IrradianceCache::record(const glm::vec3& position, const glm::vec3& normal, const Color& irradiance) {
+    if(!std::isfinite(irradiance.r) || !std::isfinite(irradiance.g) || !std::isfinite(irradiance.b)) return;
+
+    // Find the record with the highest weight (the closest one).
+    glm::ivec3 first_cell = get_first_neighbor_cell(position);
+    Record* best_record = nullptr;
+    float best_weight = 0.0f;
+    for(int z = 0; z <= 1; ++z) for(int y = 0; y <= 1; ++y) for(int x = 0; x <= 1; ++x) {
+        int32_t index = buckets[get_bucket(first_cell + glm::ivec3(x, y, z))].load(std::memory_order_acquire);
+        for(; index >= 0; index = records[index].next) {
+            float weight = get_weight(records[index], position, normal);
+            if(weight > best_weight) {
+                best_weight = weight;
+                best_record = &records[index];
+            }
+        }
+    }
+
+    if(best_record) {
+        // Accumulate the sample into the closest record.
+        for(int channel = 0; channel < 3; ++channel) {
+            std::atomic_ref<float>(best_record->irradiance_sum[channel]).fetch_add(irradiance[channel], std::memory_order_relaxed);
+        }
+        std::atomic_ref<uint32_t>(best_record->sample_count).fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // Otherwise, allocate a new record (the storage is preallocated, so this is just an atomic increment).
+    size_t index = record_count.fetch_add(1, std::memory_order_relaxed);
+    if(index >= settings.max_records) return;
+    track_memory(MemoryCategory::CACHES, sizeof(Record));
+    Record& record = records[index];
+    record.position = position;
+    record.normal = normal;
+    for(int channel = 0; channel < 3; ++channel) record.irradiance_sum[channel] = irradiance[channel];
+    record.sample_count = 1;
+    // Then publish it at the head of its bucket's list. The release order makes the fields visible before the record.
+    std::atomic<int32_t>& bucket = buckets[get_bucket(glm::ivec3(glm::floor(position / cell_size)))];
+    int32_t head = bucket.load(std::memory_order_relaxed);
+    do {
+        record.next = head;
+    } while(!bucket.compare_exchange_weak(head, static_cast<int32_t>(index), std::memory_order_release, std::memory_order_relaxed));
+}
+
+size_t IrradianceCache::get_memory_usage() const {
+    return get_record_count() * sizeof(Record) + settings.bucket_count * sizeof(std::atomic<int32_t>);
+}
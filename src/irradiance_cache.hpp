@@ -0,0 +1,67 @@
+#pragma once
+
+#include <glm.hpp>
+#include <color.hpp>
+#include <aabb.hpp>
+#include <memory.hpp>
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+// The parameters of the irradiance cache.
+struct IrradianceCacheSettings {
+    uint32_t start_depth = 1; // The first bounce (0 is the camera hit) at which diffuse surfaces query the cache.
+    float record_spacing = 0.05f; // The radius of influence of each record relative to the size of the scene.
+    float max_error = 0.5f; // The maximum interpolation error (Ward's "a"). Records with a weight below 1/max_error are ignored.
+    uint32_t min_samples = 16; // The number of samples a record needs before it can be used for interpolation.
+    size_t max_records = 1 << 20; // The capacity of the cache. Samples that would need a new record beyond it are dropped.
+    size_t bucket_count = 1 << 18; // The number of buckets in the spatial hash grid (must be a power of 2).
+};
+
+// A cache of the irradiance arriving at diffuse surfaces, which varies slowly across them.
+// Each record accumulates the irradiance samples landing near it, and lookups interpolate the nearby records using
+// Ward's error metric (which accounts for the distance between the positions and the difference between the normals).
+// The records are stored in a spatial hash grid. Both record and lookup are lock-free, so they can be called from any thread.
+// Using the cache introduces a small bias (the irradiance is blurred over the records' radius) in exchange for shorter paths.
+class IrradianceCache {
+public:
+    IrradianceCache(const AABB& scene_bounds, const IrradianceCacheSettings& settings = {});
+    ~IrradianceCache();
+
+    // Interpolates the irradiance at the given position & normal from the cached records.
+    // Returns false if no record is close enough (or has enough samples).
+    bool lookup(const glm::vec3& position, const glm::vec3& normal, Color& irradiance) const;
+    // Adds an irradiance sample at the given position & normal.
+    // The sample is added to the closest record, or a new record is created if none is close enough.
+    void record(const glm::vec3& position, const glm::vec3& normal, const Color& irradiance);
+
+    // Getters
+    inline uint32_t get_start_depth() const { return settings.start_depth; }
+    inline size_t get_record_count() const { return glm::min(record_count.load(), settings.max_records); }
+    // Returns the memory used by the cache in bytes (only counting the records in use).
+    size_t get_memory_usage() const;
+
+private:
+    struct Record {
+        glm::vec3 position, normal;
+        float irradiance_sum[3]; // Updated using atomic adds.
+        uint32_t sample_count; // Updated using atomic adds.
+        int32_t next; // The next record in the same bucket (-1 at the end of the list).
+    };
+
+    IrradianceCacheSettings settings;
+    float radius; // The world space radius of influence of each record.
+    float cell_size; // The size of the grid cells, which is twice the maximum distance at which a record can be used.
+    std::unique_ptr<Record[]> records;
+    std::atomic<size_t> record_count = 0;
+    std::unique_ptr<std::atomic<int32_t>[]> buckets; // The first record in each bucket (-1 if empty).
+    TrackedMemory bucket_memory; // The records are counted in the memory of the caches as they are used.
+
+    // Returns the first of the 2x2x2 grid cells that may contain records usable at the given position.
+    glm::ivec3 get_first_neighbor_cell(const glm::vec3& position) const;
+    // Returns the bucket of a grid cell.
+    size_t get_bucket(glm::ivec3 cell) const;
+    // Returns the interpolation weight of a record at the given position & normal (0 if it should not be used).
+    float get_weight(const Record& record, const glm::vec3& position, const glm::vec3& normal) const;
+};
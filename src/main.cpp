@@ -1,38 +1,226 @@
 #include <pathtracer.hpp>
 #include <scene_setup.hpp>
+#include <denoiser.hpp>
+#include <scene_file.hpp>
+#include <compiled_scene.hpp>
+#include <convergence.hpp>
+#include <trace.hpp>
+#include <server.hpp>
+#include <memory.hpp>
 
 #include <string>
 #include <iostream>
 #include <chrono>
 #include <algorithm>
+#include <optional>
+#include <filesystem>
+#include <sstream>
+#include <fstream>
+#include <future>
 
 std::string str_to_lower(std::string str) {
     std::transform(str.begin(), str.end(), str.begin(), [](char c) { return std::tolower(c); });
     return str;
 }
 
+// Returns true if the (lowercase) scene name is the path of a scene, compiled scene or model file.
+static bool is_scene_file(const std::string& scene_name) {
+    return scene_name.ends_with(".scene") || scene_name.ends_with(".ptscene") || scene_name.ends_with(".obj") || scene_name.ends_with(".ply");
+}
+
+// Sets up the scene with the given (lowercase) name, loading it from scene_file_path if it is a file.
+// Returns false and sets `error` if the file could not be loaded.
+static bool setup_scene(Scene& scene, const std::string& scene_name, const std::string& scene_file_path, std::string& error) {
+    TraceScope trace("setup scene");
+    // Scene files
+    if(is_scene_file(scene_name)) {
+        auto start = std::chrono::high_resolution_clock::now();
+        bool loaded;
+        if(scene_name.ends_with(".ptscene")) loaded = load_compiled_scene(scene_file_path, scene, error);
+        else if(scene_name.ends_with(".obj") || scene_name.ends_with(".ply")) loaded = setup_model_scene(scene, scene_file_path, error);
+        else loaded = load_scene_file(scene_file_path, scene, error);
+        if(!loaded) return false;
+        std::chrono::duration<double> seconds_duration = std::chrono::high_resolution_clock::now() - start;
+        std::cout << "Scene loaded in " << seconds_duration.count() << " seconds" << std::endl;
+    }
+    // Built-in scenes (the triangle & sphere tests, balls, city and cornell box scenes), generated scenes, or the special scene for any other name
+    else if(!setup_builtin_scene(scene, scene_name) && !setup_generated_scene(scene, scene_name)) setup_special_scene(scene, scene_name);
+    return true;
+}
+
+// Writes the trace of the run (if it was requested) when main returns, whichever command ran.
+struct TraceWriter {
+    std::string path;
+    ~TraceWriter() {
+        if(path.empty()) return;
+        std::string error;
+        if(write_trace(path, error)) std::cout << "Trace saved to " << path << std::endl;
+        else std::cout << "Could not write the trace: " << error << std::endl;
+    }
+};
+
+// Prints the memory report (if it was requested) when main returns, whichever command ran.
+struct MemoryReportPrinter {
+    bool enabled;
+    ~MemoryReportPrinter() {
+        if(enabled) print_memory_report();
+    }
+};
+
+// A render of the batch mode.
+struct BatchJob {
+    std::string scene_name; // In lowercase.
+    std::string scene_file_path; // The scene name in its original case (used if it is a file).
+    std::string output_path;
+    uint32_t sample_count, max_bounces;
+};
+
+// Reads a job list with one job per line: "scene-name [output-path] [samples] [bounces]".
+// The empty lines and the lines starting with # are skipped. The missing fields take the given defaults.
+static bool read_batch_jobs(const std::string& path, uint32_t sample_count, uint32_t max_bounces, std::vector<BatchJob>& jobs, std::string& error) {
+    std::ifstream file(path);
+    if(!file) {
+        error = "could not open " + path;
+        return false;
+    }
+    std::string line;
+    for(int line_number = 1; std::getline(file, line); ++line_number) {
+        std::stringstream stream(line);
+        std::string scene_name;
+        if(!(stream >> scene_name) || scene_name.starts_with("#")) continue;
+        BatchJob job = { str_to_lower(scene_name), scene_name, "", sample_count, max_bounces };
+        int samples = 0, bounces = 0;
+        stream >> job.output_path >> samples >> bounces;
+        if(job.output_path.empty()) job.output_path = job.scene_name + ".png";
+        if(samples < 0 || bounces < 0) {
+            error = path + ":" + std::to_string(line_number) + ": the samples and bounces must be positive";
+            return false;
+        }
+        if(samples > 0) job.sample_count = samples;
+        if(bounces > 0) job.max_bounces = bounces;
+        jobs.push_back(job);
+    }
+    return true;
+}
+
 int main(int argc, char** argv) {
     // Default Configuration (Change them during development to help with debugging)
     std::string scene_name = "cornel-box";
+    std::string scene_file_path = "";
+    std::string export_path = "";
+    std::string trace_path = "";
+    bool print_memory = false;
     std::string output_path = "";
     uint32_t sample_count = 1000, max_bounces = 5;
-    bool no_bvh = false;
+    std::string accelerator_name = "bvh";
+    uint32_t bvh_leaf_size = DEFAULT_BVH_LEAF_SIZE;
+    bool use_denoiser = false;
+    std::string aov_list = "";
+    int resolution_scale = 1;
+    int tile_size = 0;
+    std::string crop_string = "";
+    std::string tile_cache_path = "";
+    MeshStorage mesh_storage = MeshStorage::FULL;
+    ImageSaveOptions save_options;
     std::string debug_mode = "none";
+    ConvergenceSettings convergence_settings;
+
+    // The compile command takes the same arguments as rendering, but writes the compiled scene instead.
+    // The bench command takes a list of built-in scenes instead of a scene, and measures their convergence instead of rendering them.
+    // The batch command takes a job list instead of a scene, and renders all the jobs.
+    // The serve command takes a socket path instead of a scene, and renders the requests sent to it.
+    std::string command = argc > 1 ? str_to_lower(std::string(argv[1])) : "";
+    bool compile_command = command == "compile";
+    bool bench_command = command == "bench";
+    bool batch_command = command == "batch";
+    bool serve_command = command == "serve";
+    std::string batch_path = "";
+    RenderServerSettings server_settings;
+    if(compile_command || bench_command || batch_command || serve_command) {
+        argv++;
+        argc--;
+    }
+    if(bench_command) scene_name = "all";
 
     // Read the configuration from the commandline arguments.
     if(argc > 1) {
         std::string argument = str_to_lower(std::string(argv[1]));
         if(argument == "--help" || argument == "-h") {
             printf("usage: pathtracer scene-name [options]\n");
+            printf("       pathtracer compile scene-name [options]\n");
+            printf("       pathtracer bench scene-list [options]\n");
+            printf("       pathtracer batch job-list [options]\n");
+            printf("       pathtracer serve socket-path [options]\n");
+            printf("\n");
+            printf("the compile command writes the scene (with its BVH unless --accel none is given) to a binary .ptscene file\n");
+            printf("which is memory-mapped and used in place when it is rendered, so it loads instantly (default: scene-name.ptscene)\n");
+            printf("\n");
+            printf("the bench command renders each built-in scene of the list for a fixed time and measures its error against a reference\n");
+            printf("at doubling times, so the rendering options are judged on their quality per second. it prints a summary table\n");
+            printf("and writes the error-vs-time curves to a CSV file (default: convergence.csv)\n");
+            printf("\n");
+            printf("the batch command renders the jobs of a job list back to back in the same process, writing each image in the\n");
+            printf("background while the next one renders. each line of the list is: scene-name [output-path] [samples] [bounces]\n");
+            printf("where the missing fields take the values of the options. empty lines and lines starting with # are skipped\n");
+            printf("\n");
+            printf("the serve command keeps the scenes loaded (with their acceleration structure) and renders the requests sent to\n");
+            printf("a Unix domain socket, one per line (e.g. with: echo 'render city3 output=a.png samples=64 eye=0,4,9' | nc -U socket-path)\n");
+            printf("  render scene-name [output=path] [samples=n] [bounces=n] [eye=x,y,z] [target=x,y,z] [up=x,y,z] [fov=degrees]\n");
+            printf("         [resolution=WxH] [progress=seconds]   (the image is written and reported every progress seconds)\n");
+            printf("  status                                       (lists the resident scenes)\n");
+            printf("  shutdown                                     (stops the server once the renders in flight are done)\n");
             printf("\n");
             printf("positional arguments:\n");
             printf("  scene-name            the name of the scene to render (default: %s)\n", scene_name.c_str());
+            printf("                        or the path of a scene file ending with .scene (see scene_file.hpp for the format)\n");
+            printf("                        or the path of a compiled scene file ending with .ptscene\n");
+            printf("                        or the path of a model file ending with .obj or .ply (binary), shown on a ground plane\n");
+            printf("                        or a generated scene for stress tests: spheres-N, terrain-N or blocks-N with about N primitives\n");
+            printf("                        (e.g. spheres-1e6), generated from a fixed seed so that the same N always gives the same scene\n");
+            printf("  scene-list            a comma separated list of built-in scenes, or all of them (default: all)\n");
+            printf("  job-list              the path of a job list\n");
+            printf("  socket-path           the path of the Unix domain socket of the server\n");
             printf("\n");
             printf("optional arguments:\n");
             printf("  --output-path, -o     the output path of the rendered image (default: scene-name followed by .png)\n");
+            printf("                        the format is picked from the extension: .png, .bmp, .tga, .jpg,\n");
+            printf("                        or .pfm and .exr to store the linear colors without tone mapping\n");
+            printf("  --png-compression     the PNG compression level from 0 (fastest) to 9 (smallest) (default: %d)\n", save_options.png_compression_level);
+            printf("  --resolution-scale    multiply the resolution of the scene's camera by this factor (default: %d)\n", resolution_scale);
+            printf("  --tile-size           render in square tiles of this size straight into the output file, which must be .pfm or .exr\n");
+            printf("                        only the tiles being rendered are kept in memory, so it can render very large images\n");
+            printf("                        AOVs and denoising are not available in this mode (default: disabled)\n");
+            printf("  --crop                only render the pixels from x0,y0 (included) to x1,y1 (excluded), counted from the top left\n");
+            printf("                        of the output image, the other pixels are left black (default: disabled)\n");
+            printf("  --tile-cache          keep the rendered tiles in this directory and only render again the tiles of a view whose scene\n");
+            printf("                        changed or which need more samples, with --crop only the tiles in the crop are rendered again\n");
+            printf("                        AOVs and denoising are not available in this mode (default: disabled)\n");
             printf("  --samples, -s         the number of samples per pixel (default: %u)\n", sample_count);
             printf("  --bounces, -b         the maximum number of bounces per ray (default: %u)\n", max_bounces);
-            printf("  --no-bvh, -n          disable the use of a bounding volume hierarchy (default: %s)\n", no_bvh ? "true" : "false");
+            printf("  --accel               the acceleration structure used to intersect the shapes (default: %s)\n", accelerator_name.c_str());
+            printf("                        - bvh: a bounding volume hierarchy, which adapts to any scene\n");
+            printf("                        - grid: a uniform grid, the fastest to build and traverse when the shapes are spread evenly\n");
+            printf("                        - grid2: a two-level grid, which refines the crowded cells of a coarse grid\n");
+            printf("                        - none: test every shape\n");
+            printf("  --no-bvh, -n          the same as --accel none\n");
+            printf("  --leaf-size           the maximum number of shapes in the leaves of the BVH (default: %u)\n", bvh_leaf_size);
+            printf("                        the leaves test the bounds of %u shapes at once, so smaller leaves rarely pay off\n", SHAPE_PACKET_WIDTH);
+            printf("  --compact-geometry    store the meshes with 16-bit vertices and a BVH with 8 or 16-bit bounds (8 or 16)\n");
+            printf("                        this uses less memory but intersects more slowly (default: disabled)\n");
+            printf("  --denoise             denoise the rendered image using the first hit albedo, normal & depth (default: %s)\n", use_denoiser ? "true" : "false");
+            printf("  --aov, -a             a comma separated list of AOVs to write next to the output image (default: none)\n");
+            printf("                        each AOV is written to the output path followed by -aov-name (in the same format)\n");
+            printf("                        valid AOVs are: depth, normal, albedo, id\n");
+            printf("  --export-scene        write the scene to this .scene file instead of rendering it\n");
+            printf("  --mem-report          print the peak memory used by the primitives, materials, accelerators, framebuffers and caches,\n");
+            printf("                        and by the whole process, at the end of the run (default: disabled)\n");
+            printf("  --trace               write a timeline of the run (setup, accelerator build, samples, image writes...) on each thread\n");
+            printf("                        to this JSON file, to be opened in chrome://tracing or ui.perfetto.dev (default: disabled)\n");
+            printf("  --time-budget         bench: the render time of each scene in seconds (default: %g)\n", convergence_settings.time_budget);
+            printf("  --checkpoints         bench: the number of times the error is measured, doubling up to the time budget (default: %d)\n", convergence_settings.checkpoint_count);
+            printf("  --reference-dir       bench: the directory of the references, named scene-name.pfm or scene-name.png (default: %s)\n", convergence_settings.reference_directory.c_str());
+            printf("  --reference-samples   bench: render the missing references with this many samples and save them as .pfm (default: disabled)\n");
+            printf("  --memory-cap          serve: unload the least recently used scenes above this many megabytes (default: %zu)\n", server_settings.memory_cap >> 20);
             printf("  --debug-mode, -d      the debug mode to use (default: %s)\n", debug_mode.c_str());
             printf("                        valid debug modes are:\n");
             printf("                        - distance\n");
@@ -40,7 +228,11 @@ int main(int argc, char** argv) {
             return 0;
         }
         scene_name = argument;
-        output_path = scene_name + ".png";
+        // Scene files keep the original case of their path.
+        if(is_scene_file(scene_name)) scene_file_path = std::string(argv[1]);
+        if(batch_command) batch_path = std::string(argv[1]);
+        if(serve_command) server_settings.socket_path = std::string(argv[1]);
+        output_path = bench_command ? "convergence.csv" : scene_name + (compile_command ? ".ptscene" : ".png");
         for(int i = 2; i < argc; i++) {
             std::string argument = str_to_lower(std::string(argv[i]));
             if(i + 1 < argc) {
@@ -52,55 +244,275 @@ int main(int argc, char** argv) {
                     if(value != 0) max_bounces = value;
                 } else if(argument == "--output" || argument == "-o") {
                     output_path = std::string(argv[i + 1]);
+                } else if(argument == "--png-compression") {
+                    save_options.png_compression_level = std::clamp(std::atoi(argv[i + 1]), 0, 9);
+                } else if(argument == "--resolution-scale") {
+                    resolution_scale = std::max(1, std::atoi(argv[i + 1]));
+                } else if(argument == "--tile-size") {
+                    tile_size = std::max(0, std::atoi(argv[i + 1]));
+                } else if(argument == "--crop") {
+                    crop_string = std::string(argv[i + 1]);
+                } else if(argument == "--tile-cache") {
+                    tile_cache_path = std::string(argv[i + 1]);
+                } else if(argument == "--compact-geometry") {
+                    int bits = std::atoi(argv[i + 1]);
+                    mesh_storage = bits == 8 ? MeshStorage::COMPACT8 : (bits == 16 ? MeshStorage::COMPACT16 : MeshStorage::FULL);
+                } else if(argument == "--accel") {
+                    accelerator_name = str_to_lower(std::string(argv[i + 1]));
+                } else if(argument == "--leaf-size") {
+                    bvh_leaf_size = std::max(1, std::atoi(argv[i + 1]));
+                } else if(argument == "--aov" || argument == "-a") {
+                    aov_list = str_to_lower(std::string(argv[i + 1]));
+                } else if(argument == "--export-scene") {
+                    export_path = std::string(argv[i + 1]);
+                } else if(argument == "--memory-cap") {
+                    server_settings.memory_cap = size_t(std::max(1, std::atoi(argv[i + 1]))) << 20;
+                } else if(argument == "--trace") {
+                    trace_path = std::string(argv[i + 1]);
+                } else if(argument == "--time-budget") {
+                    double value = std::atof(argv[i + 1]);
+                    if(value > 0.0) convergence_settings.time_budget = value;
+                } else if(argument == "--checkpoints") {
+                    convergence_settings.checkpoint_count = std::max(1, std::atoi(argv[i + 1]));
+                } else if(argument == "--reference-dir") {
+                    convergence_settings.reference_directory = std::string(argv[i + 1]);
+                } else if(argument == "--reference-samples") {
+                    convergence_settings.reference_samples = std::max(0, std::atoi(argv[i + 1]));
                 } else if(argument == "--debug" || argument == "-d") {
                     debug_mode = str_to_lower(std::string(argv[i + 1]));
                 }
             }
-            if(argument == "--nobvh" || argument == "-n") {
-                no_bvh = true;
+            if(argument == "--nobvh" || argument == "--no-bvh" || argument == "-n") {
+                accelerator_name = "none";
+            } else if(argument == "--denoise") {
+                use_denoiser = true;
+            } else if(argument == "--mem-report") {
+                print_memory = true;
+            }
+        }
+    }
+
+    MemoryReportPrinter memory_report_printer = { print_memory };
+    TraceWriter trace_writer = { trace_path };
+    if(!trace_path.empty()) start_tracing();
+
+    AcceleratorType accelerator_type;
+    if(!parse_accelerator_type(accelerator_name, accelerator_type)) {
+        std::cout << "Invalid accelerator: " << accelerator_name << std::endl;
+        return 1;
+    }
+
+    std::vector<AOV> aov_outputs;
+    if(!parse_aov_list(aov_list, aov_outputs)) {
+        std::cout << "Invalid AOV list: " << aov_list << " (the valid AOVs are depth, normal, albedo and id)" << std::endl;
+        return 1;
+    }
+
+    if(bench_command) {
+        // The convergence is measured on plain renders of whole images, so the options of the other render modes are rejected instead of being ignored.
+        if(!aov_outputs.empty() || !crop_string.empty() || tile_size > 0 || !tile_cache_path.empty() || debug_mode != "none") {
+            std::cout << "AOVs, cropping, tiled rendering, the tile cache and the debug modes are not available with the bench command" << std::endl;
+            return 1;
+        }
+        if(output_path.empty()) output_path = "convergence.csv";
+        std::vector<std::string> bench_scene_names;
+        if(scene_name == "all") {
+            bench_scene_names = get_builtin_scene_names();
+        } else {
+            std::stringstream stream(scene_name);
+            std::string name;
+            while(std::getline(stream, name, ',')) if(!name.empty()) bench_scene_names.push_back(name);
+        }
+        convergence_settings.max_bounces = max_bounces;
+        convergence_settings.use_denoiser = use_denoiser;
+
+        std::vector<ConvergenceCurve> curves;
+        for(const std::string& name: bench_scene_names) {
+            Scene scene;
+            scene.set_accelerator_type(accelerator_type);
+            scene.set_bvh_leaf_size(bvh_leaf_size);
+            if(!setup_builtin_scene(scene, name)) {
+                std::cout << "Unknown built-in scene: " << name << std::endl;
+                return 1;
+            }
+            std::cout << "Measuring the convergence of scene: " << name << std::endl;
+            ConvergenceCurve curve;
+            std::string error;
+            if(!measure_convergence(scene, name, convergence_settings, curve, error)) {
+                std::cout << "Skipping " << name << ": " << error << std::endl;
+                continue;
             }
+            curves.push_back(std::move(curve));
+        }
+        print_convergence_summary(curves);
+        if(!save_convergence_curves(output_path, curves)) {
+            std::cout << "Could not write " << output_path << std::endl;
+            return 1;
+        }
+        std::cout << "Error-vs-time curves saved to " << output_path << std::endl;
+        return 0;
+    }
+
+    if(serve_command) {
+        server_settings.sample_count = sample_count;
+        server_settings.max_bounces = max_bounces;
+        server_settings.load_scene = [&](const std::string& name, Scene& scene, std::string& error) {
+            std::string scene_name = str_to_lower(name);
+            scene.set_accelerator_type(accelerator_type);
+            scene.set_bvh_leaf_size(bvh_leaf_size);
+            scene.set_mesh_storage(mesh_storage);
+            if(!setup_scene(scene, scene_name, name, error)) return false;
+            if(resolution_scale > 1) scene.get_camera().set_viewport_size(scene.get_camera().get_viewport_size() * resolution_scale);
+            return true;
+        };
+        std::string error;
+        if(!run_render_server(server_settings, error)) {
+            std::cout << "Render server error: " << error << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if(batch_command) {
+        // The jobs are plain renders of whole images, so the options of the other render modes are rejected instead of being ignored.
+        if(!aov_outputs.empty() || !crop_string.empty() || tile_size > 0 || !tile_cache_path.empty() || debug_mode != "none") {
+            std::cout << "AOVs, cropping, tiled rendering, the tile cache and the debug modes are not available with the batch command" << std::endl;
+            return 1;
+        }
+        std::vector<BatchJob> jobs;
+        std::string error;
+        if(batch_path.empty() || !read_batch_jobs(batch_path, sample_count, max_bounces, jobs, error)) {
+            std::cout << "Could not read the job list: " << (batch_path.empty() ? "no job list given" : error) << std::endl;
+            return 1;
+        }
+        // While a job renders, the image of the previous job is encoded and written by a background thread.
+        // Waiting for it before handing over the next image keeps a single image in flight.
+        struct PendingWrite {
+            std::string path;
+            std::future<bool> written;
+        };
+        std::optional<PendingWrite> pending_write;
+        int failed_jobs = 0;
+        auto finish_pending_write = [&]() {
+            if(!pending_write) return;
+            if(pending_write->written.get()) {
+                std::cout << "Result saved to " << pending_write->path << std::endl;
+            } else {
+                std::cout << "Could not write " << pending_write->path << std::endl;
+                failed_jobs++;
+            }
+            pending_write.reset();
+        };
+
+        auto batch_start = std::chrono::high_resolution_clock::now();
+        for(const BatchJob& job: jobs) {
+            std::cout << "Rendering scene: " << job.scene_name << " (" << job.sample_count << " samples, " << job.max_bounces << " bounces)" << std::endl;
+            Scene scene;
+            scene.set_accelerator_type(accelerator_type);
+            scene.set_bvh_leaf_size(bvh_leaf_size);
+            scene.set_mesh_storage(mesh_storage);
+            if(!setup_scene(scene, job.scene_name, job.scene_file_path, error)) {
+                std::cout << "Could not load the scene: " << error << std::endl;
+                failed_jobs++;
+                continue;
+            }
+            if(resolution_scale > 1) scene.get_camera().set_viewport_size(scene.get_camera().get_viewport_size() * resolution_scale);
+
+            std::optional<AOVBuffers> aovs;
+            if(use_denoiser) {
+                glm::ivec2 viewport_size = scene.get_camera().get_viewport_size();
+                aovs.emplace(viewport_size.x, viewport_size.y);
+            }
+            PathTracerOptions options;
+            options.aovs = aovs ? &*aovs : nullptr;
+            auto start = std::chrono::high_resolution_clock::now();
+            Image result = path_trace(scene, job.sample_count, job.max_bounces, options);
+            if(aovs) denoise(result, *aovs);
+            std::chrono::duration<double> seconds_duration = std::chrono::high_resolution_clock::now() - start;
+            std::cout << "Render time: " << seconds_duration.count() << " seconds" << std::endl;
+
+            finish_pending_write();
+            pending_write = PendingWrite{ job.output_path, std::async(std::launch::async, [image = std::move(result), path = job.output_path, save_options]() {
+                return image.save(path, save_options);
+            }) };
         }
+        finish_pending_write();
+        std::chrono::duration<double> seconds_duration = std::chrono::high_resolution_clock::now() - batch_start;
+        std::cout << "Rendered " << jobs.size() - failed_jobs << "/" << jobs.size() << " jobs in " << seconds_duration.count() << " seconds" << std::endl;
+        return failed_jobs == 0 ? 0 : 1;
     }
 
     // Create and setup the scene
     std::cout << "Setting up scene: " << scene_name << std::endl;
     Scene scene;
-    scene.set_use_bvh(!no_bvh);
-
-    // Triangle Tests
-    if(scene_name == "tri_test0.0") setup_triangle_test_scene(scene, 4, 4, 0);
-    else if(scene_name == "tri_test0.1") setup_triangle_test_scene(scene, 128, 128, 0);
-    else if(scene_name == "tri_test1.0") setup_triangle_test_scene(scene, 4, 4, 1);
-    else if(scene_name == "tri_test1.1") setup_triangle_test_scene(scene, 128, 128, 1);
-    else if(scene_name == "tri_test2.0") setup_triangle_test_scene(scene, 4, 4, 2);
-    else if(scene_name == "tri_test2.1") setup_triangle_test_scene(scene, 128, 128, 2);
-    else if(scene_name == "tri_test3.0") setup_triangle_test_scene(scene, 4, 4, 3);
-    else if(scene_name == "tri_test3.1") setup_triangle_test_scene(scene, 128, 128, 3);
-    // Sphere Tests
-    else if(scene_name == "sph_test0.0") setup_sphere_test_scene(scene, 4, 4, 0);
-    else if(scene_name == "sph_test0.1") setup_sphere_test_scene(scene, 128, 128, 0);
-    else if(scene_name == "sph_test1.0") setup_sphere_test_scene(scene, 4, 4, 1);
-    else if(scene_name == "sph_test1.1") setup_sphere_test_scene(scene, 128, 128, 1);
-    else if(scene_name == "sph_test2.0") setup_sphere_test_scene(scene, 4, 4, 2);
-    else if(scene_name == "sph_test2.1") setup_sphere_test_scene(scene, 128, 128, 2);
-    else if(scene_name == "sph_test3.0") setup_sphere_test_scene(scene, 4, 4, 3);
-    else if(scene_name == "sph_test3.1") setup_sphere_test_scene(scene, 128, 128, 3);
-    // Balls scenes
-    else if(scene_name == "balls0") setup_balls_scene(scene, 0);
-    else if(scene_name == "balls1") setup_balls_scene(scene, 1);
-    else if(scene_name == "balls2") setup_balls_scene(scene, 2);
-    // City scenes
-    else if(scene_name == "city0") setup_city_scene(scene, 0);
-    else if(scene_name == "city1") setup_city_scene(scene, 1);
-    else if(scene_name == "city2") setup_city_scene(scene, 2);
-    else if(scene_name == "city3") setup_city_scene(scene, 3);
-    // Cornell Box scenes
-    else if(scene_name == "cornell_box0") setup_cornell_box_scene(scene, 0);
-    else if(scene_name == "cornell_box1") setup_cornell_box_scene(scene, 1);
-    else if(scene_name == "cornell_box2") setup_cornell_box_scene(scene, 2);
-    else if(scene_name == "cornell_box3") setup_cornell_box_scene(scene, 3);
-    // Special scene
-    else setup_special_scene(scene, scene_name);
+    scene.set_accelerator_type(accelerator_type);
+    scene.set_bvh_leaf_size(bvh_leaf_size);
+    scene.set_mesh_storage(mesh_storage);
+    std::string error;
+    if(!setup_scene(scene, scene_name, scene_file_path, error)) {
+        std::cout << "Could not load the scene: " << error << std::endl;
+        return 1;
+    }
+
+    // Report the memory used by the meshes, which hold most of the geometry of large scenes.
+    size_t mesh_triangle_count = 0, mesh_memory_size = 0;
+    for(const Shape* shape: scene.get_shapes()) {
+        if(auto mesh = dynamic_cast<const TriangleMesh*>(shape)) {
+            mesh_triangle_count += mesh->get_triangle_count();
+            mesh_memory_size += mesh->get_memory_size();
+        }
+    }
+    if(mesh_triangle_count > 0) {
+        std::cout << "Meshes: " << mesh_triangle_count << " triangles in " << mesh_memory_size / 1048576.0 << " MB ("
+            << double(mesh_memory_size) / mesh_triangle_count << " bytes per triangle)" << std::endl;
+    }
+
+    if(compile_command) {
+        if(!compile_scene(scene, output_path)) {
+            std::cout << "Could not compile the scene to " << output_path << std::endl;
+            return 1;
+        }
+        std::cout << "Compiled scene saved to " << output_path << std::endl;
+        return 0;
+    }
+
+    if(!export_path.empty()) {
+        if(!save_scene_file(export_path, scene)) {
+            std::cout << "Could not write " << export_path << std::endl;
+            return 1;
+        }
+        std::cout << "Scene exported to " << export_path << std::endl;
+        return 0;
+    }
+
+    if(resolution_scale > 1) scene.get_camera().set_viewport_size(scene.get_camera().get_viewport_size() * resolution_scale);
+
+    // The crop is given from the top left of the image, whose rows are numbered from the bottom.
+    PixelRegion crop;
+    if(!crop_string.empty()) {
+        glm::ivec2 viewport_size = scene.get_camera().get_viewport_size();
+        int x0, y0, x1, y1;
+        if(sscanf(crop_string.c_str(), "%d,%d,%d,%d", &x0, &y0, &x1, &y1) != 4) {
+            std::cout << "Invalid crop: " << crop_string << " (expected x0,y0,x1,y1)" << std::endl;
+            return 1;
+        }
+        crop.min = glm::clamp(glm::ivec2(x0, viewport_size.y - y1), glm::ivec2(0), viewport_size);
+        crop.max = glm::clamp(glm::ivec2(x1, viewport_size.y - y0), glm::ivec2(0), viewport_size);
+        if(crop.is_empty()) {
+            std::cout << "The crop " << crop_string << " does not cover any pixel of the " << viewport_size.x << "x" << viewport_size.y << " image" << std::endl;
+            return 1;
+        }
+        if(tile_size > 0) {
+            std::cout << "Cropping is not available with --tile-size" << std::endl;
+            return 1;
+        }
+    }
+
+    // The debug views always draw the whole image with a single ray per pixel.
+    if((debug_mode == "distance" || debug_mode == "normal") && (!crop_string.empty() || tile_size > 0 || !tile_cache_path.empty())) {
+        std::cout << "Cropping, tiled rendering and the tile cache are not available with the debug modes" << std::endl;
+        return 1;
+    }
 
     if(debug_mode == "distance") {
 
@@ -109,7 +521,10 @@ int main(int argc, char** argv) {
         Image result = debug_draw_hit_distance(scene);
         // Save the rendered scene
         if(output_path.empty()) output_path = scene_name + "-distance-debug.png";
-        result.save(output_path);
+        if(!result.save(output_path, save_options)) {
+            std::cout << "Could not write " << output_path << std::endl;
+            return 1;
+        }
         std::cout << "Result saved to " << output_path << std::endl;
 
     } else if(debug_mode == "normal") {
@@ -119,24 +534,115 @@ int main(int argc, char** argv) {
         Image result = debug_draw_hit_normal(scene);
         // Save the rendered scene
         if(output_path.empty()) output_path = scene_name + "-normal-debug.png";
-        result.save(output_path);
+        if(!result.save(output_path, save_options)) {
+            std::cout << "Could not write " << output_path << std::endl;
+            return 1;
+        }
+        std::cout << "Result saved to " << output_path << std::endl;
+
+    } else if(debug_mode == "none" && tile_size > 0) {
+
+        // Render the scene tile by tile straight into the output file
+        if(use_denoiser || !aov_outputs.empty()) {
+            std::cout << "Denoising and AOVs are not available with --tile-size" << std::endl;
+            return 1;
+        }
+        if(!tile_cache_path.empty()) {
+            std::cout << "The tile cache is not available with --tile-size" << std::endl;
+            return 1;
+        }
+        glm::ivec2 viewport_size = scene.get_camera().get_viewport_size();
+        TiledFramebuffer framebuffer(output_path, viewport_size.x, viewport_size.y, tile_size);
+        if(!framebuffer.is_open()) {
+            std::cout << "Could not create " << output_path << " (tiled rendering needs a .pfm or .exr output path)" << std::endl;
+            return 1;
+        }
+        std::cout << "Rendering scene: " << scene_name << " (" << viewport_size.x << "x" << viewport_size.y << " in " << framebuffer.get_tile_count() << " tiles)" << std::endl;
+        auto start = std::chrono::high_resolution_clock::now();
+        path_trace_tiled(scene, sample_count, max_bounces, framebuffer);
+        framebuffer.close();
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> seconds_duration = end - start;
+        std::cout << "Total Render time: " << seconds_duration.count() << " seconds" << std::endl;
+        std::cout << "Result saved to " << output_path << std::endl;
+
+    } else if(debug_mode == "none" && !tile_cache_path.empty()) {
+
+        // Render the tiles which are missing from the tile cache (or out of date) and merge them with the cached tiles
+        if(use_denoiser || !aov_outputs.empty()) {
+            std::cout << "Denoising and AOVs are not available with --tile-cache" << std::endl;
+            return 1;
+        }
+        TileCache tile_cache;
+        // The irradiance cache is not offered on the commandline, so the views are always rendered without it.
+        uint64_t view_hash = compute_view_hash(scene.get_camera(), max_bounces, -1);
+        if(!tile_cache.open(tile_cache_path, view_hash, compute_scene_hash(scene), scene.get_camera().get_viewport_size(), error)) {
+            std::cout << "Could not open the tile cache: " << error << std::endl;
+            return 1;
+        }
+        std::cout << "Rendering scene: " << scene_name << " (" << tile_cache.get_tile_count() << " tiles cached in " << tile_cache_path << ")" << std::endl;
+        PathTracerOptions options;
+        options.crop = crop;
+        auto start = std::chrono::high_resolution_clock::now();
+        Image result = path_trace_cached(scene, sample_count, max_bounces, tile_cache, options);
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> seconds_duration = end - start;
+        std::cout << "Total Render time: " << seconds_duration.count() << " seconds" << std::endl;
+        if(output_path.empty()) output_path = scene_name + ".png";
+        if(!result.save(output_path, save_options)) {
+            std::cout << "Could not write " << output_path << std::endl;
+            return 1;
+        }
         std::cout << "Result saved to " << output_path << std::endl;
 
     } else if(debug_mode == "none") {
 
         // Render the scene and track the elapsed time
         std::cout << "Rendering scene: " << scene_name << std::endl;
+        std::optional<AOVBuffers> aovs;
+        if(use_denoiser || !aov_outputs.empty()) {
+            glm::ivec2 viewport_size = scene.get_camera().get_viewport_size();
+            aovs.emplace(viewport_size.x, viewport_size.y);
+        }
+        PathTracerOptions options;
+        options.aovs = aovs ? &*aovs : nullptr;
+        options.crop = crop;
         auto start = std::chrono::high_resolution_clock::now();
-        Image result = path_trace(scene, sample_count, max_bounces);
+        Image result = path_trace(scene, sample_count, max_bounces, options);
         auto end = std::chrono::high_resolution_clock::now();
         std::chrono::duration<double> seconds_duration = end - start;
         std::cout << "Total Render time: " << seconds_duration.count() << " seconds" << std::endl;
 
+        // Denoise the rendered scene
+        if(use_denoiser) {
+            start = std::chrono::high_resolution_clock::now();
+            denoise(result, *aovs);
+            end = std::chrono::high_resolution_clock::now();
+            seconds_duration = end - start;
+            std::cout << "Denoising time: " << seconds_duration.count() << " seconds" << std::endl;
+        }
+
         // Save the rendered scene
         if(output_path.empty()) output_path = scene_name + ".png";
-        result.save(output_path);
+        if(!result.save(output_path, save_options)) {
+            std::cout << "Could not write " << output_path << std::endl;
+            return 1;
+        }
         std::cout << "Result saved to " << output_path << std::endl;
 
+        // Save the requested AOVs next to the rendered scene
+        std::string output_stem = std::filesystem::path(output_path).replace_extension().string();
+        std::string output_extension = std::filesystem::path(output_path).extension().string();
+        if(output_extension.empty()) output_extension = ".png";
+        for(AOV aov: aov_outputs) {
+            std::string aov_path = output_stem + "-" + get_aov_name(aov) + output_extension;
+            if(!make_aov_image(*aovs, aov, max_bounces).save(aov_path, save_options)) {
+                std::cout << "Could not write " << aov_path << std::endl;
+                return 1;
+            }
+            std::cout << "AOV " << get_aov_name(aov) << " saved to " << aov_path << std::endl;
+        }
+
     } else {
 
         std::cout << "Invalid debug mode: " << debug_mode << std::endl;
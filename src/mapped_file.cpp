@@ -0,0 +1,152 @@
+#include "mapped_file.hpp"
+
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if(this != &other) {
+        close();
+        std::swap(mapping, other.mapping);
+        std::swap(mapped_size, other.mapped_size);
+#ifdef _WIN32
+        std::swap(file_handle, other.file_handle);
+        std::swap(mapping_handle, other.mapping_handle);
+#else
+        std::swap(file_descriptor, other.file_descriptor);
+#endif
+    }
+    return *this;
+}
+
+#ifdef _WIN32
+
+// Maps the whole file given the open file handle.
+static bool map_file(HANDLE file, size_t size, bool writable, void*& mapping_handle, void*& mapping) {
+    mapping_handle = CreateFileMappingA(file, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY,
+        static_cast<DWORD>(static_cast<uint64_t>(size) >> 32), static_cast<DWORD>(size & 0xFFFFFFFFu), nullptr);
+    if(mapping_handle == nullptr) return false;
+    mapping = MapViewOfFile(mapping_handle, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size);
+    return mapping != nullptr;
+}
+
+bool MappedFile::create(const std::string& path, size_t size) {
+    close();
+    if(size == 0) return false;
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE) return false;
+    file_handle = file;
+    if(!map_file(file, size, true, mapping_handle, mapping)) {
+        close();
+        return false;
+    }
+    mapped_size = size;
+    return true;
+}
+
+bool MappedFile::open_read(const std::string& path) {
+    close();
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE) return false;
+    file_handle = file;
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(file, &size) || size.QuadPart == 0 || !map_file(file, static_cast<size_t>(size.QuadPart), false, mapping_handle, mapping)) {
+        close();
+        return false;
+    }
+    mapped_size = static_cast<size_t>(size.QuadPart);
+    return true;
+}
+
+void MappedFile::close() {
+    if(mapping) UnmapViewOfFile(mapping);
+    if(mapping_handle) CloseHandle(mapping_handle);
+    if(file_handle) CloseHandle(file_handle);
+    mapping = mapping_handle = file_handle = nullptr;
+    mapped_size = 0;
+}
+
+void MappedFile::flush(size_t offset, size_t length, bool release) {
+    if(!mapping || length == 0) return;
+    FlushViewOfFile(data() + offset, length);
+    // Unlocking pages that are not locked removes them from the working set.
+    if(release) VirtualUnlock(data() + offset, length);
+}
+
+#else
+
+bool MappedFile::create(const std::string& path, size_t size) {
+    close();
+    if(size == 0) return false;
+    file_descriptor = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(file_descriptor < 0) return false;
+    if(ftruncate(file_descriptor, static_cast<off_t>(size)) != 0) {
+        close();
+        return false;
+    }
+    void* result = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file_descriptor, 0);
+    if(result == MAP_FAILED) {
+        close();
+        return false;
+    }
+    mapping = result;
+    mapped_size = size;
+    return true;
+}
+
+bool MappedFile::open_read(const std::string& path) {
+    close();
+    file_descriptor = ::open(path.c_str(), O_RDONLY);
+    if(file_descriptor < 0) return false;
+    struct stat status;
+    if(fstat(file_descriptor, &status) != 0 || status.st_size == 0) {
+        close();
+        return false;
+    }
+    size_t size = static_cast<size_t>(status.st_size);
+    void* result = mmap(nullptr, size, PROT_READ, MAP_SHARED, file_descriptor, 0);
+    if(result == MAP_FAILED) {
+        close();
+        return false;
+    }
+    mapping = result;
+    mapped_size = size;
+    return true;
+}
+
+void MappedFile::close() {
+    if(mapping) munmap(mapping, mapped_size);
+    if(file_descriptor >= 0) ::close(file_descriptor);
+    mapping = nullptr;
+    mapped_size = 0;
+    file_descriptor = -1;
+}
+
+void MappedFile::flush(size_t offset, size_t length, bool release) {
+    if(!mapping || length == 0) return;
+    // The range must start at a page boundary.
+    size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t begin = offset / page_size * page_size;
+    length += offset - begin;
+    msync(data() + begin, length, MS_SYNC);
+    if(release) madvise(data() + begin, length, MADV_DONTNEED);
+}
+
+#endif
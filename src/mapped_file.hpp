@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+// A file mapped into memory, so that its content can be read and written in place without copying it.
+// The operating system pages the content in and out on demand, so files larger than the memory can be mapped.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    // Creates (or overwrites) a file with the given size and maps it for reading and writing. Returns true on success.
+    bool create(const std::string& path, size_t size);
+    // Maps an existing file for reading only. Returns true on success.
+    bool open_read(const std::string& path);
+    // Unmaps the file (writing back any modification) and closes it.
+    void close();
+
+    // Getters
+    inline bool is_open() const { return mapping != nullptr; }
+    inline char* data() { return static_cast<char*>(mapping); }
+    inline const char* data() const { return static_cast<const char*>(mapping); }
+    inline size_t size() const { return mapped_size; }
+
+    // Writes the modified pages overlapping the given range back to the file.
+    // If `release` is true, the pages are also released from the process memory (they will be read again if accessed).
+    void flush(size_t offset, size_t length, bool release);
+
+private:
+    void* mapping = nullptr;
+    size_t mapped_size = 0;
+#ifdef _WIN32
+    void* file_handle = nullptr;
+    void* mapping_handle = nullptr;
+#else
+    int file_descriptor = -1;
+#endif
+};
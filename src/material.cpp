@@ -7,7 +7,6 @@ static float sample_uniform_01() {
     return static_cast<float>(rand()) / RAND_MAX;
 }
 
-// Sample a random point on a unit sphere's surface.
 glm::vec3 sample_sphere_surface() {
     float z = sample_uniform_01() * 2.0f - 1.0f;
     float theta = sample_uniform_01() * glm::pi<float>() * 2.0f;
@@ -18,34 +17,79 @@ glm::vec3 sample_sphere_surface() {
     return glm::vec3(x, y, z);
 }
 
-MaterialSample EmissiveMaterial::sample(const glm::vec3& incoming_ray_direction, const glm::vec3& hit_point, const glm::vec3& hit_normal) const {
-    return {
-        .outgoing_ray_direction = incoming_ray_direction, // It doesn't matter since path tracing should stop at this point (because factor will become 0).
-        .factor = Colors::BLACK, // This object doesn't relfect light from anywhere, so its factor is zero.
-        .emission = light // This object emits it's light equally in all directions.
-    };
-}
-
-MaterialSample LambertMaterial::sample(const glm::vec3& incoming_ray_direction, const glm::vec3& hit_point, const glm::vec3& hit_normal) const {
-    //TODO: Implement this function
-    // Hints:
-    // - Refer to the slides to see how we can sample a new ray direction.
-    // - Before you normalize a direction vector, Make sure that it was not zero.
-    return {
-        .outgoing_ray_direction = incoming_ray_direction,
-        .factor = Colors::BLACK,
-        .emission = Colors::BLACK
-    };
-}
-
-MaterialSample SmoothMetalMaterial::sample(const glm::vec3& incoming_ray_direction, const glm::vec3& hit_point, const glm::vec3& hit_normal) const {
-    //TODO: Implement this function
-    // Hints:
-    // - If you sample rays here as we learned in the lecture, you will get a very noisy result on smooth metallic surface.
-    //   Instead, just focus on reflecting the ray by the surface normal, and compute the factor using Schlick's approximation of Fresnel reflection.
-    return {
-        .outgoing_ray_direction = incoming_ray_direction,
-        .factor = Colors::BLACK,
-        .emission = Colors::BLACK
-    };
+Color EmissiveMaterial::get_albedo() const {
+    // Emitters don't reflect light, so we use their normalized emission color to distinguish them from their surroundings.
+    float max_channel = glm::max(glm::max(light.r, light.g), light.b);
+    return max_channel > 0.0f ? light / max_channel : Colors::BLACK;
+}
+
+MaterialRecord EmissiveMaterial::get_record() const {
+    return { light, MaterialType::EMISSIVE };
+}
+
+Color LambertMaterial::get_albedo() const {
+    return albedo;
+}
+
+MaterialRecord LambertMaterial::get_record() const {
+    return { albedo, MaterialType::LAMBERT };
+}
+
+Color SmoothMetalMaterial::get_albedo() const {
+    return specular;
+}
+
+MaterialRecord SmoothMetalMaterial::get_record() const {
+    return { specular, MaterialType::SMOOTH_METAL };
+}
+
+////////////////////
+// Material Table //
+////////////////////
+
+int32_t MaterialTable::add(const Material& material) {
+    records.push_back(material.get_record());
+    return static_cast<int32_t>(records.size() - 1);
+}
+
+int32_t MaterialTable::add(const MaterialRecord& record) {
+    records.push_back(record);
+    return static_cast<int32_t>(records.size() - 1);
+}
+
+Color MaterialTable::get_albedo(int32_t id) const {
+    const MaterialRecord& record = records[id];
+    switch(record.type) {
+    case MaterialType::EMISSIVE: return EmissiveMaterial(record.color).get_albedo();
+    case MaterialType::LAMBERT: return LambertMaterial(record.color).get_albedo();
+    case MaterialType::SMOOTH_METAL: return SmoothMetalMaterial(record.color).get_albedo();
+    }
+    return Colors::BLACK;
+}
+
+// Runs the sampling code of a single material type over the given queries.
+template<typename M>
+static void sample_batch(std::span<const MaterialRecord> records, std::span<const MaterialQuery> queries, std::span<const uint32_t> indices, std::span<MaterialSample> samples) {
+    for(uint32_t index: indices) {
+        const MaterialQuery& query = queries[index];
+        samples[index] = M(records[query.material_id].color).sample(query.incoming_ray_direction, query.hit_point, query.hit_normal);
+    }
+}
+
+void MaterialTable::sample(std::span<const MaterialQuery> queries, std::span<MaterialSample> samples) const {
+    constexpr int TYPE_COUNT = 3;
+    // Group the query indices by material type using a counting sort.
+    uint32_t offsets[TYPE_COUNT + 1] = {};
+    for(const MaterialQuery& query: queries) offsets[static_cast<int>(records[query.material_id].type) + 1]++;
+    for(int type = 0; type < TYPE_COUNT; ++type) offsets[type + 1] += offsets[type];
+    std::vector<uint32_t> indices(queries.size());
+    uint32_t cursors[TYPE_COUNT] = { offsets[0], offsets[1], offsets[2] };
+    for(uint32_t index = 0; index < queries.size(); ++index) {
+        indices[cursors[static_cast<int>(records[queries[index].material_id].type)]++] = index;
+    }
+    // Run each material's sampling code over its group.
+    std::span<const uint32_t> groups(indices);
+    sample_batch<EmissiveMaterial>(records, queries, groups.subspan(offsets[0], offsets[1] - offsets[0]), samples);
+    sample_batch<LambertMaterial>(records, queries, groups.subspan(offsets[1], offsets[2] - offsets[1]), samples);
+    sample_batch<SmoothMetalMaterial>(records, queries, groups.subspan(offsets[2], offsets[3] - offsets[2]), samples);
 }
\ No newline at end of file
@@ -2,6 +2,11 @@
 
 #include <glm.hpp>
 #include <color.hpp>
+#include <memory.hpp>
+
+#include <span>
+#include <vector>
+#include <cstdint>
 
 // This struct will hold a sample from a material to be used by the path tracer.
 struct MaterialSample {
@@ -14,36 +19,155 @@ struct MaterialSample {
     Color emission;
 };
 
+// The type tag of a material stored in a MaterialTable.
+enum class MaterialType : uint32_t {
+    EMISSIVE,
+    LAMBERT,
+    SMOOTH_METAL
+};
+
+// A compact (16 bytes) description of a material which is enough to sample it without a virtual call.
+struct MaterialRecord {
+    Color color; // The parameter of the material (light for emissive, albedo for lambert and specular for smooth metal).
+    MaterialType type;
+};
+
 // Base class for all materials.
 class Material {
 public:
     // Returns a material sample given an incoming ray direction and its hit point & normal on the shape surface. 
     virtual MaterialSample sample(const glm::vec3& incoming_ray_direction, const glm::vec3& hit_point, const glm::vec3& hit_normal) const = 0;
+    // Returns the base color of the material in the range [0,1]. It is used as a guide for post-processing (e.g. denoising).
+    virtual Color get_albedo() const = 0;
+    // Returns the compact description of the material to be stored in a MaterialTable.
+    virtual MaterialRecord get_record() const = 0;
 };
 
 // A simple emissive material that only emits light.
-class EmissiveMaterial : public Material {
+class EmissiveMaterial final : public Material {
 public:
     EmissiveMaterial(Color light) : light(light) {}
     MaterialSample sample(const glm::vec3& incoming_ray_direction, const glm::vec3& hit_point, const glm::vec3& hit_normal) const override;
+    Color get_albedo() const override;
+    MaterialRecord get_record() const override;
 private:
     Color light;
 };
 
 // A simple lambert material that scatters light equally in all directions of the hemisphere.
-class LambertMaterial : public Material {
+class LambertMaterial final : public Material {
 public:
     LambertMaterial(Color albedo) : albedo(albedo) {}
     MaterialSample sample(const glm::vec3& incoming_ray_direction, const glm::vec3& hit_point, const glm::vec3& hit_normal) const override;
+    Color get_albedo() const override;
+    MaterialRecord get_record() const override;
 private:
     Color albedo;
 };
 
 // A simple metallic material with a smooth surface that reflects light in the reflection direction.
-class SmoothMetalMaterial : public Material {
+class SmoothMetalMaterial final : public Material {
 public:
     SmoothMetalMaterial(Color specular) : specular(specular) {}
     MaterialSample sample(const glm::vec3& incoming_ray_direction, const glm::vec3& hit_point, const glm::vec3& hit_normal) const override;
+    Color get_albedo() const override;
+    MaterialRecord get_record() const override;
 private:
     Color specular;
-};
\ No newline at end of file
+};
+
+// Samples a random point on a unit sphere's surface.
+glm::vec3 sample_sphere_surface();
+
+// Creates a material owned by a shared pointer, counting it (with the control block of the pointer) in the memory of the materials.
+template<typename T, typename... Args>
+std::shared_ptr<T> make_material(Args&&... args) {
+    return make_tracked_shared<T, MemoryCategory::MATERIALS>(std::forward<Args>(args)...);
+}
+
+// A query for sampling a batch of materials from a MaterialTable.
+struct MaterialQuery {
+    int32_t material_id; // The index of the material in the table.
+    glm::vec3 incoming_ray_direction, hit_point, hit_normal;
+};
+
+// A flat table of materials that are sampled by switching on their type instead of calling a virtual function.
+// The switch calls the final material classes directly, so the compiler can inline their sampling code.
+class MaterialTable {
+public:
+    // Adds a material to the table and returns its id (its index in the table).
+    int32_t add(const Material& material);
+    int32_t add(const MaterialRecord& record);
+    // Removes all the materials from the table.
+    inline void clear() { records.clear(); }
+    // Getters for the materials
+    inline size_t size() const { return records.size(); }
+    inline const MaterialRecord& operator[](int32_t id) const { return records[id]; }
+    inline std::span<const MaterialRecord> get_records() const { return records; }
+
+    // Returns the albedo of the material with the given id (See Material::get_albedo).
+    Color get_albedo(int32_t id) const;
+
+    // Samples the material with the given id (See Material::sample).
+    MaterialSample sample(int32_t id, const glm::vec3& incoming_ray_direction, const glm::vec3& hit_point, const glm::vec3& hit_normal) const;
+    // Samples a batch of queries and writes the sample of queries[i] to samples[i].
+    // The queries are grouped by material type first, so each material's sampling code runs in a tight loop.
+    void sample(std::span<const MaterialQuery> queries, std::span<MaterialSample> samples) const;
+
+private:
+    TrackedVector<MaterialRecord, MemoryCategory::MATERIALS> records;
+};
+
+///////////////////////
+// Material Sampling //
+///////////////////////
+
+// The sampling code of the final material classes and of the table is defined in this header, so that the path tracer
+// (which samples through Scene::sample_material) can inline it into its bounce loop.
+
+inline MaterialSample EmissiveMaterial::sample(const glm::vec3& incoming_ray_direction, [[maybe_unused]] const glm::vec3& hit_point, [[maybe_unused]] const glm::vec3& hit_normal) const {
+    return {
+        .outgoing_ray_direction = incoming_ray_direction, // It doesn't matter since path tracing should stop at this point (because factor will become 0).
+        .factor = Colors::BLACK, // This object doesn't relfect light from anywhere, so its factor is zero.
+        .emission = light // This object emits it's light equally in all directions.
+    };
+}
+
+inline MaterialSample LambertMaterial::sample(const glm::vec3& incoming_ray_direction, [[maybe_unused]] const glm::vec3& hit_point, [[maybe_unused]] const glm::vec3& hit_normal) const {
+    //TODO: Implement this function
+    // Hints:
+    // - Refer to the slides to see how we can sample a new ray direction.
+    // - Before you normalize a direction vector, Make sure that it was not zero.
+    // - sample_sphere_surface (in material.cpp) returns a random point on the unit sphere.
+    return {
+        .outgoing_ray_direction = incoming_ray_direction,
+        .factor = Colors::BLACK,
+        .emission = Colors::BLACK
+    };
+}
+
+inline MaterialSample SmoothMetalMaterial::sample(const glm::vec3& incoming_ray_direction, [[maybe_unused]] const glm::vec3& hit_point, [[maybe_unused]] const glm::vec3& hit_normal) const {
+    //TODO: Implement this function
+    // Hints:
+    // - If you sample rays here as we learned in the lecture, you will get a very noisy result on smooth metallic surface.
+    //   Instead, just focus on reflecting the ray by the surface normal, and compute the factor using Schlick's approximation of Fresnel reflection.
+    return {
+        .outgoing_ray_direction = incoming_ray_direction,
+        .factor = Colors::BLACK,
+        .emission = Colors::BLACK
+    };
+}
+
+// Samples a material record. Since the material classes are final, the calls are direct and can be inlined.
+inline MaterialSample sample_material_record(const MaterialRecord& record, const glm::vec3& incoming_ray_direction, const glm::vec3& hit_point, const glm::vec3& hit_normal) {
+    switch(record.type) {
+    case MaterialType::EMISSIVE: return EmissiveMaterial(record.color).sample(incoming_ray_direction, hit_point, hit_normal);
+    case MaterialType::LAMBERT: return LambertMaterial(record.color).sample(incoming_ray_direction, hit_point, hit_normal);
+    case MaterialType::SMOOTH_METAL: return SmoothMetalMaterial(record.color).sample(incoming_ray_direction, hit_point, hit_normal);
+    }
+    return { incoming_ray_direction, Colors::BLACK, Colors::BLACK };
+}
+
+inline MaterialSample MaterialTable::sample(int32_t id, const glm::vec3& incoming_ray_direction, const glm::vec3& hit_point, const glm::vec3& hit_normal) const {
+    return sample_material_record(records[id], incoming_ray_direction, hit_point, hit_normal);
+}
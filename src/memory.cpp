@@ -0,0 +1,84 @@
+#include "memory.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <iterator>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+static const char* MEMORY_CATEGORY_NAMES[] = { "primitives", "materials", "accelerators", "framebuffers", "caches" };
+static_assert(std::size(MEMORY_CATEGORY_NAMES) == static_cast<size_t>(MemoryCategory::COUNT));
+
+// The memory of each category followed by the total, with their peaks.
+static std::atomic<int64_t> tracked_memory[static_cast<size_t>(MemoryCategory::COUNT) + 1];
+static std::atomic<int64_t> peak_tracked_memory[static_cast<size_t>(MemoryCategory::COUNT) + 1];
+
+const char* get_memory_category_name(MemoryCategory category) {
+    return MEMORY_CATEGORY_NAMES[static_cast<size_t>(category)];
+}
+
+// Adds to a counter and raises its peak if it went past it.
+static void add_memory(size_t index, int64_t size) {
+    int64_t memory = tracked_memory[index].fetch_add(size, std::memory_order_relaxed) + size;
+    int64_t peak = peak_tracked_memory[index].load(std::memory_order_relaxed);
+    while(memory > peak && !peak_tracked_memory[index].compare_exchange_weak(peak, memory, std::memory_order_relaxed)) {}
+}
+
+void track_memory(MemoryCategory category, int64_t size) {
+    if(size == 0) return;
+    add_memory(static_cast<size_t>(category), size);
+    add_memory(static_cast<size_t>(MemoryCategory::COUNT), size);
+}
+
+size_t get_tracked_memory(MemoryCategory category) {
+    return static_cast<size_t>(tracked_memory[static_cast<size_t>(category)].load());
+}
+
+size_t get_peak_tracked_memory(MemoryCategory category) {
+    return static_cast<size_t>(peak_tracked_memory[static_cast<size_t>(category)].load());
+}
+
+size_t get_peak_tracked_memory() {
+    return static_cast<size_t>(peak_tracked_memory[static_cast<size_t>(MemoryCategory::COUNT)].load());
+}
+
+size_t get_peak_resident_memory() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss); // In bytes on macOS.
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024; // In kilobytes on Linux.
+#endif
+#endif
+}
+
+// Prints a line of the memory report, in the unit which suits the size.
+static void print_memory_line(const char* name, size_t size) {
+    if(size >= 1048576) printf("  %-14s %10.2f MB\n", name, size / 1048576.0);
+    else printf("  %-14s %10.2f KB\n", name, size / 1024.0);
+}
+
+void print_memory_report() {
+    // The peaks of the categories may happen at different times, so the tracked peak is at most their sum.
+    // The process also holds the memory which is not tracked, such as the scratch buffers of the loaders and the builders.
+    printf("Memory report (peak usage):\n");
+    for(size_t index = 0; index < static_cast<size_t>(MemoryCategory::COUNT); ++index) {
+        MemoryCategory category = static_cast<MemoryCategory>(index);
+        print_memory_line(get_memory_category_name(category), get_peak_tracked_memory(category));
+    }
+    print_memory_line("tracked", get_peak_tracked_memory());
+    print_memory_line("process (RSS)", get_peak_resident_memory());
+}
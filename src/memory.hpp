@@ -0,0 +1,89 @@
+#pragma once
+
+#include <new>
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// The subsystems whose memory is accounted, to find out how much memory a render needs and where it goes.
+enum class MemoryCategory {
+    PRIMITIVES, // The shapes and the mesh vertices & indices.
+    MATERIALS, // The material objects (with the control blocks of their shared pointers) and the material table.
+    ACCELERATORS, // The acceleration structures of the scene and the BVHs of the meshes.
+    FRAMEBUFFERS, // The images, the AOVs and the denoiser buffers.
+    CACHES, // The path guide and the irradiance cache.
+    COUNT
+};
+
+// Returns the name of a memory category (as printed in the memory report).
+const char* get_memory_category_name(MemoryCategory category);
+
+// Adds `size` bytes to the memory used by a category (or removes them if `size` is negative).
+void track_memory(MemoryCategory category, int64_t size);
+// Returns the memory used by a category in bytes.
+size_t get_tracked_memory(MemoryCategory category);
+// Returns the highest memory used by a category in bytes.
+size_t get_peak_tracked_memory(MemoryCategory category);
+// Returns the highest memory used by all the categories at once in bytes.
+size_t get_peak_tracked_memory();
+// Returns the peak resident set size of the process in bytes (0 if it is unknown on this platform).
+size_t get_peak_resident_memory();
+// Prints the peak memory of each category and of the process.
+void print_memory_report();
+
+// A standard allocator which counts the memory it allocates in a category.
+template<typename T, MemoryCategory CATEGORY>
+class TrackingAllocator {
+public:
+    using value_type = T;
+    template<typename U>
+    struct rebind { using other = TrackingAllocator<U, CATEGORY>; };
+
+    TrackingAllocator() noexcept = default;
+    template<typename U>
+    TrackingAllocator(const TrackingAllocator<U, CATEGORY>&) noexcept {}
+
+    T* allocate(size_t count) {
+        T* pointer = std::allocator<T>().allocate(count);
+        track_memory(CATEGORY, static_cast<int64_t>(count * sizeof(T)));
+        return pointer;
+    }
+    void deallocate(T* pointer, size_t count) noexcept {
+        track_memory(CATEGORY, -static_cast<int64_t>(count * sizeof(T)));
+        std::allocator<T>().deallocate(pointer, count);
+    }
+
+    template<typename U>
+    bool operator==(const TrackingAllocator<U, CATEGORY>&) const noexcept { return true; }
+};
+
+// A vector whose memory is counted in a category.
+template<typename T, MemoryCategory CATEGORY>
+using TrackedVector = std::vector<T, TrackingAllocator<T, CATEGORY>>;
+
+// Creates an object owned by a shared pointer, counting the object and the control block of the pointer in a category.
+template<typename T, MemoryCategory CATEGORY, typename... Args>
+std::shared_ptr<T> make_tracked_shared(Args&&... args) {
+    return std::allocate_shared<T>(TrackingAllocator<T, CATEGORY>(), std::forward<Args>(args)...);
+}
+
+// A number of bytes counted in a category for as long as the object lives,
+// for the memory which is not allocated through a TrackingAllocator (such as arrays built before their size is known).
+class TrackedMemory {
+public:
+    TrackedMemory() = default;
+    TrackedMemory(MemoryCategory category, size_t size) : category(category), size(size) { track_memory(category, static_cast<int64_t>(size)); }
+    ~TrackedMemory() { track_memory(category, -static_cast<int64_t>(size)); }
+    TrackedMemory(const TrackedMemory& other) : TrackedMemory(other.category, other.size) {}
+    TrackedMemory& operator=(TrackedMemory other) noexcept {
+        std::swap(category, other.category);
+        std::swap(size, other.size);
+        return *this;
+    }
+
+private:
+    MemoryCategory category = MemoryCategory::PRIMITIVES;
+    size_t size = 0;
+};
@@ -0,0 +1,90 @@
+#include "mesh.hpp"
+
+TriangleMesh::TriangleMesh(std::vector<glm::vec3> vertices, std::vector<uint32_t> indices, MeshStorage storage, const std::shared_ptr<Material>& material)
+    : Shape(material), storage(storage), vertices(std::move(vertices)), indices(std::move(indices)) {
+    size_t triangle_count = get_triangle_count();
+    this->indices.resize(3 * triangle_count);
+    bounds = { glm::vec3(0.0f), glm::vec3(0.0f) };
+
+    if(storage != MeshStorage::FULL) {
+        // Quantize the vertices to 16 bits within their bounds. The BVH is then built around the quantized triangles.
+        AABB vertex_bounds = { glm::vec3(0.0f), glm::vec3(0.0f) };
+        if(!this->vertices.empty()) vertex_bounds = { this->vertices[0], this->vertices[0] };
+        for(const glm::vec3& vertex: this->vertices) vertex_bounds = { glm::min(vertex_bounds.vmin, vertex), glm::max(vertex_bounds.vmax, vertex) };
+        vertex_origin = vertex_bounds.vmin;
+        vertex_step = (vertex_bounds.vmax - vertex_bounds.vmin) / 65535.0f;
+        glm::vec3 inverse_step = glm::vec3(1.0f) / glm::max(vertex_step, glm::vec3(std::numeric_limits<float>::min()));
+        compact_vertices.resize(this->vertices.size());
+        for(size_t vertex = 0; vertex < this->vertices.size(); ++vertex) {
+            compact_vertices[vertex] = glm::u16vec3(glm::clamp(glm::round((this->vertices[vertex] - vertex_origin) * inverse_step), 0.0f, 65535.0f));
+        }
+        this->vertices = {};
+    }
+    primitive_memory = TrackedMemory(MemoryCategory::PRIMITIVES, this->vertices.size() * sizeof(glm::vec3) + compact_vertices.size() * sizeof(glm::u16vec3) + this->indices.size() * sizeof(uint32_t));
+    if(triangle_count == 0) return;
+
+    std::vector<AABB> triangle_bounds(triangle_count);
+    for(size_t triangle = 0; triangle < triangle_count; ++triangle) {
+        glm::vec3 v0 = get_vertex(triangle, 0), v1 = get_vertex(triangle, 1), v2 = get_vertex(triangle, 2);
+        triangle_bounds[triangle] = { glm::min(v0, glm::min(v1, v2)), glm::max(v0, glm::max(v1, v2)) };
+    }
+    std::vector<uint32_t> order;
+    build_flat_bvh(triangle_bounds, nodes, order);
+    bounds = { nodes[0].vmin, nodes[0].vmax };
+
+    // Store the triangles in the order of the leaves, so each leaf refers to a contiguous range of triangles.
+    std::vector<uint32_t> sorted_indices(this->indices.size());
+    for(size_t triangle = 0; triangle < triangle_count; ++triangle) {
+        for(int corner = 0; corner < 3; ++corner) sorted_indices[3 * triangle + corner] = this->indices[3 * order[triangle] + corner];
+    }
+    this->indices = std::move(sorted_indices);
+
+    // The compact modes only keep the quantized version of the BVH.
+    if(storage == MeshStorage::COMPACT16) bvh16.build(nodes);
+    if(storage == MeshStorage::COMPACT8) bvh8.build(nodes);
+    if(storage != MeshStorage::FULL) nodes = {};
+    bvh_memory = TrackedMemory(MemoryCategory::ACCELERATORS, nodes.size() * sizeof(FlatBVHNode) + bvh16.get_memory_size() + bvh8.get_memory_size());
+}
+
+template<MeshStorage STORAGE>
+bool TriangleMesh::intersect_triangles(uint32_t first, uint32_t count, const Ray& ray, RayHit& hit) const {
+    auto get_position = [this](uint32_t vertex) {
+        if constexpr(STORAGE == MeshStorage::FULL) return vertices[vertex];
+        else return decode_position(compact_vertices[vertex]);
+    };
+    bool has_hit = false;
+    for(uint32_t triangle = first; triangle < first + count; ++triangle) {
+        const uint32_t* corners = &indices[3 * triangle];
+        RayHit triangle_hit;
+        if(intersect_triangle(get_position(corners[0]), get_position(corners[1]), get_position(corners[2]), ray, triangle_hit)
+            && triangle_hit.distance < hit.distance) {
+            has_hit = true;
+            hit.distance = triangle_hit.distance;
+            hit.normal = triangle_hit.normal;
+        }
+    }
+    return has_hit;
+}
+
+bool TriangleMesh::intersect(const Ray& ray, RayHit& hit) const {
+    hit.distance = std::numeric_limits<float>::max();
+    bool has_hit;
+    switch(storage) {
+        case MeshStorage::COMPACT16:
+            has_hit = bvh16.intersect(ray, hit, [&](uint32_t first, uint32_t count) { return intersect_triangles<MeshStorage::COMPACT16>(first, count, ray, hit); });
+            break;
+        case MeshStorage::COMPACT8:
+            has_hit = bvh8.intersect(ray, hit, [&](uint32_t first, uint32_t count) { return intersect_triangles<MeshStorage::COMPACT8>(first, count, ray, hit); });
+            break;
+        default:
+            has_hit = intersect_flat_bvh(nodes, ray, hit, [&](uint32_t first, uint32_t count) { return intersect_triangles<MeshStorage::FULL>(first, count, ray, hit); });
+            break;
+    }
+    if(has_hit) hit.material = material;
+    return has_hit;
+}
+
+size_t TriangleMesh::get_memory_size() const {
+    return vertices.size() * sizeof(glm::vec3) + compact_vertices.size() * sizeof(glm::u16vec3) + indices.size() * sizeof(uint32_t)
+        + nodes.size() * sizeof(FlatBVHNode) + bvh16.get_memory_size() + bvh8.get_memory_size();
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <span>
+#include <vector>
+#include <cstdint>
+
+#include <shapes.hpp>
+#include <bvh.hpp>
+#include <memory.hpp>
+#include <ext/vector_uint3_sized.hpp>
+
+// How a TriangleMesh stores its geometry. The compact modes trade some intersection speed for memory,
+// so that the largest models fit in memory (and more of them fits in the caches).
+enum class MeshStorage {
+    FULL, // 12 bytes per vertex and 32 bytes per BVH node.
+    COMPACT16, // 6 bytes per vertex (16-bit positions within the mesh bounds) and a BVH with 16-bit child bounds.
+    COMPACT8, // 6 bytes per vertex (16-bit positions within the mesh bounds) and a BVH with 8-bit child bounds.
+};
+
+// An indexed triangle mesh shape. The triangles share their vertices, and the mesh is a single shape for the scene,
+// with its own flat BVH over its triangles (built in the constructor), so large models do not need an object per triangle.
+class TriangleMesh : public Shape {
+public:
+    // Constructs the mesh from its vertices and the vertex indices of its triangles (3 per triangle).
+    // The triangles are reordered to follow the leaves of the BVH.
+    // In the compact modes, the vertices are moved to the nearest 16-bit position within the mesh bounds (by at most 1/131070 of its size).
+    TriangleMesh(std::vector<glm::vec3> vertices, std::vector<uint32_t> indices, MeshStorage storage, const std::shared_ptr<Material>& material);
+    bool intersect(const Ray& ray, RayHit& hit) const override;
+
+    // Getters
+    inline MeshStorage get_storage() const { return storage; }
+    inline size_t get_vertex_count() const { return storage == MeshStorage::FULL ? vertices.size() : compact_vertices.size(); }
+    inline std::span<const uint32_t> get_indices() const { return indices; }
+    inline size_t get_triangle_count() const { return indices.size() / 3; }
+    inline glm::vec3 get_position(uint32_t vertex) const {
+        return storage == MeshStorage::FULL ? vertices[vertex] : decode_position(compact_vertices[vertex]);
+    }
+    inline glm::vec3 get_vertex(size_t triangle, int corner) const { return get_position(indices[3 * triangle + corner]); }
+    // Returns the memory used by the vertices, the indices and the BVH in bytes.
+    size_t get_memory_size() const;
+
+private:
+    MeshStorage storage;
+    std::vector<glm::vec3> vertices; // The vertices in the FULL mode.
+    std::vector<glm::u16vec3> compact_vertices; // The vertices in the compact modes.
+    glm::vec3 vertex_origin = glm::vec3(0.0f), vertex_step = glm::vec3(0.0f); // Decode the compact vertices.
+    std::vector<uint32_t> indices;
+    // Only the BVH of the storage mode is used.
+    std::vector<FlatBVHNode> nodes;
+    QuantizedBVH<uint16_t> bvh16;
+    QuantizedBVH<uint8_t> bvh8;
+    // The arrays above are counted in the memory of the primitives (vertices & indices) and of the accelerators (BVHs) once built.
+    TrackedMemory primitive_memory, bvh_memory;
+
+    inline glm::vec3 decode_position(const glm::u16vec3& position) const { return vertex_origin + glm::vec3(position) * vertex_step; }
+    // Intersects the ray with a range of triangles and updates the hit if one is closer than hit.distance.
+    template<MeshStorage STORAGE>
+    bool intersect_triangles(uint32_t first, uint32_t count, const Ray& ray, RayHit& hit) const;
+};
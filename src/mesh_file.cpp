@@ -0,0 +1,463 @@
+#include "mesh_file.hpp"
+#include "mapped_file.hpp"
+#include "parallel.hpp"
+
+#include <bit>
+#include <atomic>
+#include <limits>
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <string_view>
+
+// The files are split into chunks of about this size, which are parsed independently.
+constexpr size_t MESH_CHUNK_SIZE = 1 << 20;
+
+// Splits the content into chunks of about MESH_CHUNK_SIZE bytes that end at line ends.
+// Returns the chunk boundaries (the chunk i is between boundaries[i] and boundaries[i + 1]).
+static std::vector<const char*> split_lines_into_chunks(const char* begin, const char* end) {
+    std::vector<const char*> boundaries = { begin };
+    const char* cursor = begin;
+    while(static_cast<size_t>(end - cursor) > MESH_CHUNK_SIZE) {
+        const char* line_end = static_cast<const char*>(std::memchr(cursor + MESH_CHUNK_SIZE, '\n', end - cursor - MESH_CHUNK_SIZE));
+        if(!line_end) break;
+        cursor = line_end + 1;
+        boundaries.push_back(cursor);
+    }
+    if(boundaries.back() != end) boundaries.push_back(end);
+    return boundaries;
+}
+
+/////////
+// OBJ //
+/////////
+
+// The content of a chunk of an OBJ file, counted by the first pass and parsed by the second one.
+struct ObjChunk {
+    size_t line_count = 0, vertex_count = 0, triangle_count = 0;
+    size_t first_line = 0, first_vertex = 0, first_triangle = 0; // The prefix sums of the counts of the previous chunks.
+    size_t error_line = 0; // The line of the first error in the chunk (0 if there is none).
+    std::string error;
+};
+
+// Reads the lines of an OBJ chunk. The cursor stays inside the current line.
+class ObjLineReader {
+public:
+    ObjLineReader(const char* begin, const char* end) : cursor(begin), end(end) {}
+
+    // Moves to the start of the next line and returns its keyword ("v", "f", ...). Returns false at the end of the chunk.
+    bool next_line(std::string_view& keyword) {
+        if(line_end != nullptr) cursor = line_end == end ? end : line_end + 1;
+        if(cursor == end) return false;
+        line_end = static_cast<const char*>(std::memchr(cursor, '\n', end - cursor));
+        if(!line_end) line_end = end;
+        skip_spaces();
+        const char* start = cursor;
+        while(cursor != line_end && !is_space(*cursor)) ++cursor;
+        keyword = std::string_view(start, cursor - start);
+        return true;
+    }
+
+    // Counts the remaining tokens on the line.
+    size_t count_tokens() {
+        size_t count = 0;
+        while(true) {
+            skip_spaces();
+            if(cursor == line_end || *cursor == '#') return count;
+            while(cursor != line_end && !is_space(*cursor)) ++cursor;
+            ++count;
+        }
+    }
+
+    // Reads the next number on the line. Returns false if it is missing or invalid.
+    template<typename T>
+    bool read_number(T& value) {
+        skip_spaces();
+        if(cursor != line_end && *cursor == '+') ++cursor;
+        auto [next, status] = std::from_chars(cursor, line_end, value);
+        if(status != std::errc()) return false;
+        cursor = next;
+        return true;
+    }
+
+    // Reads the vertex index of the next face token ("v", "v/vt", "v//vn" or "v/vt/vn"). Returns false at the end of the line.
+    bool read_face_index(int64_t& index, bool& valid) {
+        skip_spaces();
+        if(cursor == line_end || *cursor == '#') return false;
+        valid = read_number(index);
+        while(cursor != line_end && !is_space(*cursor)) ++cursor;
+        return true;
+    }
+
+private:
+    const char* cursor;
+    const char* end;
+    const char* line_end = nullptr;
+
+    static inline bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+    inline void skip_spaces() { while(cursor != line_end && is_space(*cursor)) ++cursor; }
+};
+
+static bool load_obj(const MappedFile& file, const std::string& path, std::vector<glm::vec3>& vertices, std::vector<uint32_t>& indices, std::string& error) {
+    std::vector<const char*> boundaries = split_lines_into_chunks(file.data(), file.data() + file.size());
+    int chunk_count = static_cast<int>(boundaries.size()) - 1;
+    std::vector<ObjChunk> chunks(chunk_count);
+
+    // The first pass counts the lines, vertices & triangles of each chunk, so that the second pass knows where to store them.
+    parallel_for(0, chunk_count, [&](int index) {
+        ObjChunk& chunk = chunks[index];
+        ObjLineReader reader(boundaries[index], boundaries[index + 1]);
+        std::string_view keyword;
+        while(reader.next_line(keyword)) {
+            ++chunk.line_count;
+            if(keyword == "v") {
+                ++chunk.vertex_count;
+            } else if(keyword == "f") {
+                size_t corner_count = reader.count_tokens();
+                if(corner_count >= 3) chunk.triangle_count += corner_count - 2;
+            }
+        }
+    });
+    size_t line_count = 0, vertex_count = 0, triangle_count = 0;
+    for(ObjChunk& chunk: chunks) {
+        chunk.first_line = line_count;
+        chunk.first_vertex = vertex_count;
+        chunk.first_triangle = triangle_count;
+        line_count += chunk.line_count;
+        vertex_count += chunk.vertex_count;
+        triangle_count += chunk.triangle_count;
+    }
+    if(vertex_count > std::numeric_limits<uint32_t>::max()) {
+        error = path + " has too many vertices";
+        return false;
+    }
+    vertices.resize(vertex_count);
+    indices.resize(3 * triangle_count);
+
+    // The second pass parses the chunks into their slices of the arrays.
+    parallel_for(0, chunk_count, [&](int index) {
+        ObjChunk& chunk = chunks[index];
+        glm::vec3* vertex = vertices.data() + chunk.first_vertex;
+        uint32_t* triangle = indices.data() + 3 * chunk.first_triangle;
+        size_t line = chunk.first_line;
+        auto fail = [&](const char* message) {
+            chunk.error_line = line;
+            chunk.error = message;
+        };
+        ObjLineReader reader(boundaries[index], boundaries[index + 1]);
+        std::string_view keyword;
+        while(reader.next_line(keyword)) {
+            ++line;
+            if(keyword == "v") {
+                if(!reader.read_number(vertex->x) || !reader.read_number(vertex->y) || !reader.read_number(vertex->z)) return fail("expected: v <x> <y> <z>");
+                ++vertex;
+            } else if(keyword == "f") {
+                // Negative indices are relative to the last vertex defined before the face.
+                int64_t defined_vertex_count = static_cast<int64_t>(vertex - vertices.data());
+                uint32_t corners[2];
+                int64_t face_index;
+                bool valid;
+                for(int corner = 0; reader.read_face_index(face_index, valid); ++corner) {
+                    if(!valid) return fail("invalid vertex index in face");
+                    int64_t vertex_index = face_index < 0 ? defined_vertex_count + face_index : face_index - 1;
+                    if(vertex_index < 0 || vertex_index >= static_cast<int64_t>(vertex_count)) return fail("vertex index out of range");
+                    if(corner < 2) {
+                        corners[corner] = static_cast<uint32_t>(vertex_index);
+                        continue;
+                    }
+                    // The polygon is split into a fan of triangles around its first vertex.
+                    triangle[0] = corners[0];
+                    triangle[1] = corners[1];
+                    triangle[2] = static_cast<uint32_t>(vertex_index);
+                    triangle += 3;
+                    corners[1] = static_cast<uint32_t>(vertex_index);
+                }
+            }
+        }
+    });
+    for(const ObjChunk& chunk: chunks) {
+        if(chunk.error_line == 0) continue;
+        error = path + ":" + std::to_string(chunk.error_line) + ": " + chunk.error;
+        return false;
+    }
+    return true;
+}
+
+/////////
+// PLY //
+/////////
+
+enum class PlyScalarType { NONE, INT8, UINT8, INT16, UINT16, INT32, UINT32, FLOAT32, FLOAT64 };
+
+static PlyScalarType parse_ply_scalar_type(std::string_view name) {
+    if(name == "char" || name == "int8") return PlyScalarType::INT8;
+    if(name == "uchar" || name == "uint8") return PlyScalarType::UINT8;
+    if(name == "short" || name == "int16") return PlyScalarType::INT16;
+    if(name == "ushort" || name == "uint16") return PlyScalarType::UINT16;
+    if(name == "int" || name == "int32") return PlyScalarType::INT32;
+    if(name == "uint" || name == "uint32") return PlyScalarType::UINT32;
+    if(name == "float" || name == "float32") return PlyScalarType::FLOAT32;
+    if(name == "double" || name == "float64") return PlyScalarType::FLOAT64;
+    return PlyScalarType::NONE;
+}
+
+static size_t get_ply_scalar_size(PlyScalarType type) {
+    switch(type) {
+        case PlyScalarType::INT8: case PlyScalarType::UINT8: return 1;
+        case PlyScalarType::INT16: case PlyScalarType::UINT16: return 2;
+        case PlyScalarType::INT32: case PlyScalarType::UINT32: case PlyScalarType::FLOAT32: return 4;
+        case PlyScalarType::FLOAT64: return 8;
+        default: return 0;
+    }
+}
+
+// Reads a scalar stored in the file. The bytes are swapped if the file and the machine have different endianness.
+template<typename T>
+static inline T read_ply_bytes(const char* data, bool swap) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, data, sizeof(T));
+    if(swap) std::reverse(bytes, bytes + sizeof(T));
+    T value;
+    std::memcpy(&value, bytes, sizeof(T));
+    return value;
+}
+
+static double read_ply_scalar(const char* data, PlyScalarType type, bool swap) {
+    switch(type) {
+        case PlyScalarType::INT8: return read_ply_bytes<int8_t>(data, swap);
+        case PlyScalarType::UINT8: return read_ply_bytes<uint8_t>(data, swap);
+        case PlyScalarType::INT16: return read_ply_bytes<int16_t>(data, swap);
+        case PlyScalarType::UINT16: return read_ply_bytes<uint16_t>(data, swap);
+        case PlyScalarType::INT32: return read_ply_bytes<int32_t>(data, swap);
+        case PlyScalarType::UINT32: return read_ply_bytes<uint32_t>(data, swap);
+        case PlyScalarType::FLOAT32: return read_ply_bytes<float>(data, swap);
+        case PlyScalarType::FLOAT64: return read_ply_bytes<double>(data, swap);
+        default: return 0.0;
+    }
+}
+
+struct PlyProperty {
+    std::string name;
+    PlyScalarType type = PlyScalarType::NONE; // The type of the value, or of the items for a list.
+    PlyScalarType count_type = PlyScalarType::NONE; // The type of the item count for a list (NONE for a scalar).
+};
+
+struct PlyElement {
+    std::string name;
+    size_t count = 0;
+    std::vector<PlyProperty> properties;
+
+    // Returns the size of an element in bytes, or 0 if it contains lists (its size varies).
+    size_t get_fixed_size() const {
+        size_t size = 0;
+        for(const PlyProperty& property: properties) {
+            if(property.count_type != PlyScalarType::NONE) return 0;
+            size += get_ply_scalar_size(property.type);
+        }
+        return size;
+    }
+};
+
+static bool load_ply(const MappedFile& file, const std::string& path, std::vector<glm::vec3>& vertices, std::vector<uint32_t>& indices, std::string& error) {
+    const char* cursor = file.data();
+    const char* end = file.data() + file.size();
+    auto fail = [&](const std::string& message) {
+        error = path + ": " + message;
+        return false;
+    };
+
+    // Parse the header, which is text ending with "end_header".
+    std::vector<PlyElement> elements;
+    bool big_endian = false, has_format = false;
+    for(bool first_line = true;; first_line = false) {
+        const char* line_end = static_cast<const char*>(std::memchr(cursor, '\n', end - cursor));
+        if(!line_end) return fail("the PLY header is incomplete");
+        std::string_view line(cursor, line_end - cursor);
+        cursor = line_end + 1;
+        if(line.ends_with('\r')) line.remove_suffix(1);
+        std::vector<std::string_view> words;
+        for(size_t start = 0; start < line.size();) {
+            size_t word_end = line.find(' ', start);
+            if(word_end == std::string_view::npos) word_end = line.size();
+            if(word_end > start) words.push_back(line.substr(start, word_end - start));
+            start = word_end + 1;
+        }
+        if(first_line) {
+            if(line != "ply") return fail("not a PLY file");
+            continue;
+        }
+        if(words.empty() || words[0] == "comment" || words[0] == "obj_info") continue;
+        if(words[0] == "end_header") break;
+        if(words[0] == "format" && words.size() >= 2) {
+            if(words[1] == "ascii") return fail("ASCII PLY files are not supported (only binary ones)");
+            if(words[1] != "binary_little_endian" && words[1] != "binary_big_endian") return fail("unknown PLY format " + std::string(words[1]));
+            big_endian = words[1] == "binary_big_endian";
+            has_format = true;
+        } else if(words[0] == "element" && words.size() == 3) {
+            PlyElement& element = elements.emplace_back();
+            element.name = words[1];
+            if(std::from_chars(words[2].data(), words[2].data() + words[2].size(), element.count).ec != std::errc()) return fail("invalid element count");
+        } else if(words[0] == "property" && !elements.empty()) {
+            PlyProperty& property = elements.back().properties.emplace_back();
+            if(words.size() == 5 && words[1] == "list") {
+                property.count_type = parse_ply_scalar_type(words[2]);
+                property.type = parse_ply_scalar_type(words[3]);
+                property.name = words[4];
+                if(property.count_type == PlyScalarType::NONE || property.count_type == PlyScalarType::FLOAT32 || property.count_type == PlyScalarType::FLOAT64) {
+                    return fail("invalid PLY list count type");
+                }
+            } else if(words.size() == 3) {
+                property.type = parse_ply_scalar_type(words[1]);
+                property.name = words[2];
+            }
+            if(property.type == PlyScalarType::NONE) return fail("invalid PLY property: " + std::string(line));
+        } else {
+            return fail("invalid PLY header line: " + std::string(line));
+        }
+    }
+    if(!has_format) return fail("the PLY header has no format");
+    bool swap = big_endian != (std::endian::native == std::endian::big);
+
+    // Walk through the elements. The vertices and faces are parsed, and the other elements are skipped.
+    bool has_vertices = false, has_faces = false;
+    for(const PlyElement& element: elements) {
+        if(has_vertices && has_faces) break;
+        size_t fixed_size = element.get_fixed_size();
+        if(element.name == "vertex") {
+            if(fixed_size == 0) return fail("PLY vertices with list properties are not supported");
+            // The counts come from the header, so they are checked before anything is allocated for them.
+            if(element.count > std::numeric_limits<uint32_t>::max()) return fail("the PLY file has too many vertices");
+            if(element.count > static_cast<size_t>(end - cursor) / fixed_size) return fail("the PLY vertices are truncated");
+            // Find the position properties in a vertex.
+            size_t offsets[3] = {};
+            PlyScalarType types[3] = {};
+            size_t offset = 0;
+            for(const PlyProperty& property: element.properties) {
+                if(property.name.size() == 1 && property.name[0] >= 'x' && property.name[0] <= 'z') {
+                    offsets[property.name[0] - 'x'] = offset;
+                    types[property.name[0] - 'x'] = property.type;
+                }
+                offset += get_ply_scalar_size(property.type);
+            }
+            if(types[0] == PlyScalarType::NONE || types[1] == PlyScalarType::NONE || types[2] == PlyScalarType::NONE) return fail("the PLY vertices have no x, y & z properties");
+
+            // The vertices have a fixed size, so they are parsed in parallel.
+            vertices.resize(element.count);
+            const char* data = cursor;
+            int block_count = static_cast<int>((element.count * fixed_size + MESH_CHUNK_SIZE - 1) / MESH_CHUNK_SIZE);
+            parallel_for(0, block_count, [&](int block) {
+                size_t first = element.count * block / block_count, last = element.count * (block + 1) / block_count;
+                for(size_t vertex = first; vertex < last; ++vertex) {
+                    const char* vertex_data = data + vertex * fixed_size;
+                    for(int axis = 0; axis < 3; ++axis) {
+                        vertices[vertex][axis] = types[axis] == PlyScalarType::FLOAT32 && !swap
+                            ? read_ply_bytes<float>(vertex_data + offsets[axis], false)
+                            : static_cast<float>(read_ply_scalar(vertex_data + offsets[axis], types[axis], swap));
+                    }
+                }
+            });
+            cursor += element.count * fixed_size;
+            has_vertices = true;
+        } else if(element.name == "face") {
+            if(!has_vertices) return fail("the PLY faces come before the vertices");
+            const PlyProperty* list = nullptr;
+            for(const PlyProperty& property: element.properties) {
+                if(property.name == "vertex_indices" || property.name == "vertex_index") list = &property;
+            }
+            if(!list || list->count_type == PlyScalarType::NONE) return fail("the PLY faces have no vertex_indices list");
+            size_t count_size = get_ply_scalar_size(list->count_type), index_size = get_ply_scalar_size(list->type);
+            // A face takes at least the size of its scalars and of the item counts of its lists.
+            size_t min_face_size = 0;
+            for(const PlyProperty& property: element.properties) {
+                min_face_size += get_ply_scalar_size(property.count_type != PlyScalarType::NONE ? property.count_type : property.type);
+            }
+            if(element.count > std::numeric_limits<uint32_t>::max()) return fail("the PLY file has too many faces");
+            if(element.count > static_cast<size_t>(end - cursor) / min_face_size) return fail("the PLY faces are truncated");
+
+            // Most files only contain triangles, in which case the faces have a fixed size and they are parsed in parallel.
+            // The faces are first checked to all be triangles, otherwise they are parsed sequentially.
+            size_t triangle_size = count_size + 3 * index_size;
+            bool only_triangles = element.properties.size() == 1 && element.count <= static_cast<size_t>(end - cursor) / triangle_size;
+            const char* data = cursor;
+            int block_count = static_cast<int>((element.count * triangle_size + MESH_CHUNK_SIZE - 1) / MESH_CHUNK_SIZE);
+            if(only_triangles) {
+                std::atomic<bool> has_polygons = false;
+                parallel_for(0, block_count, [&](int block) {
+                    size_t first = element.count * block / block_count, last = element.count * (block + 1) / block_count;
+                    for(size_t face = first; face < last && !has_polygons; ++face) {
+                        if(read_ply_scalar(data + face * triangle_size, list->count_type, swap) != 3.0) has_polygons = true;
+                    }
+                });
+                only_triangles = !has_polygons;
+            }
+
+            std::atomic<bool> out_of_range = false;
+            if(only_triangles) {
+                indices.resize(3 * element.count);
+                parallel_for(0, block_count, [&](int block) {
+                    size_t first = element.count * block / block_count, last = element.count * (block + 1) / block_count;
+                    for(size_t face = first; face < last; ++face) {
+                        const char* face_data = data + face * triangle_size + count_size;
+                        for(int corner = 0; corner < 3; ++corner) {
+                            double index = read_ply_scalar(face_data + corner * index_size, list->type, swap);
+                            if(index < 0.0 || index >= vertices.size()) out_of_range = true;
+                            indices[3 * face + corner] = static_cast<uint32_t>(index);
+                        }
+                    }
+                });
+                cursor += element.count * triangle_size;
+            } else {
+                indices.clear();
+                for(size_t face = 0; face < element.count; ++face) {
+                    for(const PlyProperty& property: element.properties) {
+                        size_t item_count = 1;
+                        if(property.count_type != PlyScalarType::NONE) {
+                            if(static_cast<size_t>(end - cursor) < count_size) return fail("the PLY faces are truncated");
+                            item_count = static_cast<size_t>(read_ply_scalar(cursor, property.count_type, swap));
+                            cursor += get_ply_scalar_size(property.count_type);
+                        }
+                        size_t item_size = get_ply_scalar_size(property.type);
+                        if(item_count > static_cast<size_t>(end - cursor) / item_size) return fail("the PLY faces are truncated");
+                        if(&property == list) {
+                            // The polygon is split into a fan of triangles around its first vertex.
+                            for(size_t corner = 2; corner < item_count; ++corner) {
+                                for(size_t fan_corner: { size_t(0), corner - 1, corner }) {
+                                    double index = read_ply_scalar(cursor + fan_corner * item_size, property.type, swap);
+                                    if(index < 0.0 || index >= vertices.size()) out_of_range = true;
+                                    indices.push_back(static_cast<uint32_t>(index));
+                                }
+                            }
+                        }
+                        cursor += item_count * item_size;
+                    }
+                }
+            }
+            if(out_of_range) return fail("PLY vertex index out of range");
+            if(indices.size() / 3 > std::numeric_limits<uint32_t>::max()) return fail("the PLY file has too many triangles");
+            has_faces = true;
+        } else {
+            if(fixed_size == 0) return fail("the PLY element " + element.name + " has list properties and cannot be skipped");
+            if(element.count > static_cast<size_t>(end - cursor) / fixed_size) return fail("the PLY file is truncated");
+            cursor += element.count * fixed_size;
+        }
+    }
+    if(!has_vertices) return fail("the PLY file has no vertices");
+    return true;
+}
+
+bool load_mesh_file(const std::string& path, std::vector<glm::vec3>& vertices, std::vector<uint32_t>& indices, std::string& error) {
+    vertices.clear();
+    indices.clear();
+    bool is_obj = path.ends_with(".obj") || path.ends_with(".OBJ");
+    bool is_ply = path.ends_with(".ply") || path.ends_with(".PLY");
+    if(!is_obj && !is_ply) {
+        error = path + " is not a mesh file (expected a .obj or .ply file)";
+        return false;
+    }
+    MappedFile file;
+    if(!file.open_read(path)) {
+        error = "could not open " + path;
+        return false;
+    }
+    return is_obj ? load_obj(file, path, vertices, indices, error) : load_ply(file, path, vertices, indices, error);
+}
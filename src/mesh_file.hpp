@@ -0,0 +1,13 @@
+#pragma once
+
+#include <glm.hpp>
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Loads an indexed triangle mesh from a Wavefront OBJ (.obj) or binary PLY (.ply) file, chosen by the extension.
+// `vertices` receives the positions and `indices` the 0-based vertex indices of the triangles (3 per triangle).
+// Polygons with more than 3 vertices are split into triangle fans, and everything except the positions and faces is ignored.
+// The file is memory-mapped and parsed in chunks on all the hardware threads. Returns false and sets `error` on failure.
+bool load_mesh_file(const std::string& path, std::vector<glm::vec3>& vertices, std::vector<uint32_t>& indices, std::string& error);
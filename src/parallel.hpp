@@ -0,0 +1,138 @@
+#pragma once
+
+#include <trace.hpp>
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <cstdint>
+
+// Returns the number of worker threads used by the parallel helpers (at least 1).
+inline unsigned int get_worker_count() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// A pool of threads shared by all the parallel loops of the process, so the threads are created once
+// instead of once per loop (the path tracer runs a loop per sample, and the batch mode renders many images).
+// The thread that starts a loop also works on it, so several threads can run loops at the same time
+// (e.g. a render and the encoding of the previous image). A loop started from inside a loop of a worker runs serially on it.
+class ThreadPool {
+public:
+    // Creates a pool with `thread_count` workers (the threads starting loops come on top of them).
+    explicit ThreadPool(unsigned int thread_count) {
+        for(unsigned int index = 0; index < thread_count; ++index) workers.emplace_back([this]() { work(); });
+    }
+    ~ThreadPool() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        work_available.notify_all();
+        for(auto& worker: workers) worker.join();
+    }
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Returns the pool shared by the whole process, which has a worker per hardware thread besides the calling thread.
+    static ThreadPool& get() {
+        static ThreadPool pool(get_worker_count() - 1);
+        return pool;
+    }
+
+    // Calls `fn(task)` for every task in [0, task_count), in roughly increasing order, on the workers and the calling thread.
+    // Returns when all the tasks are done.
+    void run(int task_count, const std::function<void(int)>& fn) {
+        if(task_count <= 0) return;
+        if(is_worker || workers.empty() || task_count == 1) {
+            for(int task = 0; task < task_count; ++task) fn(task);
+            return;
+        }
+        Job job = { &fn, task_count };
+        {
+            std::lock_guard lock(mutex);
+            jobs.push_back(&job);
+        }
+        work_available.notify_all();
+        execute(job);
+        // The job lives on this stack, so wait until the workers are done with it and it is out of the queue.
+        std::unique_lock lock(mutex);
+        job_done.wait(lock, [&]() { return job.done == job.count && job.users == 0; });
+        auto it = std::find(jobs.begin(), jobs.end(), &job);
+        if(it != jobs.end()) jobs.erase(it);
+    }
+
+private:
+    struct Job {
+        const std::function<void(int)>* fn;
+        int count;
+        std::atomic<int> next = 0; // The next task to start.
+        std::atomic<int> done = 0; // The number of finished tasks.
+        int users = 0; // The number of workers executing the job (guarded by the mutex).
+    };
+
+    std::vector<std::thread> workers;
+    std::deque<Job*> jobs; // The jobs which may still have tasks to start, oldest first.
+    std::mutex mutex;
+    std::condition_variable work_available, job_done;
+    bool stopping = false;
+    static inline thread_local bool is_worker = false;
+
+    // Runs the tasks of the job until they have all been started.
+    // The time each thread spends on a loop is traced, which shows how evenly the loop was balanced.
+    void execute(Job& job) {
+        TraceScope trace("parallel work");
+        for(int task = job.next++; task < job.count; task = job.next++) {
+            (*job.fn)(task);
+            if(++job.done == job.count) {
+                std::lock_guard lock(mutex);
+                job_done.notify_all();
+            }
+        }
+    }
+
+    void work() {
+        is_worker = true;
+        std::unique_lock lock(mutex);
+        while(true) {
+            work_available.wait(lock, [&]() { return stopping || !jobs.empty(); });
+            if(stopping) return;
+            Job* job = jobs.front();
+            if(job->next >= job->count) {
+                jobs.pop_front();
+                continue;
+            }
+            job->users++;
+            lock.unlock();
+            execute(*job);
+            lock.lock();
+            if(--job->users == 0) job_done.notify_all();
+        }
+    }
+};
+
+// Calls `fn(i)` for every i in [begin, end) using all the available hardware threads.
+// The range is split into contiguous chunks (one per thread) so each thread touches a coherent block of memory.
+template<typename F>
+void parallel_for(int begin, int end, F&& fn) {
+    int count = end - begin;
+    if(count <= 0) return;
+    int chunk_count = std::min<int>(get_worker_count(), count);
+    ThreadPool::get().run(chunk_count, [&](int chunk) {
+        int chunk_begin = begin + static_cast<int>(static_cast<int64_t>(count) * chunk / chunk_count);
+        int chunk_end = begin + static_cast<int>(static_cast<int64_t>(count) * (chunk + 1) / chunk_count);
+        for(int i = chunk_begin; i < chunk_end; ++i) fn(i);
+    });
+}
+
+// Calls `fn(i)` for every i in [begin, end) using all the available hardware threads.
+// Unlike parallel_for, the threads fetch the next index from a shared counter when they are done with the previous one,
+// so it balances the work when the iterations take very different times, and the indices are processed roughly in order.
+template<typename F>
+void parallel_for_dynamic(int begin, int end, F&& fn) {
+    ThreadPool::get().run(end - begin, [&](int index) { fn(begin + index); });
+}
@@ -1,83 +1,326 @@
 #include "pathtracer.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
+#include "render_kernel.hpp"
 
 #include <glm.hpp>
 #include <gtc/constants.hpp>
 
 #include <cstdlib>
 #include <iostream>
+#include <mutex>
+#include <chrono>
+#include <cstdio>
 
-// Sample a random uniform value between 0 and 1.
-static float sample_uniform_01() {
+// Sample a random uniform value between 0 and 1 (used by path_trace_1spp for the random point inside the pixel).
+[[maybe_unused]] static float sample_uniform_01() {
     return static_cast<float>(rand()) / RAND_MAX;
 }
 
+// Limits the progress line of a render to a few updates per second, since printing it after every sample slows down the fast renders.
+class ProgressThrottle {
+public:
+    // Returns true if the progress should be printed now: always for the last update, otherwise if the last print is old enough.
+    bool should_print(bool last) {
+        auto now = std::chrono::steady_clock::now();
+        if(!last && now - last_print < PRINT_INTERVAL) return false;
+        last_print = now;
+        return true;
+    }
+
+private:
+    static constexpr std::chrono::milliseconds PRINT_INTERVAL{ 250 };
+    std::chrono::steady_clock::time_point last_print;
+};
+
+// The state of the optional features for a single sample. Each feature is disabled when its pointer is null.
+struct SampleContext {
+    // The statistics of the path traced through each pixel should be stored here (at index y * width + x).
+    TrackedVector<PathRecord, MemoryCategory::FRAMEBUFFERS>* records = nullptr;
+    // The guide should be used to sample the bounces off lambert surfaces.
+    PathGuide* guide = nullptr;
+    // Whether the light arriving at each bounce should also be recorded into the guide.
+    bool record_guide = false;
+    // The irradiance cache replaces the diffuse bounces at or after its start depth.
+    IrradianceCache* irradiance_cache = nullptr;
+    // The image may only cover a tile of the viewport: its pixel (x, y) is the viewport pixel tile_origin + (x, y).
+    glm::ivec2 tile_origin = glm::ivec2(0);
+};
+
 // Pathtraces the scene and updates the image with the rendered scene.
-// The number of samples per pixel here is just 1, and each ray can bounce at most `max_bounces` times before being discarded.
-void path_trace_1spp(Image& image, const Scene& scene, uint32_t max_bounces) {
+// The number of samples per pixel here is just 1, and each ray can bounce at most `kernel.get_max_bounces()` times before being discarded.
+// The scene is queried through the kernel, which is specialized for the acceleration structure and the background of the render
+// (See render_kernel.hpp), so this function is compiled once per combination without branching on them.
+template<typename Kernel>
+void path_trace_1spp(Image& image, const Kernel& kernel, const SampleContext& context) {
     //TODO: Write a path tracers that traces 1 sample per pixel.
-    // Note: Cast the ray from the random point inside the pixel to apply Anti-aliasing.
+    // Note: Cast the ray from the random point inside the pixel to apply Anti-aliasing (e.g. x + sample_uniform_01()).
+    //       Loop over the pixels of the image, which may be a tile starting at context.tile_origin in the viewport.
     // Hints: When casting a new ray from the hit point, move it slightly away from the hit point to avoid self-intersection. 
     //        For example, you can move the new ray origin from the hit point a distance of 0.0001 in the new ray direction. 
+    //        Use kernel.intersect and kernel.sample_background instead of the functions of the scene (kernel.get_scene()),
+    //        so the compiler can inline them, and loop up to kernel.get_max_bounces().
+    //        To sample the hit material, you can use kernel.sample_material which avoids the virtual call to Material::sample.
+    //        If context.records is not null, split the light into the part added before the first bounce (direct) and the rest (indirect),
+    //        and count the number of bounces made by the path. 
+    //        If context.guide is not null, replace the sample of each lambert material by guide->guide_diffuse_sample(...).
+    //        If context.record_guide is also true, call guide->record(...) at each bounce point with the light that came back along
+    //        the outgoing direction (the light added to the pixel after that bounce divided by the path factor up to it).
+    //        If context.irradiance_cache is not null, at each lambert hit from the cache's start depth, call lookup(...).
+    //        If it succeeds, add the emission plus albedo * irradiance / pi (times the path factor) and stop the path.
+    //        Otherwise, continue the path and record(...) the irradiance at that hit, which is pi times the light that came back 
+    //        along the (cosine distributed) outgoing direction.
+}
+
+// Fills the first hit AOVs with a ray through the center of each pixel.
+// All the first hit AOVs are written from the same primary hit, so requesting more of them costs no extra rays.
+// Using the pixel center (instead of a jittered position) keeps the guides noise-free, and it only costs one extra ray per pixel.
+void collect_first_hit_aovs(const Scene& scene, AOVBuffers& aovs) {
+    TraceScope trace("collect aovs");
+    const Camera& camera = scene.get_camera();
+    // The loop is compiled for the acceleration structure of the scene, so it does not branch on it for every ray.
+    dispatch_intersection_kernel(scene, [&](const auto& kernel) {
+        parallel_for(0, aovs.height, [&](int y) {
+            // Generate the rays of the whole row at once.
+            TileRayGenerator ray_generator(camera);
+            RayBatch rays;
+            ray_generator.generate(glm::ivec2(0, y), glm::ivec2(aovs.width, 1), nullptr, nullptr, rays);
+            for(int x = 0; x < aovs.width; ++x) {
+                Ray ray = rays.get_ray(x);
+                RayHit hit;
+                if(kernel.intersect(ray, hit)) {
+                    aovs.albedo(x, y) = scene.get_materials().get_albedo(hit.material_id);
+                    aovs.normal(x, y) = hit.normal;
+                    aovs.depth_at(x, y) = hit.distance;
+                    aovs.material_id_at(x, y) = hit.material_id;
+                } else {
+                    aovs.albedo(x, y) = Colors::BLACK;
+                    aovs.normal(x, y) = glm::vec3(0.0f);
+                    aovs.depth_at(x, y) = std::numeric_limits<float>::infinity();
+                    aovs.material_id_at(x, y) = -1;
+                }
+            }
+        });
+    });
 }
 
 // Pathtraces the scene and returns an image of the rendered scene.
 // The number of samples per pixel is given by `sample_count`, and each ray can bounce at most `max_bounces` times before being discarded.
-Image path_trace(const Scene& scene, uint32_t sample_count, uint32_t max_bounces) {
+Image path_trace(const Scene& scene, uint32_t sample_count, uint32_t max_bounces, const PathTracerOptions& options) {
     srand(time(NULL));
+    AOVBuffers* aovs = options.aovs;
+    PathGuide* guide = options.guide;
 
     glm::ivec2 viewport_size = scene.get_camera().get_viewport_size();
+    // Only the pixels of the crop region are rendered, or the whole viewport if there is none.
+    PixelRegion region = { glm::ivec2(0), viewport_size };
+    if(!options.crop.is_empty()) region = { glm::clamp(options.crop.min, glm::ivec2(0), viewport_size), glm::clamp(options.crop.max, glm::ivec2(0), viewport_size) };
+    glm::ivec2 region_size = region.get_size();
     Image final_image(viewport_size.x, viewport_size.y); // The image containing the average of all the samples
-    Image sample_image(viewport_size.x, viewport_size.y); // The image containing the current sample only
+    Image sample_image(region_size.x, region_size.y); // The image containing the current sample only (of the region)
+    TrackedVector<PathRecord, MemoryCategory::FRAMEBUFFERS> sample_records; // The path statistics of the current sample only (of the region)
+    if(aovs) sample_records.resize(region_size.x * region_size.y);
+    // The guide is trained over passes of 1, 2, 4, ... samples (refined after each), using at most a quarter of the samples.
+    // With a time limit the sample count is only a maximum, so the training also uses at most a quarter of the time.
+    uint32_t guide_training_samples = sample_count / 4;
+    double guide_training_seconds = options.time_limit / 4.0;
+    uint32_t next_guide_refinement = 1;
+    // The render time excludes the time spent in the on_sample callback.
+    double render_seconds = 0.0;
+    auto sample_start = std::chrono::high_resolution_clock::now();
+    ProgressThrottle progress;
 
     for(uint32_t sample = 0; sample < sample_count; ++sample) {
+        TraceScope trace("sample");
         // Trace 1 sample per pixel into the scene
-        path_trace_1spp(sample_image, scene, max_bounces);
-        // Mix new sample image into the final image
+        SampleContext context = {
+            .records = aovs ? &sample_records : nullptr,
+            .guide = guide,
+            .record_guide = guide && next_guide_refinement <= guide_training_samples,
+            .irradiance_cache = options.irradiance_cache,
+            .tile_origin = region.min
+        };
+        dispatch_render_kernel(scene, max_bounces, [&](const auto& kernel) { path_trace_1spp(sample_image, kernel, context); });
+        if(context.record_guide && sample + 1 == next_guide_refinement) {
+            guide->refine();
+            next_guide_refinement = 2 * next_guide_refinement + 1;
+            // The next pass has as many samples as all the previous ones (plus one), so it would take about as long as them.
+            double training_seconds = render_seconds + std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - sample_start).count();
+            if(options.time_limit > 0.0 && 2.0 * training_seconds > guide_training_seconds) guide_training_samples = 0;
+        }
+        // Mix new sample image (and the path AOVs) into the final image
         float lr = 1.0f / (1.0f + sample);
-        for(int y = 0; y < viewport_size.y; ++y) {
-            for(int x = 0; x < viewport_size.x; ++x) {
-                final_image(x, y) = glm::mix(final_image(x, y), sample_image(x, y), lr);
+        for(int y = 0; y < region_size.y; ++y) {
+            for(int x = 0; x < region_size.x; ++x) {
+                int image_x = region.min.x + x, image_y = region.min.y + y;
+                final_image(image_x, image_y) = glm::mix(final_image(image_x, image_y), sample_image(x, y), lr);
+                if(aovs) {
+                    const PathRecord& record = sample_records[y * region_size.x + x];
+                    aovs->direct(image_x, image_y) = glm::mix(aovs->direct(image_x, image_y), record.direct, lr);
+                    aovs->indirect(image_x, image_y) = glm::mix(aovs->indirect(image_x, image_y), record.indirect, lr);
+                    aovs->bounces_at(image_x, image_y) = glm::mix(aovs->bounces_at(image_x, image_y), static_cast<float>(record.bounces), lr);
+                }
             }
         }
-        // Print progress
-        std::cout << "\rSample: " << sample + 1 << "/" << sample_count << std::flush;
+        render_seconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - sample_start).count();
+
+        // Print progress, with the rate of the camera rays (one per pixel and sample, the bounces are not counted)
+        bool time_limit_reached = options.time_limit > 0.0 && render_seconds >= options.time_limit;
+        if(progress.should_print(sample + 1 == sample_count || time_limit_reached)) {
+            double mrays_per_second = 1e-6 * region_size.x * region_size.y * (sample + 1) / render_seconds;
+            if(options.time_limit > 0.0) printf("\rSample: %u (%.1f/%.1f seconds, %.2f Mrays/s)   ", sample + 1, render_seconds, options.time_limit, mrays_per_second);
+            else printf("\rSample: %u/%u (%.2f Mrays/s)   ", sample + 1, sample_count, mrays_per_second);
+            fflush(stdout);
+        }
+
+        if(options.on_sample) options.on_sample(sample + 1, render_seconds, final_image);
+        if(time_limit_reached) break;
+        sample_start = std::chrono::high_resolution_clock::now();
     }
 
     std::cout << std::endl;
+
+    // Collect the first hit AOVs if requested.
+    if(aovs) collect_first_hit_aovs(scene, *aovs);
+
     return final_image;
 }
 
-////////////////////////////
-// Debug Drawing Function //
-////////////////////////////
+// Pathtraces the pixels of a region of the viewport and returns an image of the region with the average of the samples.
+// Only the irradiance cache is used from the options. This is used to render the tiles, one per thread.
+static Image path_trace_region(const Scene& scene, uint32_t sample_count, uint32_t max_bounces, const PixelRegion& region, const PathTracerOptions& options) {
+    glm::ivec2 size = region.get_size();
+    Image final_tile(size.x, size.y);
+    Image sample_tile(size.x, size.y);
+    SampleContext context = {
+        .irradiance_cache = options.irradiance_cache,
+        .tile_origin = region.min
+    };
+    for(uint32_t sample = 0; sample < sample_count; ++sample) {
+        dispatch_render_kernel(scene, max_bounces, [&](const auto& kernel) { path_trace_1spp(sample_tile, kernel, context); });
+        float lr = 1.0f / (1.0f + sample);
+        for(int y = 0; y < size.y; ++y) {
+            for(int x = 0; x < size.x; ++x) final_tile(x, y) = glm::mix(final_tile(x, y), sample_tile(x, y), lr);
+        }
+    }
+    return final_tile;
+}
 
-template<typename F>
-Image debug_draw(const Scene& scene, Color default_color, F&& color_fn) {
-    const Camera& camera = scene.get_camera();
-    glm::ivec2 viewport_size = camera.get_viewport_size();
-    Image image(viewport_size.x, viewport_size.y);
-    for(int y = 0; y < viewport_size.y; ++y) {
-        for(int x = 0; x < viewport_size.x; ++x) {
-            Ray ray = camera.get_ray(glm::vec2(x + sample_uniform_01(), y + sample_uniform_01()));
-            RayHit hit;
-            Color color = default_color;
-            if(scene.intersect(ray, hit)) {
-                color = color_fn(hit);
+// Pathtraces the scene tile by tile into the framebuffer.
+// Each thread renders all the samples of a tile before writing it, so only the tiles in flight are kept in memory.
+void path_trace_tiled(const Scene& scene, uint32_t sample_count, uint32_t max_bounces, TiledFramebuffer& framebuffer, const PathTracerOptions& options) {
+    srand(time(NULL));
+    auto start = std::chrono::high_resolution_clock::now();
+    int finished_tiles = 0;
+    uint64_t finished_rays = 0;
+    ProgressThrottle progress;
+    std::mutex progress_mutex;
+
+    // The tiles are handed out in order, so the bands are finished (and released) roughly from bottom to top.
+    parallel_for_dynamic(0, framebuffer.get_tile_count(), [&](int tile) {
+        TraceScope trace("tile");
+        glm::ivec2 tile_origin = framebuffer.get_tile_origin(tile), tile_size = framebuffer.get_tile_size(tile);
+        framebuffer.write_tile(tile, path_trace_region(scene, sample_count, max_bounces, { tile_origin, tile_origin + tile_size }, options));
+
+        // Print progress, with the rate of the camera rays (one per pixel and sample, the bounces are not counted)
+        std::lock_guard lock(progress_mutex);
+        finished_tiles++;
+        finished_rays += static_cast<uint64_t>(tile_size.x) * tile_size.y * sample_count;
+        if(progress.should_print(finished_tiles == framebuffer.get_tile_count())) {
+            double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+            printf("\rTile: %d/%d (%.2f Mrays/s)   ", finished_tiles, framebuffer.get_tile_count(), 1e-6 * finished_rays / seconds);
+            fflush(stdout);
+        }
+    });
+
+    std::cout << std::endl;
+}
+
+// Pathtraces the tiles of the frame which are not up to date in the tile cache, and merges them with the cached tiles.
+// The tiles are handed out to the threads one at a time, and each thread renders all the missing samples of its tile.
+Image path_trace_cached(const Scene& scene, uint32_t sample_count, uint32_t max_bounces, const TileCache& cache, const PathTracerOptions& options) {
+    srand(time(NULL));
+    glm::ivec2 viewport_size = scene.get_camera().get_viewport_size();
+    Image frame(viewport_size.x, viewport_size.y);
+    auto start = std::chrono::high_resolution_clock::now();
+    int finished_tiles = 0, rendered_tiles = 0, unsaved_tiles = 0;
+    uint64_t finished_rays = 0;
+    ProgressThrottle progress;
+    std::mutex progress_mutex;
+
+    parallel_for_dynamic(0, cache.get_tile_count(), [&](int tile) {
+        TraceScope trace("tile");
+        PixelRegion region = cache.get_tile_region(tile);
+        CachedTile cached_tile;
+        bool cached = cache.load_tile(tile, cached_tile);
+        bool up_to_date = cached && cached_tile.scene_hash == cache.get_scene_hash();
+        bool in_crop = options.crop.is_empty() || options.crop.overlaps(region);
+        uint32_t new_samples = 0;
+        if(in_crop && !(up_to_date && cached_tile.sample_count >= sample_count)) {
+            // Render the missing samples, or all of them if the tile was rendered from another version of the scene.
+            uint32_t previous_samples = up_to_date ? cached_tile.sample_count : 0;
+            new_samples = sample_count - previous_samples;
+            Image new_tile = path_trace_region(scene, new_samples, max_bounces, region, options);
+            if(previous_samples > 0) {
+                // Both images are averages, so they are merged in proportion to their sample counts.
+                float weight = static_cast<float>(new_samples) / sample_count;
+                for(int y = 0; y < new_tile.get_height(); ++y) {
+                    for(int x = 0; x < new_tile.get_width(); ++x) cached_tile.image(x, y) = glm::mix(cached_tile.image(x, y), new_tile(x, y), weight);
+                }
+            } else {
+                cached_tile.image = std::move(new_tile);
+            }
+            cached_tile.scene_hash = cache.get_scene_hash();
+            cached_tile.sample_count = sample_count;
+            cached = true;
+            if(!cache.save_tile(tile, cached_tile)) {
+                std::lock_guard lock(progress_mutex);
+                unsaved_tiles++;
             }
-            image(x, y) = color;
         }
-    }
-    return image;
+        // The tiles cover different pixels, so they are copied into the frame without a lock.
+        if(cached) {
+            for(int y = 0; y < cached_tile.image.get_height(); ++y) {
+                for(int x = 0; x < cached_tile.image.get_width(); ++x) frame(region.min.x + x, region.min.y + y) = cached_tile.image(x, y);
+            }
+        }
+
+        // Print progress, with the rate of the camera rays (one per pixel and sample, the bounces are not counted)
+        std::lock_guard lock(progress_mutex);
+        finished_tiles++;
+        if(new_samples > 0) rendered_tiles++;
+        glm::ivec2 tile_size = region.get_size();
+        finished_rays += static_cast<uint64_t>(tile_size.x) * tile_size.y * new_samples;
+        if(progress.should_print(finished_tiles == cache.get_tile_count())) {
+            double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+            printf("\rTile: %d/%d (%d rendered, %.2f Mrays/s)   ", finished_tiles, cache.get_tile_count(), rendered_tiles, 1e-6 * finished_rays / seconds);
+            fflush(stdout);
+        }
+    });
+
+    std::cout << std::endl;
+    std::cout << "Rendered " << rendered_tiles << " of " << cache.get_tile_count() << " tiles, the others were taken from the tile cache" << std::endl;
+    if(unsaved_tiles > 0) std::cout << "Could not write " << unsaved_tiles << " tiles to the tile cache" << std::endl;
+    return frame;
 }
 
+////////////////////////////
+// Debug Drawing Function //
+////////////////////////////
+
+// The debug drawing functions are views of the first hit AOVs.
+// To get several of them from the same primary hits, use collect_first_hit_aovs then make_aov_image for each of them.
+
 Image debug_draw_hit_distance(const Scene& scene) {
-    return debug_draw(scene, Color(1000000.0f), [](const RayHit& hit) {
-        return Color(hit.distance * 0.1f);
-    });
+    glm::ivec2 viewport_size = scene.get_camera().get_viewport_size();
+    AOVBuffers aovs(viewport_size.x, viewport_size.y);
+    collect_first_hit_aovs(scene, aovs);
+    return make_aov_image(aovs, AOV::DEPTH, 0);
 }
 
 Image debug_draw_hit_normal(const Scene& scene) {
-    return debug_draw(scene, Color(1000000.0f), [](const RayHit& hit) {
-        return hit.normal * 0.5f + 0.5f;
-    });
-}
\ No newline at end of file
+    glm::ivec2 viewport_size = scene.get_camera().get_viewport_size();
+    AOVBuffers aovs(viewport_size.x, viewport_size.y);
+    collect_first_hit_aovs(scene, aovs);
+    return make_aov_image(aovs, AOV::NORMAL, 0);
+}
@@ -2,10 +2,53 @@
 
 #include <image.hpp>
 #include <scene.hpp>
+#include <aov.hpp>
+#include <guiding.hpp>
+#include <irradiance_cache.hpp>
+#include <framebuffer.hpp>
+#include <tile_cache.hpp>
+
+#include <functional>
+
+// The optional features of the path tracer. Each feature is disabled when its pointer (or function) is null.
+struct PathTracerOptions {
+    AOVBuffers* aovs = nullptr; // Filled with the AOVs of every pixel in the same pass.
+    // Trained during the first samples then used to guide the diffuse bounces. It stays empty until path_trace_1spp samples and records it
+    // (see its TODO), so the commandline does not offer it yet.
+    PathGuide* guide = nullptr;
+    // Queried by the diffuse bounces from its start depth instead of tracing further. It stays empty until path_trace_1spp looks it up
+    // and records into it (see its TODO), so the commandline does not offer it yet.
+    IrradianceCache* irradiance_cache = nullptr;
+    // If not empty, only the pixels of this region are rendered (the others are left black), so the time is only spent on the region.
+    PixelRegion crop;
+    // If positive, path_trace stops after the first sample that ends past this render time (in seconds), so the sample count is only a maximum.
+    // The guide is then trained during at most about a quarter of this time.
+    double time_limit = 0.0;
+    // Called by path_trace after each sample with the number of samples so far, the render time so far and the average of the samples.
+    // The time spent in the callback is not counted in the render time (nor in the time limit).
+    std::function<void(uint32_t sample_count, double seconds, const Image& image)> on_sample;
+};
 
 // Pathtraces the scene and returns an image of the rendered scene.
 // The number of samples per pixel is given by `sample_count`, and each ray can bounce at most `max_bounces` times before being discarded.
-Image path_trace(const Scene& scene, uint32_t sample_count, uint32_t max_bounces);
+// The optional features are enabled through `options`.
+Image path_trace(const Scene& scene, uint32_t sample_count, uint32_t max_bounces, const PathTracerOptions& options = {});
+
+// Pathtraces the scene tile by tile and writes each finished tile into the framebuffer, for images too large to fit in memory.
+// The tiles are rendered in parallel (one per thread), so the memory used only depends on the number and size of the tiles.
+// Only the irradiance cache is supported from the options, since the AOVs and the path guide need the whole image at once.
+void path_trace_tiled(const Scene& scene, uint32_t sample_count, uint32_t max_bounces, TiledFramebuffer& framebuffer, const PathTracerOptions& options = {});
+
+// Pathtraces the tiles of the frame which are not up to date in the tile cache, saves them to it, and returns the frame with every tile.
+// A tile is up to date if it was rendered from the same scene (see compute_scene_hash) with at least `sample_count` samples.
+// A tile rendered from the same scene with fewer samples only gets the missing samples, which are averaged with the cached ones.
+// If options.crop is not empty, only the tiles overlapping it are rendered: the others are taken from the cache even if they are out of date
+// (or left black if they are not cached), so that a frame can be fixed by rendering the region which changed.
+// As with path_trace_tiled, only the irradiance cache is supported from the options.
+Image path_trace_cached(const Scene& scene, uint32_t sample_count, uint32_t max_bounces, const TileCache& cache, const PathTracerOptions& options = {});
+
+// Fills the first hit AOVs (albedo, normal, depth & material id) of every pixel using one primary ray per pixel.
+void collect_first_hit_aovs(const Scene& scene, AOVBuffers& aovs);
 
 // Some debug drawing functions
 Image debug_draw_hit_distance(const Scene& scene);
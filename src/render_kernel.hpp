@@ -0,0 +1,125 @@
+#pragma once
+
+#include <scene.hpp>
+#include <bvh.hpp>
+#include <grid.hpp>
+#include <compiled_scene.hpp>
+#include <backgrounds.hpp>
+
+#include <cstdint>
+#include <utility>
+
+// How a render kernel intersects the scene.
+enum class IntersectionKernel {
+    SHAPES, // Tests every shape.
+    BVH, // Traverses the BVH of the scene.
+    GRID, // Traverses the uniform or two-level grid of the scene.
+    COMPILED, // Traverses the arrays of a compiled scene.
+};
+
+// How a render kernel samples the background.
+enum class BackgroundKernel {
+    CONSTANT, // A single color (a SimpleBackground, or black without a background).
+    SKY, // A SkyBackground.
+    GENERIC, // Any other background, through a virtual call.
+};
+
+// The scene queries of a render, specialized at compile time for the options which are fixed for the whole render
+// (the acceleration structure and the background), so that the inner loops of the path tracer
+// do not branch on them and the compiler can inline their code.
+// Use dispatch_render_kernel to call a function with the kernel matching a scene.
+template<IntersectionKernel INTERSECTION, BackgroundKernel BACKGROUND>
+class RenderKernel {
+public:
+    RenderKernel(const Scene& scene, uint32_t max_bounces) : scene(scene), max_bounces(max_bounces) {
+        if constexpr(INTERSECTION == IntersectionKernel::BVH) bvh = static_cast<const BVHAccelerator*>(scene.get_accelerator());
+        if constexpr(INTERSECTION == IntersectionKernel::GRID) grid = static_cast<const GridAccelerator*>(scene.get_accelerator());
+        if constexpr(INTERSECTION == IntersectionKernel::COMPILED) compiled_scene = scene.get_compiled_scene();
+        if constexpr(BACKGROUND == BackgroundKernel::CONSTANT) {
+            background_color = scene.get_background() ? static_cast<SimpleBackground*>(scene.get_background().get())->get_color() : Colors::BLACK;
+        }
+        if constexpr(BACKGROUND == BackgroundKernel::SKY) sky = static_cast<SkyBackground*>(scene.get_background().get());
+    }
+
+    inline const Scene& get_scene() const { return scene; }
+    // The maximum number of bounces per ray.
+    inline uint32_t get_max_bounces() const { return max_bounces; }
+
+    // Checks for ray intersections with any of the shapes in the scene (See Scene::intersect).
+    inline bool intersect(const Ray& ray, RayHit& hit) const {
+        if constexpr(INTERSECTION == IntersectionKernel::BVH) return bvh->intersect(ray, hit);
+        else if constexpr(INTERSECTION == IntersectionKernel::GRID) return grid->intersect(ray, hit);
+        else if constexpr(INTERSECTION == IntersectionKernel::COMPILED) return compiled_scene->intersect(ray, hit);
+        else return scene.intersect_shapes(ray, hit);
+    }
+
+    // Get the color of the background in the given direction (See Scene::sample_background).
+    inline Color sample_background(const glm::vec3& direction) const {
+        if constexpr(BACKGROUND == BackgroundKernel::CONSTANT) return background_color;
+        else if constexpr(BACKGROUND == BackgroundKernel::SKY) return sky->sample(direction);
+        else return scene.sample_background(direction);
+    }
+
+    // Samples the material at the hit point (See Scene::sample_material).
+    inline MaterialSample sample_material(const RayHit& hit, const glm::vec3& incoming_ray_direction, const glm::vec3& hit_point) const {
+        return scene.sample_material(hit, incoming_ray_direction, hit_point);
+    }
+
+private:
+    const Scene& scene;
+    uint32_t max_bounces;
+    const BVHAccelerator* bvh = nullptr;
+    const GridAccelerator* grid = nullptr;
+    const CompiledScene* compiled_scene = nullptr;
+    Color background_color = Colors::BLACK;
+    SkyBackground* sky = nullptr;
+};
+
+// Returns the intersection kernel matching the way the scene is intersected.
+inline IntersectionKernel get_intersection_kernel(const Scene& scene) {
+    if(scene.get_compiled_scene()) return IntersectionKernel::COMPILED;
+    if(dynamic_cast<const BVHAccelerator*>(scene.get_accelerator())) return IntersectionKernel::BVH;
+    if(dynamic_cast<const GridAccelerator*>(scene.get_accelerator())) return IntersectionKernel::GRID;
+    return IntersectionKernel::SHAPES;
+}
+
+// Returns the background kernel matching the background of the scene.
+inline BackgroundKernel get_background_kernel(const Scene& scene) {
+    Background* background = scene.get_background().get();
+    if(!background || dynamic_cast<SimpleBackground*>(background)) return BackgroundKernel::CONSTANT;
+    if(dynamic_cast<SkyBackground*>(background)) return BackgroundKernel::SKY;
+    return BackgroundKernel::GENERIC;
+}
+
+template<IntersectionKernel INTERSECTION, typename F>
+void dispatch_background_kernel(const Scene& scene, uint32_t max_bounces, F&& fn) {
+    switch(get_background_kernel(scene)) {
+        case BackgroundKernel::CONSTANT: fn(RenderKernel<INTERSECTION, BackgroundKernel::CONSTANT>(scene, max_bounces)); break;
+        case BackgroundKernel::SKY: fn(RenderKernel<INTERSECTION, BackgroundKernel::SKY>(scene, max_bounces)); break;
+        default: fn(RenderKernel<INTERSECTION, BackgroundKernel::GENERIC>(scene, max_bounces)); break;
+    }
+}
+
+// Calls fn(kernel) with the render kernel specialized for the scene, which limits the rays to max_bounces bounces.
+// This is the only place where the options of the kernels are branched on, once per call instead of once per ray.
+template<typename F>
+void dispatch_render_kernel(const Scene& scene, uint32_t max_bounces, F&& fn) {
+    switch(get_intersection_kernel(scene)) {
+        case IntersectionKernel::BVH: dispatch_background_kernel<IntersectionKernel::BVH>(scene, max_bounces, std::forward<F>(fn)); break;
+        case IntersectionKernel::GRID: dispatch_background_kernel<IntersectionKernel::GRID>(scene, max_bounces, std::forward<F>(fn)); break;
+        case IntersectionKernel::COMPILED: dispatch_background_kernel<IntersectionKernel::COMPILED>(scene, max_bounces, std::forward<F>(fn)); break;
+        default: dispatch_background_kernel<IntersectionKernel::SHAPES>(scene, max_bounces, std::forward<F>(fn)); break;
+    }
+}
+
+// Calls fn(kernel) with a kernel only specialized for the way the scene is intersected,
+// for the loops which only trace primary rays (such as the AOVs and the debug views).
+template<typename F>
+void dispatch_intersection_kernel(const Scene& scene, F&& fn) {
+    switch(get_intersection_kernel(scene)) {
+        case IntersectionKernel::BVH: fn(RenderKernel<IntersectionKernel::BVH, BackgroundKernel::GENERIC>(scene, 0)); break;
+        case IntersectionKernel::GRID: fn(RenderKernel<IntersectionKernel::GRID, BackgroundKernel::GENERIC>(scene, 0)); break;
+        case IntersectionKernel::COMPILED: fn(RenderKernel<IntersectionKernel::COMPILED, BackgroundKernel::GENERIC>(scene, 0)); break;
+        default: fn(RenderKernel<IntersectionKernel::SHAPES, BackgroundKernel::GENERIC>(scene, 0)); break;
+    }
+}
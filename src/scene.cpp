@@ -1,40 +1,82 @@
 #include "scene.hpp"
+#include "compiled_scene.hpp"
+#include "trace.hpp"
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include <gtx/euler_angles.hpp>
 
 bool Scene::intersect(const Ray& ray, RayHit& hit) const {
-    if(root != nullptr) { 
-        // If the BVH is defined, use it.
-        return root->intersect_ray(ray, hit);
+    if(compiled_scene != nullptr) {
+        // If the scene was loaded from a compiled scene, intersect its arrays directly.
+        return compiled_scene->intersect(ray, hit);
+    } else if(accelerator != nullptr) { 
+        // If the acceleration structure is defined, use it.
+        return accelerator->intersect(ray, hit);
     } else { 
         // Otherwise, loop over the shapes and test for intersection with them one-by-one.
-        hit.distance = std::numeric_limits<float>::max();
-        bool has_hit = false;
-        for(auto shape: shapes) {
-            RayHit shape_hit;
-            if(shape->intersect(ray, shape_hit) && shape_hit.distance < hit.distance) {
-                has_hit = true;
-                hit = shape_hit;
-            }
+        return intersect_shapes(ray, hit);
+    }
+}
+
+bool Scene::intersect_shapes(const Ray& ray, RayHit& hit) const {
+    hit.distance = std::numeric_limits<float>::max();
+    bool has_hit = false;
+    for(const Shape* shape: shapes) {
+        RayHit shape_hit;
+        if(shape->intersect(ray, shape_hit) && shape_hit.distance < hit.distance) {
+            has_hit = true;
+            hit = shape_hit;
+            hit.material_id = shape->get_material_id();
         }
-        return has_hit;
     }
+    return has_hit;
 }
 
 void Scene::start_construction() {
-    // Clears the list of shapes and the BVH.
+    // Clears the list of shapes and the acceleration structure. Their memory is freed at once by resetting the arenas.
     shapes.clear();
-    root = nullptr;
+    accelerator = nullptr;
+    accelerator_arena.reset();
+    arena.reset();
+    compiled_scene = nullptr;
+    material_references.clear();
+    material_ids.clear();
+    last_material = nullptr;
+    last_material_id = -1;
+    materials.clear();
+}
+
+void Scene::set_compiled_scene(const std::shared_ptr<const CompiledScene>& compiled_scene) {
+    start_construction();
+    this->compiled_scene = compiled_scene;
+    for(const MaterialRecord& record: compiled_scene->get_materials()) materials.add(record);
+    bounds = compiled_scene->get_header().bounds;
+}
+
+int32_t Scene::register_material(const std::shared_ptr<Material>& material) {
+    // Consecutive shapes usually share their material, so the last one is checked before the map.
+    if(material.get() == last_material) return last_material_id;
+    // Assigns an id to each material in the order of their first use, and adds it to the material table.
+    auto [it, inserted] = material_ids.try_emplace(material.get(), 0);
+    if(inserted) {
+        it->second = materials.add(*material);
+        material_references.push_back(material);
+    }
+    last_material = material.get();
+    last_material_id = it->second;
+    return it->second;
 }
 
 void Scene::finish_construction() {
-    // Constructs the BVH if use_bvh is true.
-    if(use_bvh) {
-        root = std::make_shared<BVHNode>(shapes);
-    } else {
-        root = nullptr;
+    // Computes the bounds of the scene.
+    bounds = { glm::vec3(0.0f), glm::vec3(0.0f) };
+    if(!shapes.empty()) {
+        bounds = shapes[0]->get_bounds();
+        for(const auto& shape: shapes) bounds = bounds.merge(shape->get_bounds());
     }
+    // Constructs the acceleration structure (if the accelerator type is not NONE).
+    TraceScope trace("build accelerator");
+    accelerator = create_accelerator(accelerator_type, shapes, accelerator_arena, bvh_leaf_size);
 }
 
 Color Scene::sample_background(const glm::vec3& direction) const {
@@ -42,20 +84,21 @@ Color Scene::sample_background(const glm::vec3& direction) const {
     return background ? background->sample(direction) : Colors::BLACK;
 }
 
+int32_t Scene::get_material_id(const Material* material) const {
+    auto it = material_ids.find(material);
+    return it != material_ids.end() ? it->second : -1;
+}
+
 //////////////////////////////////////////
 // Functions to add shapes to the scene //
 //////////////////////////////////////////
 
-void Scene::add_shape(std::shared_ptr<Shape> shape) {
-    shapes.push_back(shape);
-}
-
 void Scene::add_sphere(const std::shared_ptr<Material>& material, const glm::vec3& center, float radius) {
-    add_shape(std::make_shared<Sphere>(center, radius, material));
+    create_shape<Sphere>(material, center, radius);
 }
 
 void Scene::add_triangle(const std::shared_ptr<Material>& material, const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2) {
-    add_shape(std::make_shared<Triangle>(v0, v1, v2, material));
+    create_shape<Triangle>(material, v0, v1, v2);
 }
 
 void Scene::add_rectangle(const std::shared_ptr<Material>& material, const glm::vec3& center, const glm::vec2& size, const glm::vec3& angles) {
@@ -102,4 +145,8 @@ void Scene::add_cuboid(const std::shared_ptr<Material>& material, const glm::vec
     // Right
     add_triangle(material, verts[2], verts[3], verts[7]);
     add_triangle(material, verts[2], verts[6], verts[7]);
+}
+
+const TriangleMesh* Scene::add_mesh(const std::shared_ptr<Material>& material, std::vector<glm::vec3> vertices, std::vector<uint32_t> indices) {
+    return create_shape<TriangleMesh>(material, std::move(vertices), std::move(indices), mesh_storage);
 }
\ No newline at end of file
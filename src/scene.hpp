@@ -6,11 +6,20 @@
 #include <camera.hpp>
 #include <backgrounds.hpp>
 #include <bvh.hpp>
+#include <grid.hpp>
+#include <accelerator.hpp>
+#include <mesh.hpp>
+#include <arena.hpp>
 
 #include <vector>
+#include <unordered_map>
+
+class CompiledScene;
 
 // A scene class containing a camera, a list of shapes, and a background.
-// Optionally, it also contains a BVH for efficient intersection testing.
+// Optionally, it also contains an acceleration structure (a BVH or a grid) for efficient intersection testing.
+// The shapes and the acceleration structure are allocated in arenas owned by the scene, so they are packed in memory
+// and freed all at once when the scene is destroyed or constructed again.
 class Scene {
 public:
     // Setters and getters
@@ -19,35 +28,94 @@ public:
     inline Camera& get_camera() { return camera; }
     inline const Camera& get_camera() const { return camera; }
     inline void set_camera(const Camera& camera) { this->camera = camera; }
-    inline bool get_use_bvh() const { return use_bvh; }
-    inline void set_use_bvh(bool value) { this->use_bvh = value; }
+    inline AcceleratorType get_accelerator_type() const { return accelerator_type; }
+    inline void set_accelerator_type(AcceleratorType value) { this->accelerator_type = value; }
+    // Shorthands to choose between a BVH and no acceleration structure.
+    inline bool get_use_bvh() const { return accelerator_type == AcceleratorType::BVH; }
+    inline void set_use_bvh(bool value) { this->accelerator_type = value ? AcceleratorType::BVH : AcceleratorType::NONE; }
+    // The maximum number of shapes in the leaves of the BVH (about, see build_flat_bvh).
+    inline uint32_t get_bvh_leaf_size() const { return bvh_leaf_size; }
+    inline void set_bvh_leaf_size(uint32_t value) { this->bvh_leaf_size = value; }
+    inline MeshStorage get_mesh_storage() const { return mesh_storage; }
+    inline void set_mesh_storage(MeshStorage value) { this->mesh_storage = value; }
 
     // Checks for ray intersections with any of the shapes in the scene.
-    // If use_bvh was true when the scene was constructed, this will use the BVH to speed up intersection testing.
+    // If the scene was constructed with an accelerator type other than NONE, this will use it to speed up intersection testing.
     bool intersect(const Ray& ray, RayHit& hit) const;
+    // Checks for ray intersections by testing the shapes one by one (as intersect does without an accelerator).
+    bool intersect_shapes(const Ray& ray, RayHit& hit) const;
     
     // Get the color of the background in the given direction.
     Color sample_background(const glm::vec3& direction) const;
 
-     // Call before adding any shape.
+    // Get a unique id for a material used in the scene (in the order of their first use), or -1 if the material is not in the scene.
+    // The ids are assigned when the shapes are added.
+    int32_t get_material_id(const Material* material) const;
+    // Get the AABB encompassing all the shapes in the scene (computed by finish_construction).
+    inline AABB get_bounds() const { return bounds; }
+    // Get the list of all the shapes in the scene.
+    inline const std::vector<Shape*>& get_shapes() const { return shapes; }
+    // Get the acceleration structure (null if the scene was constructed without one).
+    inline const Accelerator* get_accelerator() const { return accelerator; }
+    // Get the compiled scene whose arrays are used in place of the shapes (null if the scene was not loaded from one).
+    inline const CompiledScene* get_compiled_scene() const { return compiled_scene.get(); }
+    // Get the memory reserved by the arenas holding the shapes and the acceleration structure.
+    inline size_t get_arena_capacity() const { return arena.get_capacity() + accelerator_arena.get_capacity(); }
+    // Get the table of all the materials used in the scene indexed by their ids.
+    inline const MaterialTable& get_materials() const { return materials; }
+    // Samples the material at the hit point using the material table (without a virtual call).
+    inline MaterialSample sample_material(const RayHit& hit, const glm::vec3& incoming_ray_direction, const glm::vec3& hit_point) const {
+        return materials.sample(hit.material_id, incoming_ray_direction, hit_point, hit.normal);
+    }
+
+     // Call before adding any shape. This frees the shapes and the acceleration structure of the previous construction.
     void start_construction();
     // Call after adding all shapes.
-    // If use_bvh was true, this function will construct the BVH.
+    // This function constructs the acceleration structure of the current accelerator type.
     void finish_construction(); 
 
+    // Uses the arrays of a compiled scene in place of the shapes (See compiled_scene.hpp).
+    // The scene keeps the compiled scene alive, and the camera & background must be set separately.
+    void set_compiled_scene(const std::shared_ptr<const CompiledScene>& compiled_scene);
+
     // Functions for adding shapes.
     // Note: "angles" define rotation as euler angles (Yaw, Pitch, Roll) in radians where the vector contains (Pitch, Roll, Yaw). 
-    void add_shape(std::shared_ptr<Shape> shape);
+    // The scene keeps a reference to each material until it is constructed again.
     void add_sphere(const std::shared_ptr<Material>& material, const glm::vec3& center, float radius);
     void add_triangle(const std::shared_ptr<Material>& material, const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2);
     void add_rectangle(const std::shared_ptr<Material>& material, const glm::vec3& center, const glm::vec2& size, const glm::vec3& angles = glm::vec3(0.0f));
     void add_cuboid(const std::shared_ptr<Material>& material, const glm::vec3& center, const glm::vec3& size, const glm::vec3& angles = glm::vec3(0.0f));
+    // Adds an indexed triangle mesh as a single shape (see TriangleMesh) and returns it. The indices are 0-based, 3 per triangle.
+    // The mesh is stored using the current mesh storage mode.
+    const TriangleMesh* add_mesh(const std::shared_ptr<Material>& material, std::vector<glm::vec3> vertices, std::vector<uint32_t> indices);
 
 
 private:
     Camera camera;
     std::shared_ptr<Background> background;
-    std::vector<std::shared_ptr<Shape>> shapes;
-    std::shared_ptr<BVHNode> root;
-    bool use_bvh = false;
+    Arena arena{ MemoryCategory::PRIMITIVES }; // Owns the shapes.
+    Arena accelerator_arena{ MemoryCategory::ACCELERATORS }; // Owns the acceleration structure (declared after the shapes, so it is destroyed first).
+    std::vector<Shape*> shapes;
+    const Accelerator* accelerator = nullptr;
+    std::shared_ptr<const CompiledScene> compiled_scene;
+    std::vector<std::shared_ptr<Material>> material_references; // One reference per material used by the shapes.
+    std::unordered_map<const Material*, int32_t> material_ids;
+    const Material* last_material = nullptr; // The material of the last shape added and its id.
+    int32_t last_material_id = -1;
+    MaterialTable materials;
+    AABB bounds = { glm::vec3(0.0f), glm::vec3(0.0f) };
+    AcceleratorType accelerator_type = AcceleratorType::NONE;
+    uint32_t bvh_leaf_size = DEFAULT_BVH_LEAF_SIZE;
+    MeshStorage mesh_storage = MeshStorage::FULL;
+
+    // Creates a shape in the arena, assigns the id of its material and adds it to the list of shapes.
+    template<typename T, typename... Args>
+    T* create_shape(const std::shared_ptr<Material>& material, Args&&... args) {
+        T* shape = arena.create<T>(std::forward<Args>(args)..., material);
+        shape->set_material_id(register_material(material));
+        shapes.push_back(shape);
+        return shape;
+    }
+    // Returns the id of the material, adding it to the material table on its first use.
+    int32_t register_material(const std::shared_ptr<Material>& material);
 };
\ No newline at end of file
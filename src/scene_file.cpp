@@ -0,0 +1,334 @@
+#include "scene_file.hpp"
+#include "mapped_file.hpp"
+#include "mesh_file.hpp"
+
+#include <charconv>
+#include <algorithm>
+#include <filesystem>
+#include <string_view>
+#include <vector>
+#include <cstdio>
+
+////////////
+// Parser //
+////////////
+
+// Reads the values of a scene file one line at a time. The tokens are views into the file content, so nothing is copied.
+class SceneTextReader {
+public:
+    SceneTextReader(const char* begin, const char* end) : cursor(begin), end(end) {}
+
+    // Moves to the first token of the next statement (skipping empty lines and comments).
+    // Returns false at the end of the file.
+    bool next_statement() {
+        while(true) {
+            skip_spaces();
+            if(cursor == end) return false;
+            if(*cursor == '#') {
+                while(cursor != end && *cursor != '\n') ++cursor;
+            } else if(*cursor == '\n') {
+                ++cursor;
+                ++line;
+            } else {
+                return true;
+            }
+        }
+    }
+
+    // Returns true if there are no more tokens in the current statement.
+    bool at_statement_end() {
+        skip_spaces();
+        return cursor == end || *cursor == '\n' || *cursor == '#';
+    }
+
+    // Readers for the tokens of the current statement. Each one returns false if the next token is missing or invalid.
+    bool read_word(std::string_view& word) {
+        if(at_statement_end()) return false;
+        const char* start = cursor;
+        while(cursor != end && !is_separator(*cursor)) ++cursor;
+        word = std::string_view(start, cursor - start);
+        return true;
+    }
+    template<typename T>
+    bool read_number(T& value) {
+        if(at_statement_end()) return false;
+        // from_chars does not accept a leading '+', so it is skipped here.
+        if(*cursor == '+') ++cursor;
+        auto [next, status] = std::from_chars(cursor, end, value);
+        if(status != std::errc() || (next != end && !is_separator(*next))) return false;
+        cursor = next;
+        return true;
+    }
+    bool read_vec3(glm::vec3& value) {
+        return read_number(value.x) && read_number(value.y) && read_number(value.z);
+    }
+
+    inline int get_line() const { return line; }
+    // Returns the number of bytes left after the current token.
+    inline size_t get_remaining_size() const { return end - cursor; }
+
+private:
+    const char* cursor;
+    const char* end;
+    int line = 1;
+
+    static inline bool is_separator(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '#'; }
+    inline void skip_spaces() { while(cursor != end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\r')) ++cursor; }
+};
+
+bool load_scene_file(const std::string& path, Scene& scene, std::string& error) {
+    MappedFile file;
+    if(!file.open_read(path)) {
+        error = "could not open " + path;
+        return false;
+    }
+    SceneTextReader reader(file.data(), file.data() + file.size());
+    auto fail = [&](const std::string& message) {
+        error = path + ":" + std::to_string(reader.get_line()) + ": " + message;
+        return false;
+    };
+
+    // The materials are looked up by name for every shape, and consecutive shapes usually share their material,
+    // so the last one found is checked first.
+    std::vector<std::pair<std::string, std::shared_ptr<Material>>> materials;
+    size_t last_material = 0;
+    auto find_material = [&](std::string_view name) -> std::shared_ptr<Material> {
+        if(last_material < materials.size() && materials[last_material].first == name) return materials[last_material].second;
+        for(size_t index = 0; index < materials.size(); ++index) {
+            if(materials[index].first == name) {
+                last_material = index;
+                return materials[index].second;
+            }
+        }
+        return nullptr;
+    };
+    bool has_camera = false;
+    scene.set_background(std::make_shared<SimpleBackground>(Colors::BLACK));
+    scene.start_construction();
+
+    while(reader.next_statement()) {
+        std::string_view keyword;
+        reader.read_word(keyword);
+
+        if(keyword == "camera") {
+            glm::vec3 position, look_at, up;
+            float fovy;
+            glm::ivec2 viewport_size;
+            if(!reader.read_vec3(position) || !reader.read_vec3(look_at) || !reader.read_vec3(up) || !reader.read_number(fovy)
+                || !reader.read_number(viewport_size.x) || !reader.read_number(viewport_size.y)) {
+                return fail("expected: camera <position xyz> <look at xyz> <up xyz> <fovy> <width> <height>");
+            }
+            if(viewport_size.x <= 0 || viewport_size.y <= 0) return fail("the camera resolution must be positive");
+            scene.set_camera(Camera(position, look_at, up, glm::radians(fovy), viewport_size));
+            has_camera = true;
+        } else if(keyword == "background") {
+            std::string_view type;
+            reader.read_word(type);
+            if(type == "simple") {
+                Color color;
+                if(!reader.read_vec3(color)) return fail("expected: background simple <color rgb>");
+                scene.set_background(std::make_shared<SimpleBackground>(color));
+            } else if(type == "sky") {
+                Color top, horizon, bottom, sun;
+                glm::vec3 sun_direction;
+                float sun_angle, sun_feathering;
+                if(!reader.read_vec3(top) || !reader.read_vec3(horizon) || !reader.read_vec3(bottom) || !reader.read_vec3(sun)
+                    || !reader.read_vec3(sun_direction) || !reader.read_number(sun_angle) || !reader.read_number(sun_feathering)) {
+                    return fail("expected: background sky <top rgb> <horizon rgb> <bottom rgb> <sun rgb> <sun direction xyz> <sun angle> <sun feathering>");
+                }
+                scene.set_background(std::make_shared<SkyBackground>(top, horizon, bottom, sun, sun_direction, glm::radians(sun_angle), glm::radians(sun_feathering)));
+            } else {
+                return fail("unknown background type '" + std::string(type) + "' (expected simple or sky)");
+            }
+        } else if(keyword == "material") {
+            std::string_view name, type;
+            Color color;
+            if(!reader.read_word(name) || !reader.read_word(type) || !reader.read_vec3(color)) {
+                return fail("expected: material <name> lambert|metal|emissive <color rgb>");
+            }
+            if(find_material(name)) return fail("material '" + std::string(name) + "' is already defined");
+            std::shared_ptr<Material> material;
+            if(type == "lambert") material = make_material<LambertMaterial>(color);
+            else if(type == "metal") material = make_material<SmoothMetalMaterial>(color);
+            else if(type == "emissive") material = make_material<EmissiveMaterial>(color);
+            else return fail("unknown material type '" + std::string(type) + "' (expected lambert, metal or emissive)");
+            materials.emplace_back(std::string(name), material);
+        } else if(keyword == "sphere" || keyword == "triangle" || keyword == "rectangle" || keyword == "cuboid" || keyword == "mesh" || keyword == "model") {
+            std::string_view material_name;
+            if(!reader.read_word(material_name)) return fail("expected a material name after " + std::string(keyword));
+            std::shared_ptr<Material> material = find_material(material_name);
+            if(!material) return fail("unknown material '" + std::string(material_name) + "'");
+
+            if(keyword == "sphere") {
+                glm::vec3 center;
+                float radius;
+                if(!reader.read_vec3(center) || !reader.read_number(radius)) return fail("expected: sphere <material> <center xyz> <radius>");
+                scene.add_sphere(material, center, radius);
+            } else if(keyword == "triangle") {
+                glm::vec3 v0, v1, v2;
+                if(!reader.read_vec3(v0) || !reader.read_vec3(v1) || !reader.read_vec3(v2)) return fail("expected: triangle <material> <v0 xyz> <v1 xyz> <v2 xyz>");
+                scene.add_triangle(material, v0, v1, v2);
+            } else if(keyword == "rectangle") {
+                glm::vec3 center, angles;
+                glm::vec2 size;
+                if(!reader.read_vec3(center) || !reader.read_number(size.x) || !reader.read_number(size.y) || !reader.read_vec3(angles)) {
+                    return fail("expected: rectangle <material> <center xyz> <size xy> <angles xyz>");
+                }
+                scene.add_rectangle(material, center, size, glm::radians(angles));
+            } else if(keyword == "cuboid") {
+                glm::vec3 center, size, angles;
+                if(!reader.read_vec3(center) || !reader.read_vec3(size) || !reader.read_vec3(angles)) {
+                    return fail("expected: cuboid <material> <center xyz> <size xyz> <angles xyz>");
+                }
+                scene.add_cuboid(material, center, size, glm::radians(angles));
+            } else if(keyword == "mesh") {
+                uint32_t vertex_count, triangle_count;
+                if(!reader.read_number(vertex_count) || !reader.read_number(triangle_count)) return fail("expected: mesh <material> <vertex count> <triangle count>");
+                if(!reader.at_statement_end()) return fail("unexpected values at the end of the statement");
+                // The counts are not trusted for the allocations: the arrays grow as the statements are read, and the space reserved up front
+                // is capped by the number of statements that fit in the rest of the file (the shortest ones, such as "v 0 0 0", take 8 bytes).
+                const size_t MIN_STATEMENT_SIZE = 8;
+                size_t max_statement_count = reader.get_remaining_size() / MIN_STATEMENT_SIZE;
+                std::vector<glm::vec3> vertices;
+                vertices.reserve(std::min<size_t>(vertex_count, max_statement_count));
+                for(uint32_t vertex = 0; vertex < vertex_count; ++vertex) {
+                    std::string_view tag;
+                    glm::vec3 position;
+                    if(!reader.next_statement() || !reader.read_word(tag) || tag != "v" || !reader.read_vec3(position)) return fail("expected: v <xyz>");
+                    if(!reader.at_statement_end()) return fail("unexpected values at the end of the statement");
+                    vertices.push_back(position);
+                }
+                std::vector<uint32_t> indices;
+                indices.reserve(3 * std::min<size_t>(triangle_count, max_statement_count));
+                for(uint32_t triangle = 0; triangle < triangle_count; ++triangle) {
+                    std::string_view tag;
+                    uint32_t triangle_indices[3];
+                    if(!reader.next_statement() || !reader.read_word(tag) || tag != "f"
+                        || !reader.read_number(triangle_indices[0]) || !reader.read_number(triangle_indices[1]) || !reader.read_number(triangle_indices[2])) {
+                        return fail("expected: f <i0> <i1> <i2>");
+                    }
+                    if(triangle_indices[0] >= vertex_count || triangle_indices[1] >= vertex_count || triangle_indices[2] >= vertex_count) return fail("vertex index out of range");
+                    if(!reader.at_statement_end()) return fail("unexpected values at the end of the statement");
+                    indices.insert(indices.end(), std::begin(triangle_indices), std::end(triangle_indices));
+                }
+                scene.add_mesh(material, std::move(vertices), std::move(indices));
+            } else {
+                std::string_view model_path;
+                if(!reader.read_word(model_path)) return fail("expected: model <material> <path>");
+                // Relative paths are relative to the directory of the scene file.
+                std::filesystem::path full_path = std::filesystem::path(path).parent_path() / std::filesystem::path(model_path);
+                std::vector<glm::vec3> vertices;
+                std::vector<uint32_t> indices;
+                std::string model_error;
+                if(!load_mesh_file(full_path.string(), vertices, indices, model_error)) return fail(model_error);
+                scene.add_mesh(material, std::move(vertices), std::move(indices));
+            }
+        } else {
+            return fail("unknown statement '" + std::string(keyword) + "'");
+        }
+
+        if(!reader.at_statement_end()) return fail("unexpected values at the end of the statement");
+    }
+
+    if(!has_camera) return fail("the scene has no camera");
+    scene.finish_construction();
+    return true;
+}
+
+////////////
+// Writer //
+////////////
+
+// Builds the text of a scene file in a buffer which is written to the file in large blocks.
+class SceneTextWriter {
+public:
+    SceneTextWriter(FILE* file) : file(file) { buffer.reserve(BLOCK_SIZE + 1024); }
+    ~SceneTextWriter() { flush(); }
+
+    inline SceneTextWriter& text(std::string_view value) {
+        buffer.append(value);
+        return *this;
+    }
+    // Writes a space followed by the shortest representation that reads back to exactly the same float.
+    inline SceneTextWriter& number(float value) {
+        char digits[32];
+        auto [end, status] = std::to_chars(digits, digits + sizeof(digits), value);
+        buffer.push_back(' ');
+        buffer.append(digits, end);
+        return *this;
+    }
+    inline SceneTextWriter& number(int value) {
+        char digits[16];
+        auto [end, status] = std::to_chars(digits, digits + sizeof(digits), value);
+        buffer.push_back(' ');
+        buffer.append(digits, end);
+        return *this;
+    }
+    inline SceneTextWriter& vec3(const glm::vec3& value) {
+        return number(value.x).number(value.y).number(value.z);
+    }
+    inline void end_statement() {
+        buffer.push_back('\n');
+        if(buffer.size() >= BLOCK_SIZE) flush();
+    }
+
+    // Writes the buffered text to the file. A short write sets the error indicator of the file, which the caller checks with ferror.
+    inline void flush() {
+        fwrite(buffer.data(), 1, buffer.size(), file);
+        buffer.clear();
+    }
+
+private:
+    static constexpr size_t BLOCK_SIZE = 1 << 20;
+    FILE* file;
+    std::string buffer;
+};
+
+bool save_scene_file(const std::string& path, const Scene& scene) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if(!file) return false;
+    {
+        SceneTextWriter writer(file);
+        writer.text("# path tracer scene").end_statement();
+
+        const Camera& camera = scene.get_camera();
+        writer.text("camera").vec3(camera.get_position()).vec3(camera.get_look_at()).vec3(camera.get_up()).number(glm::degrees(camera.get_fovy()))
+            .number(camera.get_viewport_size().x).number(camera.get_viewport_size().y).end_statement();
+
+        const Background* background = scene.get_background().get();
+        if(auto sky = dynamic_cast<const SkyBackground*>(background)) {
+            writer.text("background sky").vec3(sky->get_top()).vec3(sky->get_horizon()).vec3(sky->get_bottom()).vec3(sky->get_sun())
+                .vec3(sky->get_sun_direction()).number(glm::degrees(sky->get_sun_angle())).number(glm::degrees(sky->get_sun_feathering())).end_statement();
+        } else if(auto simple = dynamic_cast<const SimpleBackground*>(background)) {
+            writer.text("background simple").vec3(simple->get_color()).end_statement();
+        }
+
+        // The materials are named after their ids in the material table.
+        const MaterialTable& materials = scene.get_materials();
+        for(size_t id = 0; id < materials.size(); ++id) {
+            const MaterialRecord& record = materials[static_cast<int32_t>(id)];
+            const char* type = record.type == MaterialType::LAMBERT ? "lambert" : (record.type == MaterialType::SMOOTH_METAL ? "metal" : "emissive");
+            writer.text("material m").text(std::to_string(id)).text(" ").text(type).vec3(record.color).end_statement();
+        }
+
+        for(const Shape* shape: scene.get_shapes()) {
+            std::string material_name = "m" + std::to_string(shape->get_material_id());
+            if(auto sphere = dynamic_cast<const Sphere*>(shape)) {
+                writer.text("sphere ").text(material_name).vec3(sphere->get_center()).number(sphere->get_radius()).end_statement();
+            } else if(auto triangle = dynamic_cast<const Triangle*>(shape)) {
+                writer.text("triangle ").text(material_name).vec3(triangle->get_vertex(0)).vec3(triangle->get_vertex(1)).vec3(triangle->get_vertex(2)).end_statement();
+            } else if(auto mesh = dynamic_cast<const TriangleMesh*>(shape)) {
+                // The models loaded from mesh files are written inline, so the scene file is self-contained.
+                writer.text("mesh ").text(material_name).number(static_cast<int>(mesh->get_vertex_count())).number(static_cast<int>(mesh->get_triangle_count())).end_statement();
+                for(uint32_t vertex = 0; vertex < mesh->get_vertex_count(); ++vertex) writer.text("v").vec3(mesh->get_position(vertex)).end_statement();
+                std::span<const uint32_t> indices = mesh->get_indices();
+                for(size_t index = 0; index < indices.size(); index += 3) {
+                    writer.text("f").number(static_cast<int>(indices[index])).number(static_cast<int>(indices[index + 1])).number(static_cast<int>(indices[index + 2])).end_statement();
+                }
+            }
+        }
+    }
+    // A short write (e.g. on a full disk) fails the save.
+    bool success = !ferror(file);
+    return fclose(file) == 0 && success;
+}
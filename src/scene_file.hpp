@@ -0,0 +1,32 @@
+#pragma once
+
+#include <scene.hpp>
+
+#include <string>
+
+// A simple line based text format describing a whole scene. Every line holds one statement,
+// the values are separated by spaces, and everything after a '#' is a comment. Angles are in degrees.
+//
+//   camera <position xyz> <look at xyz> <up xyz> <fovy> <width> <height>
+//   background simple <color rgb>
+//   background sky <top rgb> <horizon rgb> <bottom rgb> <sun rgb> <sun direction xyz> <sun angle> <sun feathering>
+//   material <name> lambert|metal|emissive <color rgb>
+//   sphere <material name> <center xyz> <radius>
+//   triangle <material name> <v0 xyz> <v1 xyz> <v2 xyz>
+//   rectangle <material name> <center xyz> <size xy> <angles xyz>
+//   cuboid <material name> <center xyz> <size xyz> <angles xyz>
+//   mesh <material name> <vertex count> <triangle count>
+//   followed by the vertex lines "v <xyz>" then the triangle lines "f <i0> <i1> <i2>" (0-based vertex indices).
+//   model <material name> <path of a .obj or .ply file, relative to the scene file>
+//
+// The angles of rectangles and cuboids are the euler angles given to Scene::add_rectangle and Scene::add_cuboid.
+// Meshes and models are added as indexed triangle meshes (see TriangleMesh), and the models are exported as meshes.
+// A material must be defined before the shapes using it. The camera is required, and the background defaults to black.
+
+// Loads a scene file into the scene (which is constructed from scratch). Returns false and sets `error` on failure.
+// The file is memory-mapped and parsed in place, without allocating anything per token.
+bool load_scene_file(const std::string& path, Scene& scene, std::string& error);
+
+// Writes a constructed scene to a scene file. Returns true if the file was written.
+// The rectangles and cuboids were split into triangles when they were added, so they are written as triangles.
+bool save_scene_file(const std::string& path, const Scene& scene);
@@ -1,4 +1,12 @@
 #include "scene_setup.hpp"
+#include "mesh_file.hpp"
+
+#include <gtc/constants.hpp>
+
+#include <functional>
+#include <random>
+#include <cmath>
+#include <cstdlib>
 
 void setup_triangle_test_scene(Scene& scene, int width, int height, int version) {
     scene.set_background(std::make_shared<SimpleBackground>(Colors::BLACK));
@@ -12,7 +20,7 @@ void setup_triangle_test_scene(Scene& scene, int width, int height, int version)
 
     scene.start_construction();
 
-    std::shared_ptr<Material> light = std::make_shared<EmissiveMaterial>(Color(1.0f, 1.0f, 1.0f) * 2.0f);
+    std::shared_ptr<Material> light = make_material<EmissiveMaterial>(Color(1.0f, 1.0f, 1.0f) * 2.0f);
 
     if(version == 0) { // Fully visible triangle
         scene.add_triangle(light, glm::vec3(-0.5f, -0.5f, 0.0f), glm::vec3(0.5f, -0.5f, 0.0f), glm::vec3(0.0f, 0.5f, 0.0f));
@@ -39,7 +47,7 @@ void setup_sphere_test_scene(Scene& scene, int width, int height, int version) {
 
     scene.start_construction();
 
-    std::shared_ptr<Material> light = std::make_shared<EmissiveMaterial>(Color(1.0f, 1.0f, 1.0f) * 2.0f);
+    std::shared_ptr<Material> light = make_material<EmissiveMaterial>(Color(1.0f, 1.0f, 1.0f) * 2.0f);
 
     if(version == 0) { // Fully visible sphere
         scene.add_sphere(light, glm::vec3(0.0f, 0.0f, 0.0f), 0.5f);
@@ -73,9 +81,9 @@ void setup_balls_scene(Scene& scene, int version) {
 
     scene.start_construction();
 
-    std::shared_ptr<Material> white = std::make_shared<LambertMaterial>(Color(0.8f, 0.8f, 0.8f));
-    std::shared_ptr<Material> ground = std::make_shared<LambertMaterial>(Color(0.8f, 0.2f, 0.1f));
-    std::shared_ptr<Material> silver = std::make_shared<SmoothMetalMaterial>(Color(0.3f, 0.4f, 0.5f));
+    std::shared_ptr<Material> white = make_material<LambertMaterial>(Color(0.8f, 0.8f, 0.8f));
+    std::shared_ptr<Material> ground = make_material<LambertMaterial>(Color(0.8f, 0.2f, 0.1f));
+    std::shared_ptr<Material> silver = make_material<SmoothMetalMaterial>(Color(0.3f, 0.4f, 0.5f));
 
     // Ground
     scene.add_rectangle(ground, glm::vec3(0.0f, -1.0f, 0.0f), glm::vec2(100.0f, 100.0f), glm::vec3(0.0f, 0.0f, 0.0f)); 
@@ -113,10 +121,10 @@ void setup_city_scene(Scene& scene, int version) {
 
     scene.start_construction();
 
-    std::shared_ptr<Material> grey = std::make_shared<LambertMaterial>(Color(0.5f, 0.5f, 0.5f));
-    std::shared_ptr<Material> ground = std::make_shared<LambertMaterial>(Color(0.8f, 0.2f, 0.1f));
-    std::shared_ptr<Material> silver = std::make_shared<SmoothMetalMaterial>(Color(0.3f, 0.4f, 0.5f));
-    std::shared_ptr<Material> light = std::make_shared<EmissiveMaterial>(Color(1.0f, 1.0f, 1.0f) * 5.0f);
+    std::shared_ptr<Material> grey = make_material<LambertMaterial>(Color(0.5f, 0.5f, 0.5f));
+    std::shared_ptr<Material> ground = make_material<LambertMaterial>(Color(0.8f, 0.2f, 0.1f));
+    std::shared_ptr<Material> silver = make_material<SmoothMetalMaterial>(Color(0.3f, 0.4f, 0.5f));
+    std::shared_ptr<Material> light = make_material<EmissiveMaterial>(Color(1.0f, 1.0f, 1.0f) * 5.0f);
 
     float heights[] = {
         3, 1, 4, 5,
@@ -160,11 +168,11 @@ void setup_cornell_box_scene(Scene& scene, int version) {
 
     scene.start_construction();
 
-    std::shared_ptr<Material> white = std::make_shared<LambertMaterial>(Color(0.8f, 0.8f, 0.8f));
-    std::shared_ptr<Material> red = std::make_shared<LambertMaterial>(Color(0.8f, 0.0f, 0.0f));
-    std::shared_ptr<Material> green = std::make_shared<LambertMaterial>(Color(0.0f, 0.8f, 0.0f));
-    std::shared_ptr<Material> light = std::make_shared<EmissiveMaterial>(Color(1.0f, 1.0f, 1.0f) * 5.0f);
-    std::shared_ptr<Material> gold = std::make_shared<SmoothMetalMaterial>(Colors::YELLOW);
+    std::shared_ptr<Material> white = make_material<LambertMaterial>(Color(0.8f, 0.8f, 0.8f));
+    std::shared_ptr<Material> red = make_material<LambertMaterial>(Color(0.8f, 0.0f, 0.0f));
+    std::shared_ptr<Material> green = make_material<LambertMaterial>(Color(0.0f, 0.8f, 0.0f));
+    std::shared_ptr<Material> light = make_material<EmissiveMaterial>(Color(1.0f, 1.0f, 1.0f) * 5.0f);
+    std::shared_ptr<Material> gold = make_material<SmoothMetalMaterial>(Colors::YELLOW);
 
     // Back Face
     scene.add_rectangle(white, glm::vec3(0.0f, 0.0f, -1.0f), glm::vec2(2.0f, 2.0f), glm::vec3(glm::radians(90.0f), 0.0f, 0.0f));
@@ -277,8 +285,8 @@ void setup_special_scene(Scene& scene, const std::string& name) {
 
     scene.start_construction();
 
-    std::shared_ptr<Material> white = std::make_shared<LambertMaterial>(Color(0.8f, 0.8f, 0.8f));
-    std::shared_ptr<Material> light = std::make_shared<EmissiveMaterial>(Color(0.9f, 0.9f, 0.9f) * 5.0f);
+    std::shared_ptr<Material> white = make_material<LambertMaterial>(Color(0.8f, 0.8f, 0.8f));
+    std::shared_ptr<Material> light = make_material<EmissiveMaterial>(Color(0.9f, 0.9f, 0.9f) * 5.0f);
     
     int name_length = 0;
     while(name_length < name.length() && name[name_length] != '_') name_length++;
@@ -303,8 +311,8 @@ void setup_special_scene(Scene& scene, const std::string& name) {
     }
 
     
-    std::shared_ptr<Material> right_mat = std::make_shared<LambertMaterial>(convert_HSL_to_RGB(get_rand() / 32767.0f, 1.0f, 0.5f));
-    std::shared_ptr<Material> left_mat = std::make_shared<LambertMaterial>(convert_HSL_to_RGB(get_rand() / 32767.0f, 1.0f, 0.5f));
+    std::shared_ptr<Material> right_mat = make_material<LambertMaterial>(convert_HSL_to_RGB(get_rand() / 32767.0f, 1.0f, 0.5f));
+    std::shared_ptr<Material> left_mat = make_material<LambertMaterial>(convert_HSL_to_RGB(get_rand() / 32767.0f, 1.0f, 0.5f));
     
     // Back Face
     scene.add_rectangle(white, glm::vec3(0.0f, 0.0f, -50.0f), glm::vec2(100.0f, 100.0f), glm::vec3(glm::radians(90.0f), 0.0f, 0.0f));
@@ -326,12 +334,243 @@ void setup_special_scene(Scene& scene, const std::string& name) {
             Color color = convert_HSL_to_RGB(get_rand() / 32767.0f, 0.5f, 0.5f);
             std::shared_ptr<Material> sphere_mat;
             if(get_rand() % 2)
-                sphere_mat = std::make_shared<LambertMaterial>(color);
+                sphere_mat = make_material<LambertMaterial>(color);
             else 
-                sphere_mat = std::make_shared<SmoothMetalMaterial>(color);
+                sphere_mat = make_material<SmoothMetalMaterial>(color);
             scene.add_sphere(sphere_mat, glm::vec3(x, y, z), radius);
         }
     }
 
     scene.finish_construction();
-}
\ No newline at end of file
+}
+
+bool setup_model_scene(Scene& scene, const std::string& path, std::string& error) {
+    std::vector<glm::vec3> vertices;
+    std::vector<uint32_t> indices;
+    if(!load_mesh_file(path, vertices, indices, error)) return false;
+
+    scene.set_background(std::make_shared<SkyBackground>(
+        Color(0.4f, 0.5f, 1.0f) * 2.0f, 
+        Color(0.4f, 0.3f, 0.8f), 
+        Color(0.2f, 0.2f, 0.3f),
+        Color(1.0f, 0.9f, 0.9f) * 50.0f,
+        glm::vec3(1.0f, 1.0f, -1.0f),
+        glm::radians(30.0f)
+    ));
+
+    scene.start_construction();
+
+    std::shared_ptr<Material> white = make_material<LambertMaterial>(Color(0.8f, 0.8f, 0.8f));
+    std::shared_ptr<Material> ground = make_material<LambertMaterial>(Color(0.8f, 0.2f, 0.1f));
+
+    AABB bounds = scene.add_mesh(white, std::move(vertices), std::move(indices))->get_bounds();
+    // The camera looks at the center of the model from a distance where its bounding sphere fills the view.
+    glm::vec3 center = 0.5f * (bounds.vmin + bounds.vmax);
+    float radius = glm::max(0.5f * glm::length(bounds.vmax - bounds.vmin), 1e-3f);
+    scene.set_camera(Camera (
+        center + glm::normalize(glm::vec3(0.5f, 0.4f, 1.0f)) * radius * 2.5f,
+        center,
+        glm::vec3(0.0f, 1.0f, 0.0f),
+        glm::radians(45.0f),
+        glm::ivec2(256, 256)
+    ));
+    // Ground
+    scene.add_rectangle(ground, glm::vec3(center.x, bounds.vmin.y, center.z), glm::vec2(radius * 100.0f), glm::vec3(0.0f, 0.0f, 0.0f));
+
+    scene.finish_construction();
+    return true;
+}
+
+// The sky and the materials shared by the generated scenes: 6 diffuse and 2 metal colors, picked at random for each primitive.
+static std::vector<std::shared_ptr<Material>> setup_generated_materials(Scene& scene, std::mt19937& rng) {
+    scene.set_background(std::make_shared<SkyBackground>(
+        Color(0.4f, 0.5f, 1.0f) * 2.0f, 
+        Color(0.4f, 0.3f, 0.8f), 
+        Color(0.2f, 0.2f, 0.3f),
+        Color(1.0f, 0.9f, 0.9f) * 50.0f,
+        glm::vec3(1.0f, 1.0f, -1.0f),
+        glm::radians(30.0f)
+    ));
+    std::vector<std::shared_ptr<Material>> palette;
+    for(int index = 0; index < 8; ++index) {
+        Color color = convert_HSL_to_RGB(get_random_unit(rng), 0.5f, 0.5f);
+        if(index < 6) palette.push_back(make_material<LambertMaterial>(color));
+        else palette.push_back(make_material<SmoothMetalMaterial>(color));
+    }
+    return palette;
+}
+
+// Random spheres in a cube whose volume grows with their count, so that their density (and the length of the rays) stays the same.
+static void setup_sphere_field_scene(Scene& scene, uint64_t sphere_count) {
+    std::mt19937 rng(1);
+    std::vector<std::shared_ptr<Material>> palette = setup_generated_materials(scene, rng);
+    float size = 3.0f * std::cbrt(static_cast<float>(sphere_count));
+    scene.set_camera(Camera (
+        glm::vec3(1.4f, 1.1f, 1.8f) * size,
+        glm::vec3(0.5f) * size,
+        glm::vec3(0.0f, 1.0f, 0.0f),
+        glm::radians(50.0f),
+        glm::ivec2(256, 256)
+    ));
+
+    scene.start_construction();
+    for(uint64_t index = 0; index < sphere_count; ++index) {
+        // The values are drawn one statement at a time, since the order in which function arguments are evaluated is unspecified.
+        float x = get_random_unit(rng);
+        float y = get_random_unit(rng);
+        float z = get_random_unit(rng);
+        glm::vec3 center = glm::vec3(x, y, z) * size;
+        float radius = glm::mix(0.5f, 1.0f, get_random_unit(rng));
+        scene.add_sphere(palette[rng() % palette.size()], center, radius);
+    }
+    scene.finish_construction();
+}
+
+// A height field of 100x100 units made of a single mesh, tessellated more finely as the triangle count grows (so the image stays the same).
+// The heights are a sum of sine waves with random directions and phases, each twice as fine and half as high as the previous one.
+static void setup_terrain_scene(Scene& scene, uint64_t triangle_count) {
+    std::mt19937 rng(2);
+    std::vector<std::shared_ptr<Material>> palette = setup_generated_materials(scene, rng);
+    scene.set_camera(Camera (
+        glm::vec3(0.0f, 30.0f, 70.0f),
+        glm::vec3(0.0f, 0.0f, 0.0f),
+        glm::vec3(0.0f, 1.0f, 0.0f),
+        glm::radians(60.0f),
+        glm::ivec2(256, 256)
+    ));
+
+    struct Wave { glm::vec2 direction; float frequency, amplitude, phase; };
+    std::vector<Wave> waves;
+    for(int octave = 0; octave < 8; ++octave) {
+        float angle = glm::two_pi<float>() * get_random_unit(rng);
+        float phase = glm::two_pi<float>() * get_random_unit(rng);
+        waves.push_back({ glm::vec2(glm::cos(angle), glm::sin(angle)), 0.06f * (1 << octave), 6.0f / (1 << octave), phase });
+    }
+
+    // A grid of quads of 2 triangles each.
+    const float SIZE = 100.0f;
+    uint32_t resolution = std::max(1u, static_cast<uint32_t>(std::sqrt(triangle_count / 2.0)));
+    std::vector<glm::vec3> vertices;
+    vertices.reserve(static_cast<size_t>(resolution + 1) * (resolution + 1));
+    for(uint32_t z = 0; z <= resolution; ++z) {
+        for(uint32_t x = 0; x <= resolution; ++x) {
+            glm::vec2 position = (glm::vec2(x, z) / static_cast<float>(resolution) - 0.5f) * SIZE;
+            float height = 0.0f;
+            for(const Wave& wave: waves) height += wave.amplitude * glm::sin(wave.frequency * glm::dot(wave.direction, position) + wave.phase);
+            vertices.push_back(glm::vec3(position.x, height, position.y));
+        }
+    }
+    std::vector<uint32_t> indices;
+    indices.reserve(static_cast<size_t>(resolution) * resolution * 6);
+    for(uint32_t z = 0; z < resolution; ++z) {
+        for(uint32_t x = 0; x < resolution; ++x) {
+            uint32_t corner = z * (resolution + 1) + x;
+            indices.insert(indices.end(), { corner, corner + resolution + 1, corner + 1 });
+            indices.insert(indices.end(), { corner + 1, corner + resolution + 1, corner + resolution + 2 });
+        }
+    }
+
+    scene.start_construction();
+    scene.add_mesh(palette[0], std::move(vertices), std::move(indices));
+    scene.finish_construction();
+}
+
+// A square city of blocks of 4x4 buildings separated by streets, with as many blocks as needed for the triangle count
+// (each building is a cuboid of 12 triangles of random footprint and height), on a ground plane.
+static void setup_city_blocks_scene(Scene& scene, uint64_t triangle_count) {
+    std::mt19937 rng(3);
+    std::vector<std::shared_ptr<Material>> palette = setup_generated_materials(scene, rng);
+    const int BLOCK_BUILDINGS = 4;
+    const float LOT_SIZE = 2.0f, STREET_WIDTH = 3.0f, BLOCK_SIZE = BLOCK_BUILDINGS * LOT_SIZE + STREET_WIDTH;
+    uint64_t building_count = std::max<uint64_t>(1, triangle_count / 12);
+    int block_count = static_cast<int>(std::ceil(std::sqrt(building_count / double(BLOCK_BUILDINGS * BLOCK_BUILDINGS))));
+    float city_size = block_count * BLOCK_SIZE;
+    scene.set_camera(Camera (
+        glm::vec3(-0.3f, 0.5f, 0.9f) * city_size + glm::vec3(0.0f, 10.0f, 10.0f),
+        glm::vec3(0.0f, 0.0f, 0.0f),
+        glm::vec3(0.0f, 1.0f, 0.0f),
+        glm::radians(60.0f),
+        glm::ivec2(256, 256)
+    ));
+
+    scene.start_construction();
+    std::shared_ptr<Material> ground = make_material<LambertMaterial>(Color(0.3f, 0.3f, 0.3f));
+    scene.add_rectangle(ground, glm::vec3(0.0f), glm::vec2(city_size * 4.0f), glm::vec3(0.0f));
+    uint64_t building = 0;
+    for(int block = 0; block < block_count * block_count && building < building_count; ++block) {
+        glm::vec2 block_corner = glm::vec2(block % block_count, block / block_count) * BLOCK_SIZE - 0.5f * city_size + 0.5f * STREET_WIDTH;
+        for(int lot = 0; lot < BLOCK_BUILDINGS * BLOCK_BUILDINGS && building < building_count; ++lot, ++building) {
+            glm::vec2 center = block_corner + (glm::vec2(lot % BLOCK_BUILDINGS, lot / BLOCK_BUILDINGS) + 0.5f) * LOT_SIZE;
+            float width = glm::mix(0.6f, 0.9f, get_random_unit(rng));
+            float depth = glm::mix(0.6f, 0.9f, get_random_unit(rng));
+            glm::vec2 footprint = glm::vec2(width, depth) * LOT_SIZE;
+            // Mostly low buildings, with a few towers.
+            float unit = get_random_unit(rng);
+            float height = glm::mix(1.0f, 12.0f, unit * unit * unit);
+            scene.add_cuboid(palette[rng() % palette.size()], glm::vec3(center.x, 0.5f * height, center.y), glm::vec3(footprint.x, height, footprint.y));
+        }
+    }
+    scene.finish_construction();
+}
+
+bool setup_generated_scene(Scene& scene, const std::string& name) {
+    size_t separator = name.find('-');
+    if(separator == std::string::npos) return false;
+    std::string type = name.substr(0, separator);
+    const char* count_begin = name.c_str() + separator + 1;
+    char* count_end = nullptr;
+    double count = std::strtod(count_begin, &count_end);
+    if(count_end == count_begin || *count_end != '\0' || !(count >= 1.0 && count <= MAX_GENERATED_PRIMITIVES)) return false;
+
+    uint64_t primitive_count = static_cast<uint64_t>(count);
+    if(type == "spheres") setup_sphere_field_scene(scene, primitive_count);
+    else if(type == "terrain") setup_terrain_scene(scene, primitive_count);
+    else if(type == "blocks") setup_city_blocks_scene(scene, primitive_count);
+    else return false;
+    return true;
+}
+
+// The built-in scenes and the setup function of each of them.
+struct BuiltinScene {
+    std::string name;
+    std::function<void(Scene&)> setup;
+};
+
+static const std::vector<BuiltinScene>& get_builtin_scenes() {
+    static const std::vector<BuiltinScene> scenes = [] {
+        std::vector<BuiltinScene> scenes;
+        // Triangle & Sphere Tests (version x, at 4x4 then 128x128)
+        for(int version = 0; version < 4; ++version) {
+            for(int size: { 4, 128 }) {
+                std::string suffix = std::to_string(version) + (size == 4 ? ".0" : ".1");
+                scenes.push_back({ "tri_test" + suffix, [=](Scene& scene) { setup_triangle_test_scene(scene, size, size, version); } });
+                scenes.push_back({ "sph_test" + suffix, [=](Scene& scene) { setup_sphere_test_scene(scene, size, size, version); } });
+            }
+        }
+        // Balls, City & Cornell Box scenes
+        for(int version = 0; version < 3; ++version) scenes.push_back({ "balls" + std::to_string(version), [=](Scene& scene) { setup_balls_scene(scene, version); } });
+        for(int version = 0; version < 4; ++version) scenes.push_back({ "city" + std::to_string(version), [=](Scene& scene) { setup_city_scene(scene, version); } });
+        for(int version = 0; version < 4; ++version) scenes.push_back({ "cornell_box" + std::to_string(version), [=](Scene& scene) { setup_cornell_box_scene(scene, version); } });
+        return scenes;
+    }();
+    return scenes;
+}
+
+const std::vector<std::string>& get_builtin_scene_names() {
+    static const std::vector<std::string> names = [] {
+        std::vector<std::string> names;
+        for(const BuiltinScene& scene: get_builtin_scenes()) names.push_back(scene.name);
+        return names;
+    }();
+    return names;
+}
+
+bool setup_builtin_scene(Scene& scene, const std::string& name) {
+    for(const BuiltinScene& builtin_scene: get_builtin_scenes()) {
+        if(builtin_scene.name == name) {
+            builtin_scene.setup(scene);
+            return true;
+        }
+    }
+    return false;
+}
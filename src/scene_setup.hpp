@@ -3,6 +3,8 @@
 #include <scene.hpp>
 
 #include <string>
+#include <vector>
+#include <random>
 
 void setup_triangle_test_scene(Scene& scene, int width, int height, int version);
 void setup_sphere_test_scene(Scene& scene, int width, int height, int version);
@@ -10,4 +12,29 @@ void setup_sphere_test_scene(Scene& scene, int width, int height, int version);
 void setup_balls_scene(Scene& scene, int version);
 void setup_city_scene(Scene& scene, int version);
 void setup_cornell_box_scene(Scene& scene, int version);
-void setup_special_scene(Scene& scene, const std::string& name);
\ No newline at end of file
+void setup_special_scene(Scene& scene, const std::string& name);
+// Sets up a scene showing the model of a .obj or .ply file on a ground plane, with the camera framing it.
+// Returns false and sets `error` if the model could not be loaded.
+bool setup_model_scene(Scene& scene, const std::string& path, std::string& error);
+
+// Returns a random number in [0, 1) from the raw output of the generator, which (unlike the standard distributions)
+// is the same with every standard library, so that the generated scenes and the benchmark rays are the same everywhere.
+// Draw the values of a vector one statement at a time: the order in which function arguments are evaluated is unspecified.
+inline float get_random_unit(std::mt19937& rng) {
+    return (rng() >> 8) * (1.0f / 16777216.0f);
+}
+
+// The largest primitive count of the generated scenes.
+constexpr double MAX_GENERATED_PRIMITIVES = 1e9;
+// Sets up a generated scene for stress tests, named after its type and its primitive count (e.g. spheres-1e6 or terrain-250000):
+// - spheres: random spheres spread evenly in a cube
+// - terrain: a height field made of a single triangle mesh
+// - blocks: a city of cuboid buildings (12 triangles each)
+// The scenes are generated from fixed seeds, so that the build time, the traversal cost and the memory can be compared across sizes and runs.
+// Returns false if the name is not a valid generated scene name.
+bool setup_generated_scene(Scene& scene, const std::string& name);
+
+// Returns the names of the built-in scenes (the triangle & sphere tests, balls, city and cornell box scenes).
+const std::vector<std::string>& get_builtin_scene_names();
+// Sets up the built-in scene with the given name. Returns false if there is no built-in scene with this name.
+bool setup_builtin_scene(Scene& scene, const std::string& name);
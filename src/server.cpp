@@ -0,0 +1,347 @@
+#include "server.hpp"
+
+#ifdef _WIN32
+
+bool run_render_server(const RenderServerSettings& settings, std::string& error) {
+    error = "the render server needs Unix domain sockets, which are not supported on Windows";
+    return false;
+}
+
+#else
+
+#include "pathtracer.hpp"
+#include "mesh.hpp"
+
+#include <glm.hpp>
+
+#include <list>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <optional>
+#include <condition_variable>
+
+#include <signal.h>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/socket.h>
+
+// A scene kept in memory by the server, with the camera it was loaded with (each render overrides a copy of it).
+struct ResidentScene {
+    std::string name;
+    Scene scene;
+    Camera camera;
+    size_t memory_size = 0;
+    std::mutex render_mutex; // Held by the render using the scene, since it sets the camera of the scene.
+};
+
+// Estimates the memory used by a scene from its arena (shapes and acceleration structure) and its meshes.
+static size_t estimate_scene_memory(const Scene& scene) {
+    size_t memory_size = scene.get_arena_capacity() + scene.get_shapes().capacity() * sizeof(Shape*);
+    for(const Shape* shape: scene.get_shapes()) {
+        if(auto mesh = dynamic_cast<const TriangleMesh*>(shape)) memory_size += mesh->get_memory_size();
+    }
+    return memory_size;
+}
+
+// The resident scenes, unloaded in least recently used order when they use more memory than the cap.
+// A render keeps its scene alive even if it is unloaded in the meantime, so the cap may be exceeded while it finishes.
+class SceneCache {
+public:
+    explicit SceneCache(const RenderServerSettings& settings): settings(settings) {}
+
+    // Returns the resident scene with the given name, loading it if needed. Returns null and sets `error` if it could not be loaded.
+    std::shared_ptr<ResidentScene> get(const std::string& name, std::string& error) {
+        if(auto resident = find(name)) return resident;
+        // The scene is loaded without holding the lock, so the other clients are not blocked by a large scene.
+        // If two clients load the same scene at once, the second copy is dropped.
+        auto start = std::chrono::high_resolution_clock::now();
+        auto resident = std::make_shared<ResidentScene>();
+        resident->name = name;
+        if(!settings.load_scene(name, resident->scene, error)) return nullptr;
+        resident->camera = resident->scene.get_camera();
+        resident->memory_size = estimate_scene_memory(resident->scene);
+        std::chrono::duration<double> seconds_duration = std::chrono::high_resolution_clock::now() - start;
+        printf("Loaded scene %s in %.3f seconds (%.1f MB)\n", name.c_str(), seconds_duration.count(), resident->memory_size / 1048576.0);
+
+        std::lock_guard lock(mutex);
+        for(const auto& other: scenes) {
+            if(other->name == name) return other;
+        }
+        scenes.push_front(resident);
+        memory_size += resident->memory_size;
+        // The scene just loaded is never unloaded, even if it is larger than the cap on its own.
+        while(memory_size > settings.memory_cap && scenes.size() > 1) {
+            printf("Unloaded scene %s (%.1f MB)\n", scenes.back()->name.c_str(), scenes.back()->memory_size / 1048576.0);
+            memory_size -= scenes.back()->memory_size;
+            scenes.pop_back();
+        }
+        return resident;
+    }
+
+    // Returns the names and the memory sizes of the resident scenes, the most recently used first.
+    std::vector<std::pair<std::string, size_t>> get_resident_scenes() {
+        std::lock_guard lock(mutex);
+        std::vector<std::pair<std::string, size_t>> resident_scenes;
+        for(const auto& resident: scenes) resident_scenes.push_back({ resident->name, resident->memory_size });
+        return resident_scenes;
+    }
+
+private:
+    const RenderServerSettings& settings;
+    std::mutex mutex;
+    std::list<std::shared_ptr<ResidentScene>> scenes; // The most recently used first.
+    size_t memory_size = 0;
+
+    // Returns the resident scene with the given name (and marks it as the most recently used), or null if it is not resident.
+    std::shared_ptr<ResidentScene> find(const std::string& name) {
+        std::lock_guard lock(mutex);
+        for(auto it = scenes.begin(); it != scenes.end(); ++it) {
+            if((*it)->name != name) continue;
+            scenes.splice(scenes.begin(), scenes, it);
+            return scenes.front();
+        }
+        return nullptr;
+    }
+};
+
+// A client connection, which is read line by line.
+class Connection {
+public:
+    explicit Connection(int fd): fd(fd) {}
+    ~Connection() { close(fd); }
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    // Reads the next line (without its line break). Returns false when the client closed the connection.
+    bool read_line(std::string& line) {
+        while(true) {
+            size_t end = buffer.find('\n');
+            if(end != std::string::npos) {
+                line = buffer.substr(0, end);
+                if(!line.empty() && line.back() == '\r') line.pop_back();
+                buffer.erase(0, end + 1);
+                return true;
+            }
+            char data[4096];
+            ssize_t size = recv(fd, data, sizeof(data), 0);
+            if(size < 0 && errno == EINTR) continue;
+            if(size <= 0) return false;
+            buffer.append(data, size);
+        }
+    }
+
+    // Sends a line to the client. Once the client is gone, the lines are dropped (a render still finishes and writes its output).
+    void send_line(const std::string& line) {
+        std::string data = line + "\n";
+        for(size_t sent = 0; connected && sent < data.size();) {
+            ssize_t size = send(fd, data.data() + sent, data.size() - sent, 0);
+            if(size < 0 && errno == EINTR) continue;
+            if(size <= 0) connected = false;
+            else sent += size;
+        }
+    }
+
+private:
+    int fd;
+    std::string buffer;
+    bool connected = true;
+};
+
+// A render request, with the overrides of the camera of the scene.
+struct RenderRequest {
+    std::string scene_name;
+    std::string output_path;
+    uint32_t sample_count, max_bounces;
+    std::optional<glm::vec3> eye, target, up;
+    std::optional<float> fovy; // In degrees.
+    std::optional<glm::ivec2> resolution;
+    double progress_interval = 1.0;
+};
+
+// Parses the arguments of a render request: the scene name then key=value pairs.
+static bool parse_render_request(std::stringstream& stream, const RenderServerSettings& settings, RenderRequest& request, std::string& error) {
+    if(!(stream >> request.scene_name)) {
+        error = "missing scene name";
+        return false;
+    }
+    request.output_path = request.scene_name + ".png";
+    request.sample_count = settings.sample_count;
+    request.max_bounces = settings.max_bounces;
+    std::string argument;
+    while(stream >> argument) {
+        size_t separator = argument.find('=');
+        std::string key = argument.substr(0, separator);
+        std::string value = separator == std::string::npos ? "" : argument.substr(separator + 1);
+        glm::vec3 vector;
+        glm::ivec2 size;
+        int count = std::atoi(value.c_str());
+        float number = static_cast<float>(std::atof(value.c_str()));
+        bool valid = !value.empty();
+        if(key == "output") request.output_path = value;
+        else if(key == "samples") {
+            valid = valid && count > 0;
+            request.sample_count = count;
+        } else if(key == "bounces") {
+            valid = valid && count > 0;
+            request.max_bounces = count;
+        } else if(key == "progress") {
+            valid = valid && number >= 0.0f;
+            request.progress_interval = number;
+        } else if(key == "fov") {
+            valid = valid && number > 0.0f && number < 180.0f;
+            request.fovy = number;
+        } else if(key == "resolution") {
+            valid = valid && std::sscanf(value.c_str(), "%dx%d", &size.x, &size.y) == 2 && size.x > 0 && size.y > 0;
+            request.resolution = size;
+        } else if(key == "eye" || key == "target" || key == "up") {
+            valid = valid && std::sscanf(value.c_str(), "%f,%f,%f", &vector.x, &vector.y, &vector.z) == 3;
+            (key == "eye" ? request.eye : key == "target" ? request.target : request.up) = vector;
+        } else {
+            error = "unknown argument: " + key;
+            return false;
+        }
+        if(!valid) {
+            error = "invalid value for " + key + ": " + value;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Renders a request on its resident scene, streaming the progress to the client.
+static void serve_render(Connection& connection, SceneCache& cache, const RenderRequest& request) {
+    std::string error;
+    std::shared_ptr<ResidentScene> resident = cache.get(request.scene_name, error);
+    if(!resident) {
+        connection.send_line("error could not load the scene: " + error);
+        return;
+    }
+    std::lock_guard lock(resident->render_mutex);
+    const Camera& base = resident->camera;
+    resident->scene.set_camera(Camera(request.eye.value_or(base.get_position()), request.target.value_or(base.get_look_at()), request.up.value_or(base.get_up()),
+        request.fovy ? glm::radians(*request.fovy) : base.get_fovy(), request.resolution.value_or(base.get_viewport_size())));
+
+    printf("Rendering %s to %s (%u samples, %u bounces)\n", request.scene_name.c_str(), request.output_path.c_str(), request.sample_count, request.max_bounces);
+    double last_progress = 0.0;
+    PathTracerOptions options;
+    options.on_sample = [&](uint32_t sample_count, double seconds, const Image& image) {
+        if(request.progress_interval <= 0.0 || seconds - last_progress < request.progress_interval || sample_count == request.sample_count) return;
+        last_progress = seconds;
+        if(image.save(request.output_path)) connection.send_line("progress " + std::to_string(sample_count) + " " + std::to_string(seconds));
+    };
+    auto start = std::chrono::high_resolution_clock::now();
+    Image result = path_trace(resident->scene, request.sample_count, request.max_bounces, options);
+    std::chrono::duration<double> seconds_duration = std::chrono::high_resolution_clock::now() - start;
+    if(!result.save(request.output_path)) {
+        connection.send_line("error could not write " + request.output_path);
+        return;
+    }
+    connection.send_line("done " + std::to_string(request.sample_count) + " " + std::to_string(seconds_duration.count()) + " " + request.output_path);
+}
+
+bool run_render_server(const RenderServerSettings& settings, std::string& error) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if(settings.socket_path.size() >= sizeof(address.sun_path)) {
+        error = "the socket path is too long: " + settings.socket_path;
+        return false;
+    }
+    std::strcpy(address.sun_path, settings.socket_path.c_str());
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listen_fd < 0) {
+        error = std::string("could not create the socket: ") + std::strerror(errno);
+        return false;
+    }
+    // A socket file left by a previous server would make bind fail.
+    unlink(settings.socket_path.c_str());
+    if(bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listen_fd, 16) < 0) {
+        error = "could not listen on " + settings.socket_path + ": " + std::strerror(errno);
+        close(listen_fd);
+        return false;
+    }
+    // The writes to a client which disconnected must fail instead of killing the server.
+    signal(SIGPIPE, SIG_IGN);
+    printf("Listening on %s (memory cap: %.0f MB)\n", settings.socket_path.c_str(), settings.memory_cap / 1048576.0);
+
+    SceneCache cache(settings);
+    std::atomic<bool> stopping = false;
+    std::mutex clients_mutex;
+    std::condition_variable clients_done;
+    std::vector<int> client_fds; // The connections being served (guarded by clients_mutex).
+
+    // The accept call is woken up by connecting to the server once stopping is set.
+    auto stop = [&]() {
+        stopping = true;
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(fd >= 0) {
+            connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+            close(fd);
+        }
+    };
+    auto serve_client = [&](Connection& connection) {
+        std::string line;
+        while(connection.read_line(line)) {
+            std::stringstream stream(line);
+            std::string command;
+            if(!(stream >> command)) continue;
+            if(command == "render") {
+                RenderRequest request;
+                std::string request_error;
+                if(parse_render_request(stream, settings, request, request_error)) serve_render(connection, cache, request);
+                else connection.send_line("error " + request_error);
+            } else if(command == "status") {
+                for(const auto& [name, memory_size]: cache.get_resident_scenes()) connection.send_line("scene " + name + " " + std::to_string(memory_size / 1048576.0));
+                connection.send_line("done");
+            } else if(command == "shutdown") {
+                connection.send_line("done");
+                stop();
+                break;
+            } else {
+                connection.send_line("error unknown command: " + command);
+            }
+        }
+    };
+
+    while(true) {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if(stopping) {
+            if(fd >= 0) close(fd);
+            break;
+        }
+        if(fd < 0) {
+            if(errno == EINTR || errno == ECONNABORTED) continue;
+            error = std::string("could not accept a client: ") + std::strerror(errno);
+            break;
+        }
+        std::lock_guard lock(clients_mutex);
+        client_fds.push_back(fd);
+        std::thread([&, fd]() {
+            // The connection is closed after it is removed from the list, so its descriptor cannot be reused while it is listed.
+            Connection connection(fd);
+            serve_client(connection);
+            std::lock_guard lock(clients_mutex);
+            client_fds.erase(std::find(client_fds.begin(), client_fds.end(), fd));
+            clients_done.notify_all();
+        }).detach();
+    }
+
+    // Hang up on the idle clients, then wait for the renders in flight before the scenes are destroyed.
+    std::unique_lock lock(clients_mutex);
+    for(int fd: client_fds) shutdown(fd, SHUT_RD);
+    clients_done.wait(lock, [&]() { return client_fds.empty(); });
+    close(listen_fd);
+    unlink(settings.socket_path.c_str());
+    printf("Server stopped\n");
+    return error.empty();
+}
+
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <scene.hpp>
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+
+// The settings of the render server, which keeps the scenes (and their acceleration structures) in memory between renders.
+struct RenderServerSettings {
+    std::string socket_path = "pathtracer.sock";
+    // The least recently used scenes are unloaded when the resident scenes use more than this many bytes.
+    size_t memory_cap = size_t(1) << 30;
+    // The defaults of the render requests.
+    uint32_t sample_count = 1000, max_bounces = 5;
+    // Sets up the scene with the given name (as written in the request). Returns false and sets `error` if it failed.
+    std::function<bool(const std::string& scene_name, Scene& scene, std::string& error)> load_scene;
+};
+
+// Listens on a Unix domain socket and renders the requests of the clients until one of them asks for a shutdown.
+// The clients are served concurrently, each connection sending one request per line and receiving one reply per line:
+//   render scene-name [output=path] [samples=n] [bounces=n] [eye=x,y,z] [target=x,y,z] [up=x,y,z] [fov=degrees]
+//          [resolution=WxH] [progress=seconds]
+//     renders the scene (loading it unless it is resident) with the camera overrides. Every `progress` seconds
+//     (default 1, 0 to disable) the current image is written to the output path and "progress samples seconds" is sent.
+//     The render ends with "done samples seconds output-path", or "error message" if it failed.
+//   status
+//     sends "scene name megabytes" for each resident scene, then "done".
+//   shutdown
+//     stops accepting clients, waits for the renders in flight, then returns from run_render_server.
+// The renders of different scenes run at the same time on the shared thread pool. The renders of the same scene wait for
+// each other, since the camera belongs to the scene.
+// Returns false and sets `error` if the socket could not be opened (or on Windows, which has no Unix domain sockets here).
+bool run_render_server(const RenderServerSettings& settings, std::string& error);
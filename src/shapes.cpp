@@ -1,5 +1,17 @@
 #include "shapes.hpp"
 
+bool intersect_triangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, const Ray& ray, RayHit& hit) {
+    //TODO: implement ray intersection test for triangle.
+    // Remember to return the hit distance and normal in hit if the ray intersects the triangle. 
+    return false;
+}
+
+bool intersect_sphere(const glm::vec3& center, float radius, const Ray& ray, RayHit& hit) {
+    //TODO: Implement ray intersection test with sphere.
+    // Remember to return the hit distance and normal in hit if the ray intersects the sphere.
+    return false; 
+}
+
 Triangle::Triangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, const std::shared_ptr<Material>& material) : 
     v0(v0), v1(v1), v2(v2), Shape(material) {
     // Compute the AABB for the triangle.
@@ -10,9 +22,9 @@ Triangle::Triangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2
 }
 
 bool Triangle::intersect(const Ray& ray, RayHit& hit) const {
-    //TODO: implement ray intersection test for triangle.
-    // Remember to return the hit distance, normal and material in hit if the ray intersects the triangle. 
-    return false;
+    if(!intersect_triangle(v0, v1, v2, ray, hit)) return false;
+    hit.material = material;
+    return true;
 }
 
 Sphere::Sphere(const glm::vec3& center, float radius, const std::shared_ptr<Material>& material) : 
@@ -23,7 +35,7 @@ Sphere::Sphere(const glm::vec3& center, float radius, const std::shared_ptr<Mate
 }
 
 bool Sphere::intersect(const Ray& ray, RayHit& hit) const {
-    //TODO: Implement ray intersection test with sphere.
-    // Remember to return the hit distance, normal and material in hit if the ray intersects the sphere.
-    return false; 
+    if(!intersect_sphere(center, radius, ray, hit)) return false;
+    hit.material = material;
+    return true;
 }
\ No newline at end of file
@@ -11,21 +11,35 @@
 struct RayHit {
     float distance; // The distance from the origin of the ray to the hit point.
     glm::vec3 normal; // The surface normal at the hit point.
-    std::weak_ptr<Material> material; // The surface material at the hit point.
+    const Material* material = nullptr; // The surface material at the hit point.
+    int32_t material_id = -1; // The id of the surface material in the scene's material table (filled by the scene, not the shapes).
 };
 
+// Intersects a ray with the triangle (v0, v1, v2) and returns true if the ray intersects it.
+// On a hit, only hit.distance and hit.normal are filled (the material is filled by the caller).
+bool intersect_triangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, const Ray& ray, RayHit& hit);
+// Intersects a ray with the sphere and returns true if the ray intersects it.
+// On a hit, only hit.distance and hit.normal are filled (the material is filled by the caller).
+bool intersect_sphere(const glm::vec3& center, float radius, const Ray& ray, RayHit& hit);
+
 // The base class of all shapes
+// The shapes only keep a plain pointer to their material, so whoever creates them must keep the material alive (the Scene does).
+// They have no virtual destructor since they are allocated in the scene's arena, which never deletes them one by one.
 class Shape {
 public:
-    Shape(const std::shared_ptr<Material>& material) : material(material) {}
+    Shape(const std::shared_ptr<Material>& material) : material(material.get()) {}
     inline AABB get_bounds() const { return bounds; }
+    inline const Material* get_material() const { return material; }
+    inline int32_t get_material_id() const { return material_id; }
+    inline void set_material_id(int32_t id) { material_id = id; }
     
     // Intersects a ray with the shape and returns true if the ray intersects it.
     // hit will contain the hit information if the ray intersects the shape.
     virtual bool intersect(const Ray& ray, RayHit& hit) const = 0;
 
 protected:
-    std::shared_ptr<Material> material; // The material of the shape.
+    const Material* material; // The material of the shape.
+    int32_t material_id = -1; // The id of the material in the scene's material table.
     AABB bounds; // The AABB encompassing the shape.
 };
 
@@ -34,6 +48,7 @@ class Triangle : public Shape {
 public:
     Triangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, const std::shared_ptr<Material>& material);
     bool intersect(const Ray& ray, RayHit& hit) const override;
+    inline const glm::vec3& get_vertex(int index) const { return index == 0 ? v0 : (index == 1 ? v1 : v2); }
 private:
     // The three vertices of the triangle.
     glm::vec3 v0, v1, v2;
@@ -44,6 +59,8 @@ class Sphere : public Shape {
 public:
     Sphere(const glm::vec3& center, float radius, const std::shared_ptr<Material>& material);
     bool intersect(const Ray& ray, RayHit& hit) const override;
+    inline const glm::vec3& get_center() const { return center; }
+    inline float get_radius() const { return radius; }
 private:
     // The center and radius of the sphere.
     glm::vec3 center;
@@ -0,0 +1,169 @@
+#include "tile_cache.hpp"
+#include "compiled_scene.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+
+// Hashes values with the 64-bit FNV-1a hash, which is fast enough to go over the geometry of large scenes.
+class Hasher {
+public:
+    inline void add_bytes(const void* data, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for(size_t index = 0; index < size; ++index) hash = (hash ^ bytes[index]) * 0x100000001b3ull;
+    }
+    template<typename T>
+    inline void add(const T& value) { add_bytes(&value, sizeof(T)); }
+    inline uint64_t get() const { return hash; }
+
+private:
+    uint64_t hash = 0xcbf29ce484222325ull;
+};
+
+uint64_t compute_scene_hash(const Scene& scene) {
+    Hasher hasher;
+    for(const MaterialRecord& record: scene.get_materials().get_records()) {
+        hasher.add(record.color);
+        hasher.add(record.type);
+    }
+
+    if(const CompiledScene* compiled_scene = scene.get_compiled_scene()) {
+        std::span<const CompiledPrimitive> primitives = compiled_scene->get_primitives();
+        hasher.add_bytes(primitives.data(), primitives.size_bytes());
+    }
+    // The shapes are hashed in their order in the scene, which follows the BVH leaves, so the same scene built
+    // with another accelerator (or leaf size) has another hash. The cache is keyed by the settings of the render anyway.
+    for(const Shape* shape: scene.get_shapes()) {
+        hasher.add(shape->get_material_id());
+        if(auto sphere = dynamic_cast<const Sphere*>(shape)) {
+            hasher.add(sphere->get_center());
+            hasher.add(sphere->get_radius());
+        } else if(auto triangle = dynamic_cast<const Triangle*>(shape)) {
+            for(int vertex = 0; vertex < 3; ++vertex) hasher.add(triangle->get_vertex(vertex));
+        } else if(auto mesh = dynamic_cast<const TriangleMesh*>(shape)) {
+            for(size_t vertex = 0; vertex < mesh->get_vertex_count(); ++vertex) hasher.add(mesh->get_position(static_cast<uint32_t>(vertex)));
+            std::span<const uint32_t> indices = mesh->get_indices();
+            hasher.add_bytes(indices.data(), indices.size_bytes());
+        } else {
+            // An unknown shape only contributes its bounds.
+            hasher.add(shape->get_bounds());
+        }
+    }
+
+    // Any background is hashed through its colors in a fixed set of directions (the axes and the diagonals),
+    // and the known backgrounds through their parameters too.
+    if(std::shared_ptr<Background> background = scene.get_background()) {
+        for(int z = -1; z <= 1; ++z) {
+            for(int y = -1; y <= 1; ++y) {
+                for(int x = -1; x <= 1; ++x) {
+                    if(x == 0 && y == 0 && z == 0) continue;
+                    hasher.add(background->sample(glm::normalize(glm::vec3(x, y, z))));
+                }
+            }
+        }
+        if(auto sky = dynamic_cast<const SkyBackground*>(background.get())) {
+            hasher.add(sky->get_sun_direction());
+            hasher.add(sky->get_sun_angle());
+            hasher.add(sky->get_sun_feathering());
+        }
+    }
+    return hasher.get();
+}
+
+uint64_t compute_view_hash(const Camera& camera, uint32_t max_bounces, int irradiance_cache_depth) {
+    Hasher hasher;
+    hasher.add(camera.get_position());
+    hasher.add(camera.get_look_at());
+    hasher.add(camera.get_up());
+    hasher.add(camera.get_fovy());
+    hasher.add(camera.get_viewport_size());
+    hasher.add(max_bounces);
+    hasher.add(irradiance_cache_depth);
+    hasher.add(TileCache::TILE_SIZE);
+    return hasher.get();
+}
+
+// The header at the start of a tile file.
+struct TileFileHeader {
+    static constexpr char MAGIC[8] = { 'P', 'T', 'T', 'I', 'L', 'E', '\0', '\0' };
+
+    char magic[8];
+    uint32_t sample_count;
+    int32_t width, height;
+    uint32_t padding = 0;
+    uint64_t scene_hash;
+};
+
+bool TileCache::open(const std::string& directory, uint64_t view_hash, uint64_t scene_hash, glm::ivec2 viewport_size, std::string& error) {
+    std::error_code error_code;
+    std::filesystem::create_directories(directory, error_code);
+    if(!std::filesystem::is_directory(directory)) {
+        error = "could not create the directory " + directory;
+        return false;
+    }
+    this->directory = directory;
+    this->view_hash = view_hash;
+    this->scene_hash = scene_hash;
+    this->viewport_size = viewport_size;
+    tile_count = (viewport_size + TILE_SIZE - 1) / TILE_SIZE;
+    return true;
+}
+
+PixelRegion TileCache::get_tile_region(int tile) const {
+    glm::ivec2 origin = glm::ivec2(tile % tile_count.x, tile / tile_count.x) * TILE_SIZE;
+    return { origin, glm::min(origin + TILE_SIZE, viewport_size) };
+}
+
+std::string TileCache::get_tile_path(int tile) const {
+    char name[64];
+    snprintf(name, sizeof(name), "%016llx-%d.tile", static_cast<unsigned long long>(view_hash), tile);
+    return (std::filesystem::path(directory) / name).string();
+}
+
+bool TileCache::load_tile(int tile, CachedTile& cached_tile) const {
+    FILE* file = fopen(get_tile_path(tile).c_str(), "rb");
+    if(!file) return false;
+    glm::ivec2 size = get_tile_region(tile).get_size();
+    TileFileHeader header;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1
+        && std::memcmp(header.magic, TileFileHeader::MAGIC, sizeof(header.magic)) == 0
+        && header.width == size.x && header.height == size.y;
+    if(valid) {
+        cached_tile.scene_hash = header.scene_hash;
+        cached_tile.sample_count = header.sample_count;
+        cached_tile.image = Image(size.x, size.y);
+        for(int y = 0; y < size.y && valid; ++y) valid = fread(&cached_tile.image(0, y), sizeof(Color), size.x, file) == static_cast<size_t>(size.x);
+    }
+    fclose(file);
+    return valid;
+}
+
+bool TileCache::save_tile(int tile, const CachedTile& cached_tile) const {
+    // The tile is written next to its final path then renamed over it, so a render stopped while writing never leaves a truncated tile.
+    std::string path = get_tile_path(tile);
+    std::string temporary_path = path + ".tmp";
+    FILE* file = fopen(temporary_path.c_str(), "wb");
+    if(!file) return false;
+    // The magic is copied from TileFileHeader::MAGIC below.
+    TileFileHeader header = {
+        .magic = {},
+        .sample_count = cached_tile.sample_count,
+        .width = cached_tile.image.get_width(),
+        .height = cached_tile.image.get_height(),
+        .scene_hash = cached_tile.scene_hash
+    };
+    std::memcpy(header.magic, TileFileHeader::MAGIC, sizeof(header.magic));
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+    for(int y = 0; y < cached_tile.image.get_height() && written; ++y) {
+        written = fwrite(cached_tile.image.get_row(y), sizeof(Color), cached_tile.image.get_width(), file) == static_cast<size_t>(cached_tile.image.get_width());
+    }
+    written = fclose(file) == 0 && written;
+    std::error_code error_code;
+    if(written) std::filesystem::rename(temporary_path, path, error_code);
+    if(!written || error_code) {
+        std::filesystem::remove(temporary_path, error_code);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <image.hpp>
+#include <scene.hpp>
+
+#include <string>
+#include <cstdint>
+
+// A rectangle of pixels of the viewport, from min (included) to max (excluded).
+// As in Image, the rows are numbered from the bottom.
+struct PixelRegion {
+    glm::ivec2 min = glm::ivec2(0), max = glm::ivec2(0);
+
+    inline glm::ivec2 get_size() const { return max - min; }
+    inline bool is_empty() const { return max.x <= min.x || max.y <= min.y; }
+    inline bool overlaps(const PixelRegion& other) const {
+        return min.x < other.max.x && other.min.x < max.x && min.y < other.max.y && other.min.y < max.y;
+    }
+};
+
+// Hashes everything in the scene which affects the rendered image: the shapes, the materials and the background.
+// The camera is left out (see compute_view_hash), so that the tiles of a view can tell which version of the scene they show.
+uint64_t compute_scene_hash(const Scene& scene);
+// Hashes the camera and the render settings which change the image (the bounce limit, and the irradiance cache start depth or -1).
+uint64_t compute_view_hash(const Camera& camera, uint32_t max_bounces, int irradiance_cache_depth);
+
+// A tile of a frame as stored in the tile cache: the average of its samples, with the version of the scene they were rendered from.
+struct CachedTile {
+    uint64_t scene_hash = 0;
+    uint32_t sample_count = 0;
+    Image image = Image(0, 0);
+};
+
+// A directory keeping the accumulation buffer of each tile of the frames rendered from a view, so that a frame can be rendered again
+// by only rendering the tiles which changed (or need more samples) and merging them with the others.
+// The frame is split in square tiles of TILE_SIZE pixels, each stored in its own file named after the view hash and the tile index:
+// a header holding the scene hash and the sample count, followed by the linear colors of the tile.
+class TileCache {
+public:
+    static constexpr int TILE_SIZE = 64;
+
+    // Opens the cache directory (creating it if needed) for the frames of a view. Returns false and sets `error` on failure.
+    bool open(const std::string& directory, uint64_t view_hash, uint64_t scene_hash, glm::ivec2 viewport_size, std::string& error);
+
+    // Getters
+    inline uint64_t get_scene_hash() const { return scene_hash; }
+    inline int get_tile_count() const { return tile_count.x * tile_count.y; }
+    // Returns the pixels covered by a tile (the tiles are smaller on the right and top borders).
+    PixelRegion get_tile_region(int tile) const;
+
+    // Reads a tile from the cache. Returns false if it is not cached (or if its file is corrupted or has the wrong size).
+    bool load_tile(int tile, CachedTile& cached_tile) const;
+    // Writes a tile to the cache, replacing the previous version. Returns true if it was written.
+    // It is safe to call it from multiple threads for different tiles.
+    bool save_tile(int tile, const CachedTile& cached_tile) const;
+
+private:
+    std::string directory;
+    uint64_t view_hash = 0, scene_hash = 0;
+    glm::ivec2 viewport_size = glm::ivec2(0);
+    glm::ivec2 tile_count = glm::ivec2(0);
+
+    std::string get_tile_path(int tile) const;
+};
@@ -0,0 +1,84 @@
+#include "trace.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct TraceEvent {
+    const char* name;
+    int64_t start, duration; // In microseconds.
+};
+
+// The events of a thread. Only its thread appends to it, so recording an event takes no lock.
+struct ThreadTraceBuffer {
+    int thread_id;
+    std::vector<TraceEvent> events;
+};
+
+using TraceClock = std::chrono::steady_clock;
+
+static std::atomic<bool> tracing = false;
+static TraceClock::time_point trace_start;
+// The buffers are owned here rather than by the threads, so the events of the threads which already exited
+// (such as the image writers of the batch mode) are still written. The mutex is only taken to add a buffer.
+static std::mutex buffers_mutex;
+static std::vector<std::unique_ptr<ThreadTraceBuffer>> buffers;
+static thread_local ThreadTraceBuffer* thread_buffer = nullptr;
+
+static ThreadTraceBuffer& get_thread_buffer() {
+    if(!thread_buffer) {
+        std::lock_guard lock(buffers_mutex);
+        buffers.push_back(std::make_unique<ThreadTraceBuffer>());
+        buffers.back()->thread_id = static_cast<int>(buffers.size()) - 1;
+        thread_buffer = buffers.back().get();
+    }
+    return *thread_buffer;
+}
+
+void start_tracing() {
+    trace_start = TraceClock::now();
+    tracing = true;
+}
+
+bool is_tracing() {
+    return tracing.load(std::memory_order_relaxed);
+}
+
+int64_t get_trace_time() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(TraceClock::now() - trace_start).count();
+}
+
+void record_trace_event(const char* name, int64_t start) {
+    get_thread_buffer().events.push_back({ name, start, get_trace_time() - start });
+}
+
+bool write_trace(const std::string& path, std::string& error) {
+    std::ofstream file(path);
+    if(!file) {
+        error = "could not open " + path;
+        return false;
+    }
+    // The events are complete events ("X"), and the threads are named after their order of first event
+    // (the first one is usually the main thread).
+    std::lock_guard lock(buffers_mutex);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    for(const auto& buffer: buffers) {
+        file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->thread_id
+            << ",\"args\":{\"name\":\"thread " << buffer->thread_id << "\"}}";
+        first = false;
+        for(const TraceEvent& event: buffer->events) {
+            file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->thread_id
+                << ",\"ts\":" << event.start << ",\"dur\":" << event.duration << "}";
+        }
+    }
+    file << "\n]}\n";
+    if(!file) {
+        error = "could not write " + path;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+// A timeline of the phases of a run (scene setup, accelerator build, render passes, image writes...) on every thread,
+// written as a Chrome trace which can be opened in chrome://tracing or https://ui.perfetto.dev.
+// Each thread records its events into its own buffer, so the traced scopes never wait on each other.
+// Tracing is disabled until start_tracing is called, and a disabled scope only costs the check of a flag.
+
+// Starts recording the traced scopes of all the threads. The event times are measured from this call.
+void start_tracing();
+// Returns true if the traced scopes are being recorded.
+bool is_tracing();
+// Returns the time since start_tracing in microseconds.
+int64_t get_trace_time();
+// Records a scope which started at `start` (in microseconds since start_tracing) and ends now on the calling thread.
+// The name must outlive the trace (a string literal).
+void record_trace_event(const char* name, int64_t start);
+
+// Writes the events recorded so far to a Chrome trace JSON file, with a track per thread.
+// It must be called while no traced scope is running on another thread.
+// Returns false and sets `error` if the file could not be written.
+bool write_trace(const std::string& path, std::string& error);
+
+// Records the time spent in the enclosing scope under the given name (a string literal) if tracing is enabled.
+class TraceScope {
+public:
+    explicit TraceScope(const char* name): name(is_tracing() ? name : nullptr) {
+        if(this->name) start = get_trace_time();
+    }
+    ~TraceScope() {
+        if(name) record_trace_event(name, start);
+    }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name;
+    int64_t start = 0;
+};